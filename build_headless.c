@@ -0,0 +1,28 @@
+///
+// Build config stuff
+// Headless build: no window, no audio, and graphics are drawn offscreen by the software
+// renderer. This is what we build on Linux for dedicated servers and CI.
+
+#define OOGABOOGA_HEADLESS 1
+
+#define GFX_RENDERER GFX_RENDERER_SOFTWARE
+
+#define INITIAL_PROGRAM_MEMORY_SIZE MB(5)
+
+#define TEMPORARY_STORAGE_SIZE MB(2)
+
+// Run the ooga booga tests before entry
+#define RUN_TESTS 1
+
+// Enable VERY_DEBUG if you are having memory bugs to detect things like heap corruption earlier.
+// #define VERY_DEBUG 1
+
+#define ENTRY_PROC entry
+
+// Ooga booga needs to be included AFTER configuration and BEFORE the program code
+#include "oogabooga/oogabooga.c"
+
+// This is where you swap in your own headless program (server, tool, benchmark...)
+int entry(int argc, char **argv) {
+	return 0;
+}
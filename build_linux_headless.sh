@@ -0,0 +1,11 @@
+#!/bin/sh
+set -e
+rm -rf build
+mkdir build
+
+cd build
+
+# -fno-builtin-printf etc. because ooga booga has its own print procedures which take string, not char*
+gcc -g -o headless ../build_headless.c -O0 -std=gnu11 -I.. -fno-builtin-printf -fno-builtin-sprintf -fno-builtin-fprintf -Wextra -Wno-sign-compare -Wno-unused-parameter -Wno-type-limits -Wno-deprecated-declarations -lm -lpthread -ldl
+
+cd ..
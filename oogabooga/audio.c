@@ -38,6 +38,11 @@
 	player->config.volume                = ...; // (1.0 by default)
 	player->config.playback_speed        = ...; // (1.0 by default)
 	
+	Or all at once, without the audio thread ever seeing half of it:
+	
+	void                  audio_player_set_config(Audio_Player *p, Audio_Playback_Config config);
+	Audio_Playback_Config audio_player_get_config(Audio_Player *p);
+	
 */
 
 
@@ -1139,6 +1144,10 @@ convert_frames(void *dst, Audio_Format dst_format,
 
 
 #define AUDIO_SMOOTH_TRANSITION_TIME_MS 40
+// Logical processors the audio mixing thread may run on (see Cpu_Topology). 0 means anywhere.
+#ifndef AUDIO_THREAD_AFFINITY_MASK
+	#define AUDIO_THREAD_AFFINITY_MASK 0
+#endif
 
 typedef enum Audio_Player_State {
 	AUDIO_PLAYER_STATE_PAUSED,
@@ -1166,8 +1175,9 @@ typedef struct Audio_Player {
 	u64 fade_frames_total;
 	bool release_when_done;
 	// I think we only need to sync when audio thread samples the source, which should be
-	// fairly quick and low contention, hence a spinlock.
-	Spinlock sample_lock; 
+	// fairly quick and low contention, hence a spinlock. It's a ticket lock so the audio
+	// thread taking it every callback can't starve the game thread's setters (and vice versa).
+	Ticket_Lock sample_lock; 
 	
 	// #Cleanup
 	DEPRECATED(Vector3 position, "Use player->config.position_ndc instead"); // ndc space -1 to 1
@@ -1175,8 +1185,11 @@ typedef struct Audio_Player {
 	DEPRECATED(float32 volume, "Use player->config.volume instead");
 	DEPRECATED(float32 playback_speed, "Use player->config.playback_speed instead");
 	
-	// This is safe to set whenever
+	// This is safe to set whenever, but the audio thread may see one field changed and not
+	// another for one callback. audio_player_set_config() changes it all at once.
 	Audio_Playback_Config config;
+	// Audio thread reads config every callback, game thread rarely writes it
+	Seqlock config_lock;
 	
 } Audio_Player;
 #define AUDIO_PLAYERS_PER_BLOCK 128
@@ -1242,7 +1255,7 @@ audio_player_set_state(Audio_Player *p, Audio_Player_State state) {
 
 	if (p->state == state) return;
 
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	p->state = state;
 	
@@ -1258,11 +1271,11 @@ audio_player_set_state(Audio_Player *p, Audio_Player_State state) {
 	p->fade_frames = (u64)round(fade_factor*(float64)p->source.number_of_frames);
 	p->fade_frames_total = p->fade_frames;
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 }
 void
 audio_player_set_time_stamp(Audio_Player *p, float64 time_in_seconds) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
 	float64 full_duration 
@@ -1272,52 +1285,52 @@ audio_player_set_time_stamp(Audio_Player *p, float64 time_in_seconds) {
 	
 	p->frame_index = (u64)round((float64)p->source.number_of_frames*progression);
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 }
 
 bool 
 audio_player_at_source_end(Audio_Player *p) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
     bool finished = p->frame_index == p->source.number_of_frames;
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 
     return finished;
 }
 
 void // 0 - 1
 audio_player_set_progression_factor(Audio_Player *p, float64 factor) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
 	p->frame_index = (u64)round((float64)p->source.number_of_frames*factor);
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 }
 float64 // seconds
 audio_player_get_time_stamp(Audio_Player *p) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
 	float64 full_duration 
 		= (float64)p->source.number_of_frames/(float64)p->source.format.sample_rate;
 	float64 progression = (float64)p->frame_index / (float64)p->source.number_of_frames;
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 	
 	return progression*full_duration;
 }
 float64
 audio_player_get_current_progression_factor(Audio_Player *p) {
 	if (!p->has_source) return 0;
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
 	float64 progression = (float64)p->frame_index / (float64)p->source.number_of_frames;
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 	
 	return progression;
 }
@@ -1326,29 +1339,39 @@ audio_player_set_source(Audio_Player *p, Audio_Source src) {
 
 	float64 last_progression = audio_player_get_current_progression_factor(p);
 	
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 
 	p->source = src;
 	p->has_source = true;
 	
 	p->frame_index = 0;
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 }
 void 
 audio_player_clear_source(Audio_Player *p) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	assert(p->frame_index <= p->source.number_of_frames);
 	
 	p->has_source = false;
 	p->state = AUDIO_PLAYER_STATE_PAUSED;
 	p->source = ZERO(Audio_Source);
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
+}
+void
+audio_player_set_config(Audio_Player *p, Audio_Playback_Config config) {
+	seqlock_write(&p->config_lock, &p->config, &config, sizeof(config));
+}
+Audio_Playback_Config
+audio_player_get_config(Audio_Player *p) {
+	Audio_Playback_Config config;
+	seqlock_read(&p->config_lock, &config, &p->config, sizeof(config));
+	return config;
 }
 void
 audio_player_set_looping(Audio_Player *p, bool looping) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	ticket_lock_acquire_or_wait(&p->sample_lock);
 	
 	if (p->has_source && looping && !p->looping && p->frame_index == p->source.number_of_frames) {
 		p->frame_index = 0;
@@ -1356,7 +1379,7 @@ audio_player_set_looping(Audio_Player *p, bool looping) {
 	
 	p->looping = looping;
 	
-	spinlock_release(&p->sample_lock);
+	ticket_lock_release(&p->sample_lock);
 }
 
 // #Global
@@ -1382,8 +1405,8 @@ void
 play_one_audio_clip_source_with_config(Audio_Source source, Audio_Playback_Config config) {
 	Audio_Player *p = audio_player_get_one();
 	audio_player_set_source(p, source);
+	audio_player_set_config(p, config);
 	audio_player_set_state(p, AUDIO_PLAYER_STATE_PLAYING);
-	p->config = config;
 	p->release_when_done = true;
 }
 
@@ -1703,19 +1726,21 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 				if (p->fade_frames == 0) continue;
 			}
 			
+			Audio_Playback_Config config = audio_player_get_config(p);
+			
 			// #Incomplete Reverse playback ?
-			if (p->config.playback_speed <= 0.0) continue;
+			if (config.playback_speed <= 0.0) continue;
 			
 			if (p->frame_index >= p->source.number_of_frames && !p->looping) continue;
 			
-			spinlock_acquire_or_wait(&p->sample_lock);
+			ticket_lock_acquire_or_wait(&p->sample_lock);
 			
 			Audio_Source src = p->source;
 			
 			mutex_acquire_or_wait(&src.mutex_for_destroy);
 
 			Audio_Format sample_format = src.format;
-			sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
+			sample_format.sample_rate = sample_format.sample_rate*config.playback_speed;
 			
 			bool need_convert = !bytes_match(
 				&out_format, 
@@ -1859,7 +1884,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 				}
 			}
 			
-			spinlock_release(&p->sample_lock);
+			ticket_lock_release(&p->sample_lock);
 						
 			if (need_convert) {
 				int converted = convert_frames(
@@ -1872,11 +1897,11 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 				assert(converted == number_of_output_frames);
 			}
 
-			if (p->config.enable_spacialization) {
-				apply_audio_spacialization(mix_buffer, out_format, number_of_output_frames, p->config.position_ndc);
+			if (config.enable_spacialization) {
+				apply_audio_spacialization(mix_buffer, out_format, number_of_output_frames, config.position_ndc);
 			}
-			if (p->config.volume != 0.0) {
-				apply_audio_volume(mix_buffer, out_format, number_of_output_frames, p->config.volume);
+			if (config.volume != 0.0) {
+				apply_audio_volume(mix_buffer, out_format, number_of_output_frames, config.volume);
 			}
 			
 			mix_frames(output, mix_buffer, number_of_output_frames, out_format);
@@ -62,6 +62,8 @@ typedef enum Allocator_Message {
 	ALLOCATOR_ALLOCATE,
 	ALLOCATOR_DEALLOCATE,
 	ALLOCATOR_REALLOCATE,
+	// The alignment is passed in place of the pointer. Return 0 if it's not supported.
+	ALLOCATOR_ALLOCATE_ALIGNED,
 } Allocator_Message;
 typedef void*(*Allocator_Proc)(u64, void*, Allocator_Message, void*);
 
@@ -92,6 +94,9 @@ typedef struct Context {
 	
 	u64 thread_id;
 	
+	// Heap allocations are counted under this tag, see heap_make_tag()
+	u64 allocation_tag;
+	
 	CONTEXT_EXTRA extra;
 } Context;
 
@@ -114,6 +119,15 @@ alloc_uninitialized(Allocator allocator, u64 size);
 ogb_instance void 
 dealloc(Allocator allocator, void *p);
 
+// Alignment must be a power of two. Deallocate like any other allocation.
+ogb_instance void* 
+alloc_aligned(Allocator allocator, u64 size, u64 alignment);
+
+// Keeps the first min(old_size, new_size) bytes. Allocators which can resize in place
+// (heap, arena) will, otherwise this is alloc + copy + dealloc.
+ogb_instance void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size);
+
 ogb_instance void 
 push_context(Context c);
 
@@ -145,12 +159,43 @@ alloc_uninitialized(Allocator allocator, u64 size) {
 	return allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);	
 }
 
+void* 
+alloc_aligned(Allocator allocator, u64 size, u64 alignment) {
+	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	void *p = allocator.proc(size, (void*)alignment, ALLOCATOR_ALLOCATE_ALIGNED, allocator.data);
+	assert(p, "This allocator does not support aligned allocations");
+	assert((u64)p % alignment == 0, "Allocator returned memory which is not aligned to %llu", alignment);
+#if DO_ZERO_INITIALIZATION
+	memset(p, 0, size);
+#endif
+	return p;
+}
+
 void 
 dealloc(Allocator allocator, void *p) {
 	assert(p != 0, "You tried to deallocate a pointer at adress 0. That doesn't make sense!");
 	allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
 }
 
+void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	assert(new_size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	if (!p) return alloc(allocator, new_size);
+	
+	void *new = allocator.proc(new_size, p, ALLOCATOR_REALLOCATE, allocator.data);
+	if (!new) {
+		// Allocator can't reallocate
+		new = allocator.proc(new_size, 0, ALLOCATOR_ALLOCATE, allocator.data);
+		memcpy(new, p, old_size < new_size ? old_size : new_size);
+		allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
+	}
+#if DO_ZERO_INITIALIZATION
+	if (new_size > old_size) memset((u8*)new + old_size, 0, new_size - old_size);
+#endif
+	return new;
+}
+
 void 
 push_context(Context c) {
 	assert(num_contexts < CONTEXT_STACK_MAX, "Context stack overflow");
@@ -2,6 +2,12 @@
 typedef struct Spinlock Spinlock;
 typedef struct Mutex Mutex;
 typedef struct Binary_Semaphore Binary_Semaphore;
+typedef struct Semaphore Semaphore;
+typedef struct Rw_Lock Rw_Lock;
+typedef struct Seqlock Seqlock;
+typedef struct Fiber Fiber;
+typedef struct Spsc_Queue Spsc_Queue;
+typedef struct Mpmc_Queue Mpmc_Queue;
 
 // These are probably your best friend for sync-free multi-processing.
 inline bool compare_and_swap_8(volatile uint8_t *a, uint8_t b, uint8_t old);
@@ -10,6 +16,50 @@ inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
 
+// Sets *a to b and returns what it was
+inline uint32_t exchange_32(volatile uint32_t *a, uint32_t b);
+
+///
+// Atomics
+// For counters and flags that don't need a full compare_and_swap loop or MEMORY_BARRIER.
+// The fetch_* and exchange procedures return the value from before.
+// See Memory_Order in cpu.c; MEMORY_ORDER_RELAXED is enough for stat counters.
+inline uint8_t atomic_load_8(volatile uint8_t *a, Memory_Order order);
+inline void atomic_store_8(volatile uint8_t *a, uint8_t b, Memory_Order order);
+inline uint8_t atomic_fetch_add_8(volatile uint8_t *a, uint8_t b, Memory_Order order);
+inline uint8_t atomic_fetch_sub_8(volatile uint8_t *a, uint8_t b, Memory_Order order);
+inline uint8_t atomic_exchange_8(volatile uint8_t *a, uint8_t b, Memory_Order order);
+inline uint8_t atomic_fetch_or_8(volatile uint8_t *a, uint8_t b, Memory_Order order);
+inline uint8_t atomic_fetch_and_8(volatile uint8_t *a, uint8_t b, Memory_Order order);
+
+inline uint16_t atomic_load_16(volatile uint16_t *a, Memory_Order order);
+inline void atomic_store_16(volatile uint16_t *a, uint16_t b, Memory_Order order);
+inline uint16_t atomic_fetch_add_16(volatile uint16_t *a, uint16_t b, Memory_Order order);
+inline uint16_t atomic_fetch_sub_16(volatile uint16_t *a, uint16_t b, Memory_Order order);
+inline uint16_t atomic_exchange_16(volatile uint16_t *a, uint16_t b, Memory_Order order);
+inline uint16_t atomic_fetch_or_16(volatile uint16_t *a, uint16_t b, Memory_Order order);
+inline uint16_t atomic_fetch_and_16(volatile uint16_t *a, uint16_t b, Memory_Order order);
+
+inline uint32_t atomic_load_32(volatile uint32_t *a, Memory_Order order);
+inline void atomic_store_32(volatile uint32_t *a, uint32_t b, Memory_Order order);
+inline uint32_t atomic_fetch_add_32(volatile uint32_t *a, uint32_t b, Memory_Order order);
+inline uint32_t atomic_fetch_sub_32(volatile uint32_t *a, uint32_t b, Memory_Order order);
+inline uint32_t atomic_exchange_32(volatile uint32_t *a, uint32_t b, Memory_Order order);
+inline uint32_t atomic_fetch_or_32(volatile uint32_t *a, uint32_t b, Memory_Order order);
+inline uint32_t atomic_fetch_and_32(volatile uint32_t *a, uint32_t b, Memory_Order order);
+
+inline uint64_t atomic_load_64(volatile uint64_t *a, Memory_Order order);
+inline void atomic_store_64(volatile uint64_t *a, uint64_t b, Memory_Order order);
+inline uint64_t atomic_fetch_add_64(volatile uint64_t *a, uint64_t b, Memory_Order order);
+inline uint64_t atomic_fetch_sub_64(volatile uint64_t *a, uint64_t b, Memory_Order order);
+inline uint64_t atomic_exchange_64(volatile uint64_t *a, uint64_t b, Memory_Order order);
+inline uint64_t atomic_fetch_or_64(volatile uint64_t *a, uint64_t b, Memory_Order order);
+inline uint64_t atomic_fetch_and_64(volatile uint64_t *a, uint64_t b, Memory_Order order);
+
+inline void* atomic_load_ptr(void *volatile *a, Memory_Order order);
+inline void atomic_store_ptr(void *volatile *a, void *b, Memory_Order order);
+inline void* atomic_exchange_ptr(void *volatile *a, void *b, Memory_Order order);
+
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
@@ -31,17 +81,59 @@ spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds);
 void ogb_instance
 spinlock_release(Spinlock* l);
 
+///
+// Backoff for spin loops
+// Each call pauses twice as long as the last one, up to SPIN_BACKOFF_MAX_PAUSES, and after
+// SPIN_BACKOFF_YIELD_AFTER calls it starts yielding the thread instead. Waiters that back off
+// stay out of the lock's cache line, which is what lets the holder actually release it, and
+// yielding lets a preempted holder (or a hyperthread sibling) get some time.
+//
+//    Spin_Backoff backoff = ZERO(Spin_Backoff);
+//    while (!try_thing()) spin_backoff(&backoff);
+#define SPIN_BACKOFF_MAX_PAUSES 64
+#define SPIN_BACKOFF_YIELD_AFTER 16
+typedef struct Spin_Backoff {
+	u32 pauses;
+	u32 count;
+} Spin_Backoff;
+
+void ogb_instance
+spin_backoff(Spin_Backoff *b);
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
-// Just spins for a few (configurable) microseconds with a spinlock,
-// and if acquiring fails it falls back to a OS mutex.
-#define MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS 100
+// Ticket lock
+// A spinlock which hands the lock out first come first served, so one thread which keeps
+// re-acquiring it can't starve another. Uncontended it costs the same as Spinlock, but under
+// contention every release has to reach the next thread in line, so throughput is lower.
+// Use it where fairness matters more than throughput.
+#define TICKET_LOCK_PAUSES_PER_WAITER 32
+typedef struct Ticket_Lock {
+	volatile u32 next_ticket;
+	volatile u32 now_serving;
+} Ticket_Lock;
+
+void ogb_instance
+ticket_lock_init(Ticket_Lock *l);
+
+void ogb_instance
+ticket_lock_acquire_or_wait(Ticket_Lock *l);
+
+void ogb_instance
+ticket_lock_release(Ticket_Lock *l);
+
+
+///
+// High-level mutex primitive (short spin then sleep on the OS)
+// It's just one atomic word, so acquiring and releasing without contention is a single
+// compare_and_swap and no OS calls. If it's taken, we spin for a bit (configurable) in
+// case it's released soon, and then sleep with os_wait_on_address() until it's released.
+#define MUTEX_DEFAULT_SPIN_COUNT 100
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+#define MUTEX_LOCKED_WITH_WAITERS 2
 typedef struct Mutex {
-	Spinlock spinlock;
-	f64 spin_time_microseconds;
-	Mutex_Handle os_handle;
-	volatile bool spinlock_acquired;
+	volatile u32 state;
+	u32 spin_count;
 	volatile u64 acquiring_thread;
 } Mutex;
 
@@ -60,9 +152,10 @@ mutex_release(Mutex *m);
 
 ///
 // Binary semaphore
+// Waiting sleeps until it's signaled.
 typedef struct Binary_Semaphore {
-    volatile bool signaled;
-    Mutex mutex;
+    volatile u32 signaled;
+    volatile u32 waiter_count;
 } Binary_Semaphore;
 
 void ogb_instance
@@ -78,32 +171,258 @@ void ogb_instance
 binary_semaphore_signal(Binary_Semaphore *sem);
 
 
+///
+// Counting semaphore
+// Waiting takes one from the count, or sleeps until there is one.
+typedef struct Semaphore {
+	volatile u32 count;
+	volatile u32 waiter_count;
+} Semaphore;
+
+void ogb_instance
+semaphore_init(Semaphore *sem, u32 initial_count);
+
+void ogb_instance
+semaphore_destroy(Semaphore *sem);
+
+void ogb_instance
+semaphore_wait(Semaphore *sem);
+
+// Returns false instead of waiting if the count is 0
+bool ogb_instance
+semaphore_try_wait(Semaphore *sem);
+
+void ogb_instance
+semaphore_signal(Semaphore *sem, u32 count);
+
+
+///
+// Reader-writer lock
+// Any number of readers or one writer. Writer-preferring: once a writer is waiting, new
+// readers wait too so a steady stream of readers can't starve it.
+// Like Mutex it's one atomic word; waiters spin for a bit and then os_wait_on_address().
+#define RW_LOCK_SPIN_COUNT 100
+#define RW_LOCK_READER_MASK    0x1FFFFFFF
+#define RW_LOCK_SLEEPERS       (1u << 29) // Someone is in os_wait_on_address, release has to wake
+#define RW_LOCK_WRITER_WAITING (1u << 30)
+#define RW_LOCK_WRITER_HELD    (1u << 31)
+typedef struct Rw_Lock {
+	volatile u32 state;
+	volatile u32 writers_waiting;
+} Rw_Lock;
+
+void ogb_instance
+rw_lock_init(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_destroy(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_acquire_read(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_release_read(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_acquire_write(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_release_write(Rw_Lock *l);
+
+
+///
+// Seqlock
+// For small plain data which is read a lot and written rarely (configs, transforms).
+// Readers never block and never write to the lock, they copy the data and retry if a
+// writer was in the middle of changing it. Writers are serialized with each other.
+//
+//    Audio_Playback_Config config;
+//    seqlock_read(&lock, &config, &shared_config, sizeof(config));
+//
+// Or by hand, for when you don't want to copy everything:
+//
+//    u32 seq;
+//    do {
+//        seq = seqlock_read_begin(&lock);
+//        volume = shared_config.volume;
+//    } while (seqlock_read_retry(&lock, seq));
+//
+// Only read plain values inside the loop, they may be torn until the retry check.
+typedef struct Seqlock {
+	volatile u32 sequence; // Odd while a writer is writing
+} Seqlock;
+
+void ogb_instance
+seqlock_init(Seqlock *l);
+
+u32 ogb_instance
+seqlock_read_begin(Seqlock *l);
+
+// True if the data changed since seqlock_read_begin() and needs to be read again
+bool ogb_instance
+seqlock_read_retry(Seqlock *l, u32 sequence);
+
+void ogb_instance
+seqlock_write_begin(Seqlock *l);
+
+void ogb_instance
+seqlock_write_end(Seqlock *l);
+
+void ogb_instance
+seqlock_read(Seqlock *l, void *dst, void *shared_src, u64 size);
+
+void ogb_instance
+seqlock_write(Seqlock *l, void *shared_dst, void *src, u64 size);
+
+
+///
+// Fibers
+// A fiber is a stack plus the registers needed to continue running on it. fiber_switch()
+// saves where we are into 'from' and continues 'to' where it left off, without the OS.
+// A fiber can be continued on a different thread than the one it was switched away on.
+//
+// #Portability x64 only. Context switching is written by hand for the SysV (Linux) and Win64
+// calling conventions: callee-saved registers, mxcsr and the x87 control word (and on
+// Windows the stack bounds in the TEB, which stack probes look at).
+//
+// #Volatile Be careful with thread_local's in code that can switch threads. The compiler may
+// keep the address of a thread_local around from before the switch.
+typedef void(*Fiber_Proc)(void *data);
+typedef struct Fiber {
+	void *stack_pointer;
+} Fiber;
+
+// proc(data) runs on the first switch to the fiber. It must never return, switch away instead.
+// The stack must stay alive as long as the fiber is used.
+void ogb_instance
+fiber_init(Fiber *f, void *stack, u64 stack_size, Fiber_Proc proc, void *data);
+
+// 'from' doesn't need to be initialized, that's how a thread's own stack becomes a fiber to
+// switch back to.
+void ogb_instance
+fiber_switch(Fiber *from, Fiber *to);
+
+
+///
+// Lock-free queues
+// Bounded ring buffers of fixed size items which are copied in and out.
+// Capacity is rounded up to a power of two. Push returns false when full and pop returns
+// false when empty, they never wait.
+// The _batch versions push/pop as many as they can (up to count) and return how many.
+//
+// #Portability
+// These rely on x64 not reordering stores with other stores or loads with other loads, so
+// only the compiler needs to be stopped from reordering.
+
+#define QUEUE_CACHE_LINE_SIZE 64
+
+///
+// Single producer, single consumer
+// Wait-free: one thread pushes and one thread pops, no compare_and_swap at all.
+typedef struct Spsc_Queue {
+	// Consumer's cache line
+	volatile u64 head;
+	u64 cached_tail;
+	u8 _pad0[QUEUE_CACHE_LINE_SIZE-sizeof(u64)*2];
+	
+	// Producer's cache line
+	volatile u64 tail;
+	u64 cached_head;
+	u8 _pad1[QUEUE_CACHE_LINE_SIZE-sizeof(u64)*2];
+	
+	u64 capacity;
+	u64 item_size;
+	u8 *items;
+	Allocator allocator;
+} Spsc_Queue;
+
+#define spsc_queue_init(queue_ptr, Item_Type, capacity, allocator) spsc_queue_init_raw((queue_ptr), sizeof(Item_Type), (capacity), (allocator))
+
+void ogb_instance
+spsc_queue_init_raw(Spsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+
+void ogb_instance
+spsc_queue_destroy(Spsc_Queue *q);
+
+bool ogb_instance
+spsc_queue_push(Spsc_Queue *q, void *item);
+
+bool ogb_instance
+spsc_queue_pop(Spsc_Queue *q, void *item);
+
+u64 ogb_instance
+spsc_queue_push_batch(Spsc_Queue *q, void *items, u64 count);
+
+u64 ogb_instance
+spsc_queue_pop_batch(Spsc_Queue *q, void *items, u64 max_count);
+
+///
+// Multi producer, multi consumer
+// Dmitry Vyukov's bounded queue: each cell has a sequence number which tells producers and
+// consumers whose turn it is, so they only compare_and_swap the position to claim cells.
+typedef struct Mpmc_Queue {
+	volatile u64 enqueue_pos;
+	u8 _pad0[QUEUE_CACHE_LINE_SIZE-sizeof(u64)];
+	
+	volatile u64 dequeue_pos;
+	u8 _pad1[QUEUE_CACHE_LINE_SIZE-sizeof(u64)];
+	
+	u64 capacity;
+	u64 item_size;
+	u64 cell_stride;
+	u8 *cells;
+	Allocator allocator;
+} Mpmc_Queue;
+
+#define mpmc_queue_init(queue_ptr, Item_Type, capacity, allocator) mpmc_queue_init_raw((queue_ptr), sizeof(Item_Type), (capacity), (allocator))
+
+void ogb_instance
+mpmc_queue_init_raw(Mpmc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+
+void ogb_instance
+mpmc_queue_destroy(Mpmc_Queue *q);
+
+bool ogb_instance
+mpmc_queue_push(Mpmc_Queue *q, void *item);
+
+bool ogb_instance
+mpmc_queue_pop(Mpmc_Queue *q, void *item);
+
+u64 ogb_instance
+mpmc_queue_push_batch(Mpmc_Queue *q, void *items, u64 count);
+
+u64 ogb_instance
+mpmc_queue_pop_batch(Mpmc_Queue *q, void *items, u64 max_count);
+
+
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 void spinlock_init(Spinlock *l) {
 	memset(l, 0, sizeof(*l));
 }
 void spinlock_acquire_or_wait(Spinlock* l) {
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
 	while (true) {
         bool expected = false;
         if (compare_and_swap_bool(&l->locked, true, expected)) {
             return;
         }
         while (l->locked) {
-            // spinny boi
+            spin_backoff(&backoff);
         }
     }
 }
 // Returns true on aquired, false if timeout seconds reached
 bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
     f64 start = os_get_current_time_in_seconds();
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
 	while (true) {
         bool expected = false;
         if (compare_and_swap_bool(&l->locked, true, expected)) {
             return true;
         }
         while (l->locked) {
-            // spinny boi
+            spin_backoff(&backoff);
             if ((os_get_current_time_in_seconds()-start) >= timeout_seconds) return false;
         }
     }
@@ -115,26 +434,76 @@ void spinlock_release(Spinlock* l) {
     assert(success, "This thread should have acquired the spinlock but compare_and_swap failed");
 }
 
+void spin_backoff(Spin_Backoff *b) {
+	if (b->count >= SPIN_BACKOFF_YIELD_AFTER) {
+		os_yield_thread();
+		return;
+	}
+	b->count += 1;
+	b->pauses = b->pauses ? min(b->pauses*2, SPIN_BACKOFF_MAX_PAUSES) : 1;
+	for (u32 i = 0; i < b->pauses; i++) _mm_pause();
+}
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
+// Ticket lock
+
+void ticket_lock_init(Ticket_Lock *l) {
+	l->next_ticket = 0;
+	l->now_serving = 0;
+}
+void ticket_lock_acquire_or_wait(Ticket_Lock *l) {
+	u32 ticket = atomic_fetch_add_32(&l->next_ticket, 1, MEMORY_ORDER_RELAXED);
+	u32 spins = 0;
+	while (true) {
+		u32 serving = atomic_load_32(&l->now_serving, MEMORY_ORDER_ACQUIRE);
+		if (serving == ticket) return;
+		
+		// Everyone ahead of us holds it for a bit, so wait in proportion to how far back we are
+		// instead of all hammering now_serving. If it's taking long then whoever is in front of
+		// us is probably not running, and nobody behind them can go until they do.
+		if (spins++ < SPIN_BACKOFF_YIELD_AFTER) {
+			u32 pauses = (ticket-serving)*TICKET_LOCK_PAUSES_PER_WAITER;
+			for (u32 i = 0; i < pauses; i++) _mm_pause();
+		} else {
+			os_yield_thread();
+		}
+	}
+}
+void ticket_lock_release(Ticket_Lock *l) {
+	u32 serving = l->now_serving; // Only the holder writes it
+	assert(serving != l->next_ticket, "Released a Ticket_Lock which wasn't acquired");
+	atomic_store_32(&l->now_serving, serving+1, MEMORY_ORDER_RELEASE);
+}
+
+
+///
+// High-level mutex primitive (short spin then sleep on the OS)
 
 void mutex_init(Mutex *m) {
-	spinlock_init(&m->spinlock);
-	m->spin_time_microseconds = MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS;
-	m->os_handle = os_make_mutex();
-	m->spinlock_acquired = false;
+	m->state = MUTEX_UNLOCKED;
+	m->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
 	m->acquiring_thread = 0;
 }
 void mutex_destroy(Mutex *m) {
-	os_destroy_mutex(m->os_handle);
+	assert(m->state == MUTEX_UNLOCKED, "Destroying a mutex which is acquired");
 }
 void mutex_acquire_or_wait(Mutex *m) {
-	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
-        assert(!m->spinlock_acquired, "Internal sync error in Mutex");
-    	m->spinlock_acquired = true;
-    }
-    os_lock_mutex(m->os_handle);
+	bool acquired = false;
+	for (u32 i = 0; i <= m->spin_count; i++) {
+		if (m->state == MUTEX_UNLOCKED && compare_and_swap_32(&m->state, MUTEX_LOCKED, MUTEX_UNLOCKED)) {
+			acquired = true;
+			break;
+		}
+		_mm_pause();
+	}
+	
+	if (!acquired) {
+		// Whoever releases it has to wake someone up from now on. If it was unlocked when we
+		// swapped then we got it (and we can't know if there are other waiters so stay at 2).
+		while (exchange_32(&m->state, MUTEX_LOCKED_WITH_WAITERS) != MUTEX_UNLOCKED) {
+			os_wait_on_address(&m->state, MUTEX_LOCKED_WITH_WAITERS);
+		}
+	}
     
     assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
     m->acquiring_thread = context.thread_id;
@@ -143,40 +512,559 @@ void mutex_release(Mutex *m) {
 	assert(m->acquiring_thread != 0, "Tried to release a mutex which is not acquired");
 	assert(m->acquiring_thread == context.thread_id, "Non-owning thread tried to release mutex");
 	m->acquiring_thread = 0;
-	bool was_spinlock_acquired = m->spinlock_acquired;
-	m->spinlock_acquired = false;
-	os_unlock_mutex(m->os_handle);
-	if (was_spinlock_acquired) {
-		spinlock_release(&m->spinlock);
+	if (exchange_32(&m->state, MUTEX_UNLOCKED) == MUTEX_LOCKED_WITH_WAITERS) {
+		os_wake_one_on_address(&m->state);
 	}
 }
 
 
+///
+// Binary semaphore
 
 void binary_semaphore_init(Binary_Semaphore *sem, bool initial_state) {
-    sem->signaled = initial_state;
-    mutex_init(&sem->mutex);
+    sem->signaled = initial_state ? 1 : 0;
+    sem->waiter_count = 0;
 }
 
 void binary_semaphore_destroy(Binary_Semaphore *sem) {
-    mutex_destroy(&sem->mutex);
+    assert(sem->waiter_count == 0, "Destroying a semaphore which is being waited on");
 }
 
 void binary_semaphore_wait(Binary_Semaphore *sem) {
-    mutex_acquire_or_wait(&sem->mutex);
-    while (!sem->signaled) {
-        mutex_release(&sem->mutex);
-        os_yield_thread();
-        mutex_acquire_or_wait(&sem->mutex);
+	if (compare_and_swap_32(&sem->signaled, 0, 1)) return;
+	
+	atomic_fetch_add_32(&sem->waiter_count, 1, MEMORY_ORDER_SEQ_CST);
+	
+    while (!compare_and_swap_32(&sem->signaled, 0, 1)) {
+    	os_wait_on_address(&sem->signaled, 0);
     }
-    sem->signaled = false;
-    mutex_release(&sem->mutex);
+    
+	atomic_fetch_sub_32(&sem->waiter_count, 1, MEMORY_ORDER_RELAXED);
 }
 
 void binary_semaphore_signal(Binary_Semaphore *sem) {
-    mutex_acquire_or_wait(&sem->mutex);
-    sem->signaled = true;
-    mutex_release(&sem->mutex);
+	// exchange is a full barrier so we see waiter_count from anyone who's about to sleep
+	exchange_32(&sem->signaled, 1);
+	if (sem->waiter_count > 0) os_wake_one_on_address(&sem->signaled);
+}
+
+
+///
+// Counting semaphore
+
+void semaphore_init(Semaphore *sem, u32 initial_count) {
+	sem->count = initial_count;
+	sem->waiter_count = 0;
+}
+
+void semaphore_destroy(Semaphore *sem) {
+    assert(sem->waiter_count == 0, "Destroying a semaphore which is being waited on");
+}
+
+bool semaphore_try_wait(Semaphore *sem) {
+	u32 count;
+	do {
+		count = sem->count;
+		if (count == 0) return false;
+	} while (!compare_and_swap_32(&sem->count, count-1, count));
+	return true;
+}
+
+void semaphore_wait(Semaphore *sem) {
+	if (semaphore_try_wait(sem)) return;
+	
+	atomic_fetch_add_32(&sem->waiter_count, 1, MEMORY_ORDER_SEQ_CST);
+	
+	while (!semaphore_try_wait(sem)) {
+		os_wait_on_address(&sem->count, 0);
+	}
+	
+	atomic_fetch_sub_32(&sem->waiter_count, 1, MEMORY_ORDER_RELAXED);
+}
+
+void semaphore_signal(Semaphore *sem, u32 count) {
+	if (count == 0) return;
+	// seq_cst so the waiter_count load below can't happen before it
+	atomic_fetch_add_32(&sem->count, count, MEMORY_ORDER_SEQ_CST);
+	
+	if (sem->waiter_count > 0) {
+		if (count == 1) os_wake_one_on_address(&sem->count);
+		else            os_wake_all_on_address(&sem->count);
+	}
+}
+
+
+///
+// Reader-writer lock
+
+void rw_lock_init(Rw_Lock *l) {
+	l->state = 0;
+	l->writers_waiting = 0;
+}
+void rw_lock_destroy(Rw_Lock *l) {
+	assert(l->state == 0, "Destroying a Rw_Lock which is still held or waited on");
+}
+
+// Sleep until state is no longer what we saw. Sets RW_LOCK_SLEEPERS first so whoever
+// changes it knows to wake us, or returns right away if it already changed.
+void rw_lock_sleep(Rw_Lock *l, u32 seen) {
+	if (!(seen & RW_LOCK_SLEEPERS)) {
+		if (!compare_and_swap_32(&l->state, seen | RW_LOCK_SLEEPERS, seen)) return;
+		seen |= RW_LOCK_SLEEPERS;
+	}
+	os_wait_on_address(&l->state, seen);
+}
+
+void rw_lock_acquire_read(Rw_Lock *l) {
+	u64 spins = 0;
+	while (true) {
+		u32 state = atomic_load_32(&l->state, MEMORY_ORDER_RELAXED);
+		if (!(state & (RW_LOCK_WRITER_HELD | RW_LOCK_WRITER_WAITING))) {
+			assert((state & RW_LOCK_READER_MASK) != RW_LOCK_READER_MASK, "Too many readers on Rw_Lock");
+			if (compare_and_swap_32(&l->state, state+1, state)) return;
+			continue;
+		}
+		if (spins++ < RW_LOCK_SPIN_COUNT) {
+			_mm_pause();
+			continue;
+		}
+		rw_lock_sleep(l, state);
+	}
+}
+void rw_lock_release_read(Rw_Lock *l) {
+	u32 state = atomic_fetch_sub_32(&l->state, 1, MEMORY_ORDER_RELEASE);
+	assert(state & RW_LOCK_READER_MASK, "Released read on a Rw_Lock which wasn't read-acquired");
+	// Last reader out lets a sleeping writer in
+	if ((state & RW_LOCK_READER_MASK) == 1 && (state & RW_LOCK_SLEEPERS)) {
+		atomic_fetch_and_32(&l->state, ~RW_LOCK_SLEEPERS, MEMORY_ORDER_RELAXED);
+		os_wake_all_on_address(&l->state);
+	}
+}
+
+void rw_lock_acquire_write(Rw_Lock *l) {
+	if (compare_and_swap_32(&l->state, RW_LOCK_WRITER_HELD, 0)) return;
+	
+	atomic_fetch_add_32(&l->writers_waiting, 1, MEMORY_ORDER_SEQ_CST);
+	u64 spins = 0;
+	while (true) {
+		u32 state = atomic_load_32(&l->state, MEMORY_ORDER_RELAXED);
+		if (!(state & (RW_LOCK_READER_MASK | RW_LOCK_WRITER_HELD))) {
+			// Keep readers out if there are more writers behind us. A writer which starts
+			// waiting after this sets RW_LOCK_WRITER_WAITING itself.
+			u32 new_state = RW_LOCK_WRITER_HELD | (state & RW_LOCK_SLEEPERS);
+			if (atomic_load_32(&l->writers_waiting, MEMORY_ORDER_SEQ_CST) > 1) new_state |= RW_LOCK_WRITER_WAITING;
+			if (compare_and_swap_32(&l->state, new_state, state)) break;
+			continue;
+		}
+		if (!(state & RW_LOCK_WRITER_WAITING)) {
+			compare_and_swap_32(&l->state, state | RW_LOCK_WRITER_WAITING, state);
+			continue;
+		}
+		if (spins++ < RW_LOCK_SPIN_COUNT) {
+			_mm_pause();
+			continue;
+		}
+		rw_lock_sleep(l, state);
+	}
+	atomic_fetch_sub_32(&l->writers_waiting, 1, MEMORY_ORDER_RELAXED);
+}
+void rw_lock_release_write(Rw_Lock *l) {
+	u32 new_state = atomic_load_32(&l->writers_waiting, MEMORY_ORDER_SEQ_CST) > 0 ? RW_LOCK_WRITER_WAITING : 0;
+	u32 state = atomic_exchange_32(&l->state, new_state, MEMORY_ORDER_RELEASE);
+	assert(state & RW_LOCK_WRITER_HELD, "Released write on a Rw_Lock which wasn't write-acquired");
+	if (state & RW_LOCK_SLEEPERS) os_wake_all_on_address(&l->state);
+}
+
+
+///
+// Seqlock
+
+void seqlock_init(Seqlock *l) {
+	l->sequence = 0;
+}
+
+u32 seqlock_read_begin(Seqlock *l) {
+	while (true) {
+		u32 sequence = atomic_load_32(&l->sequence, MEMORY_ORDER_ACQUIRE);
+		if (!(sequence & 1)) return sequence;
+		_mm_pause();
+	}
+}
+bool seqlock_read_retry(Seqlock *l, u32 sequence) {
+	// #Portability x64 doesn't reorder loads with other loads, so the reads of the data
+	// can't move past this as long as the compiler doesn't move them.
+	COMPILER_BARRIER;
+	return atomic_load_32(&l->sequence, MEMORY_ORDER_ACQUIRE) != sequence;
+}
+
+void seqlock_write_begin(Seqlock *l) {
+	while (true) {
+		u32 sequence = atomic_load_32(&l->sequence, MEMORY_ORDER_RELAXED);
+		if (!(sequence & 1) && compare_and_swap_32(&l->sequence, sequence+1, sequence)) return;
+		_mm_pause();
+	}
+}
+void seqlock_write_end(Seqlock *l) {
+	assert(l->sequence & 1, "seqlock_write_end without seqlock_write_begin");
+	atomic_store_32(&l->sequence, l->sequence+1, MEMORY_ORDER_RELEASE);
+}
+
+void seqlock_read(Seqlock *l, void *dst, void *shared_src, u64 size) {
+	u32 sequence;
+	do {
+		sequence = seqlock_read_begin(l);
+		memcpy(dst, shared_src, size);
+	} while (seqlock_read_retry(l, sequence));
+}
+void seqlock_write(Seqlock *l, void *shared_dst, void *src, u64 size) {
+	seqlock_write_begin(l);
+	memcpy(shared_dst, src, size);
+	seqlock_write_end(l);
+}
+
+
+///
+// Fibers
+//
+// The switch pushes the callee-saved registers, saves the stack pointer to *save_stack_pointer
+// and pops everything back from load_stack_pointer. ogb_fiber_start is where a new fiber
+// "returns" to on its first switch, with proc in r12 and data in rbx.
+//
+// SysV frame (low to high): mxcsr+fpu cw, r15, r14, r13, r12, rbx, rbp, return address
+// Win64 frame (low to high): xmm6-xmm15, mxcsr+fpu cw, padding, TEB DeallocationStack,
+//                            TEB StackLimit, TEB StackBase, r15, r14, r13, r12, rsi, rdi,
+//                            rbx, rbp, return address
+
+#if TARGET_OS == WINDOWS
+	#define FIBER_FRAME_SLOTS 34
+	#define FIBER_FRAME_CSR 20
+	#define FIBER_FRAME_DEALLOCATION_STACK 22
+	#define FIBER_FRAME_STACK_LIMIT 23
+	#define FIBER_FRAME_STACK_BASE 24
+	#define FIBER_FRAME_R12 28
+	#define FIBER_FRAME_RBX 31
+	#define FIBER_FRAME_RETURN 33
+#else
+	#define FIBER_FRAME_SLOTS 8
+	#define FIBER_FRAME_CSR 0
+	#define FIBER_FRAME_R12 4
+	#define FIBER_FRAME_RBX 5
+	#define FIBER_FRAME_RETURN 7
+#endif
+
+#if COMPILER_MSVC
+	// No inline assembly on x64 msvc, so this is the Win64 version below assembled and put
+	// straight in .text
+	#pragma section(".text")
+	__declspec(allocate(".text")) const u8 ogb_fiber_code[] = {
+		0x55, 0x53, 0x57, 0x56, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x65, 0x48, 0x8B, 0x04,
+		0x25, 0x08, 0x00, 0x00, 0x00, 0x50, 0x65, 0x48, 0x8B, 0x04, 0x25, 0x10, 0x00, 0x00, 0x00, 0x50,
+		0x65, 0x48, 0x8B, 0x04, 0x25, 0x78, 0x14, 0x00, 0x00, 0x50, 0x48, 0x81, 0xEC, 0xB0, 0x00, 0x00,
+		0x00, 0x0F, 0xAE, 0x9C, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xD9, 0xBC, 0x24, 0xA4, 0x00, 0x00, 0x00,
+		0x0F, 0x11, 0x34, 0x24, 0x0F, 0x11, 0x7C, 0x24, 0x10, 0x44, 0x0F, 0x11, 0x44, 0x24, 0x20, 0x44,
+		0x0F, 0x11, 0x4C, 0x24, 0x30, 0x44, 0x0F, 0x11, 0x54, 0x24, 0x40, 0x44, 0x0F, 0x11, 0x5C, 0x24,
+		0x50, 0x44, 0x0F, 0x11, 0x64, 0x24, 0x60, 0x44, 0x0F, 0x11, 0x6C, 0x24, 0x70, 0x44, 0x0F, 0x11,
+		0xB4, 0x24, 0x80, 0x00, 0x00, 0x00, 0x44, 0x0F, 0x11, 0xBC, 0x24, 0x90, 0x00, 0x00, 0x00, 0x48,
+		0x89, 0x21, 0x48, 0x89, 0xD4, 0x0F, 0x10, 0x34, 0x24, 0x0F, 0x10, 0x7C, 0x24, 0x10, 0x44, 0x0F,
+		0x10, 0x44, 0x24, 0x20, 0x44, 0x0F, 0x10, 0x4C, 0x24, 0x30, 0x44, 0x0F, 0x10, 0x54, 0x24, 0x40,
+		0x44, 0x0F, 0x10, 0x5C, 0x24, 0x50, 0x44, 0x0F, 0x10, 0x64, 0x24, 0x60, 0x44, 0x0F, 0x10, 0x6C,
+		0x24, 0x70, 0x44, 0x0F, 0x10, 0xB4, 0x24, 0x80, 0x00, 0x00, 0x00, 0x44, 0x0F, 0x10, 0xBC, 0x24,
+		0x90, 0x00, 0x00, 0x00, 0x0F, 0xAE, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xD9, 0xAC, 0x24, 0xA4,
+		0x00, 0x00, 0x00, 0x48, 0x81, 0xC4, 0xB0, 0x00, 0x00, 0x00, 0x58, 0x65, 0x48, 0x89, 0x04, 0x25,
+		0x78, 0x14, 0x00, 0x00, 0x58, 0x65, 0x48, 0x89, 0x04, 0x25, 0x10, 0x00, 0x00, 0x00, 0x58, 0x65,
+		0x48, 0x89, 0x04, 0x25, 0x08, 0x00, 0x00, 0x00, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C,
+		0x5E, 0x5F, 0x5B, 0x5D, 0xC3, 0x48, 0x89, 0xD9, 0x48, 0x83, 0xEC, 0x20, 0x41, 0xFF, 0xD4, 0x0F,
+		0x0B,
+	};
+	#define ogb_fiber_switch ((void(*)(void**, void*))(void*)ogb_fiber_code)
+	#define ogb_fiber_start ((void*)(ogb_fiber_code + 0x105))
+#elif COMPILER_GCC || COMPILER_CLANG
+	void ogb_fiber_switch(void **save_stack_pointer, void *load_stack_pointer);
+	void ogb_fiber_start();
+	
+	#if TARGET_OS == WINDOWS
+	__asm__(
+		".text\n"
+		".globl ogb_fiber_switch\n"
+		"ogb_fiber_switch:\n"
+		"	pushq %rbp\n"
+		"	pushq %rbx\n"
+		"	pushq %rdi\n"
+		"	pushq %rsi\n"
+		"	pushq %r12\n"
+		"	pushq %r13\n"
+		"	pushq %r14\n"
+		"	pushq %r15\n"
+		"	movq %gs:0x08, %rax\n"
+		"	pushq %rax\n"
+		"	movq %gs:0x10, %rax\n"
+		"	pushq %rax\n"
+		"	movq %gs:0x1478, %rax\n"
+		"	pushq %rax\n"
+		"	subq $176, %rsp\n"
+		"	stmxcsr 160(%rsp)\n"
+		"	fnstcw 164(%rsp)\n"
+		"	movups %xmm6, 0(%rsp)\n"
+		"	movups %xmm7, 16(%rsp)\n"
+		"	movups %xmm8, 32(%rsp)\n"
+		"	movups %xmm9, 48(%rsp)\n"
+		"	movups %xmm10, 64(%rsp)\n"
+		"	movups %xmm11, 80(%rsp)\n"
+		"	movups %xmm12, 96(%rsp)\n"
+		"	movups %xmm13, 112(%rsp)\n"
+		"	movups %xmm14, 128(%rsp)\n"
+		"	movups %xmm15, 144(%rsp)\n"
+		"	movq %rsp, (%rcx)\n"
+		"	movq %rdx, %rsp\n"
+		"	movups 0(%rsp), %xmm6\n"
+		"	movups 16(%rsp), %xmm7\n"
+		"	movups 32(%rsp), %xmm8\n"
+		"	movups 48(%rsp), %xmm9\n"
+		"	movups 64(%rsp), %xmm10\n"
+		"	movups 80(%rsp), %xmm11\n"
+		"	movups 96(%rsp), %xmm12\n"
+		"	movups 112(%rsp), %xmm13\n"
+		"	movups 128(%rsp), %xmm14\n"
+		"	movups 144(%rsp), %xmm15\n"
+		"	ldmxcsr 160(%rsp)\n"
+		"	fldcw 164(%rsp)\n"
+		"	addq $176, %rsp\n"
+		"	popq %rax\n"
+		"	movq %rax, %gs:0x1478\n"
+		"	popq %rax\n"
+		"	movq %rax, %gs:0x10\n"
+		"	popq %rax\n"
+		"	movq %rax, %gs:0x08\n"
+		"	popq %r15\n"
+		"	popq %r14\n"
+		"	popq %r13\n"
+		"	popq %r12\n"
+		"	popq %rsi\n"
+		"	popq %rdi\n"
+		"	popq %rbx\n"
+		"	popq %rbp\n"
+		"	ret\n"
+		".globl ogb_fiber_start\n"
+		"ogb_fiber_start:\n"
+		"	movq %rbx, %rcx\n"
+		"	subq $32, %rsp\n" // Shadow space
+		"	callq *%r12\n"
+		"	ud2\n"
+	);
+	#else
+	__asm__(
+		".pushsection .text\n"
+		".globl ogb_fiber_switch\n"
+		".type ogb_fiber_switch, @function\n"
+		"ogb_fiber_switch:\n"
+		"	pushq %rbp\n"
+		"	pushq %rbx\n"
+		"	pushq %r12\n"
+		"	pushq %r13\n"
+		"	pushq %r14\n"
+		"	pushq %r15\n"
+		"	subq $8, %rsp\n"
+		"	stmxcsr (%rsp)\n"
+		"	fnstcw 4(%rsp)\n"
+		"	movq %rsp, (%rdi)\n"
+		"	movq %rsi, %rsp\n"
+		"	ldmxcsr (%rsp)\n"
+		"	fldcw 4(%rsp)\n"
+		"	addq $8, %rsp\n"
+		"	popq %r15\n"
+		"	popq %r14\n"
+		"	popq %r13\n"
+		"	popq %r12\n"
+		"	popq %rbx\n"
+		"	popq %rbp\n"
+		"	ret\n"
+		".globl ogb_fiber_start\n"
+		".type ogb_fiber_start, @function\n"
+		"ogb_fiber_start:\n"
+		"	movq %rbx, %rdi\n"
+		"	callq *%r12\n"
+		"	ud2\n"
+		".popsection\n"
+	);
+	#endif
+#endif
+
+void fiber_init(Fiber *f, void *stack, u64 stack_size, Fiber_Proc proc, void *data) {
+	assert(stack_size >= 4096, "Fiber stack is too small");
+	
+	// The stack pointer has to be 16 byte aligned when the fiber's first call happens
+	u64 *top = (u64*)((u64)((u8*)stack + stack_size) & ~15ULL);
+	u64 *frame = top - FIBER_FRAME_SLOTS;
+	memset(frame, 0, FIBER_FRAME_SLOTS*sizeof(u64));
+	
+	// Default mxcsr (all exceptions masked, round to nearest) and x87 control word
+	frame[FIBER_FRAME_CSR] = 0x1F80ULL | (0x037FULL << 32);
+#if TARGET_OS == WINDOWS
+	frame[FIBER_FRAME_DEALLOCATION_STACK] = (u64)stack;
+	frame[FIBER_FRAME_STACK_LIMIT] = (u64)stack;
+	frame[FIBER_FRAME_STACK_BASE] = (u64)top;
+#endif
+	frame[FIBER_FRAME_R12] = (u64)proc;
+	frame[FIBER_FRAME_RBX] = (u64)data;
+	frame[FIBER_FRAME_RETURN] = (u64)ogb_fiber_start;
+	
+	f->stack_pointer = frame;
+}
+
+void fiber_switch(Fiber *from, Fiber *to) {
+	assert(from != to, "Switching a fiber to itself");
+	ogb_fiber_switch(&from->stack_pointer, to->stack_pointer);
+}
+
+
+///
+// Single producer, single consumer queue
+
+void spsc_queue_init_raw(Spsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0 && capacity > 0, "Bad queue item size or capacity");
+	memset(q, 0, sizeof(Spsc_Queue));
+	q->capacity = get_next_power_of_two(capacity);
+	q->item_size = item_size;
+	q->allocator = allocator;
+	q->items = (u8*)alloc_aligned(allocator, q->capacity*item_size, QUEUE_CACHE_LINE_SIZE);
+}
+void spsc_queue_destroy(Spsc_Queue *q) {
+	dealloc(q->allocator, q->items);
+}
+
+u64 spsc_queue_push_batch(Spsc_Queue *q, void *items, u64 count) {
+	u64 tail = q->tail;
+	// Only look at the consumer's cache line when we think it's full
+	if (tail + count - q->cached_head > q->capacity) {
+		q->cached_head = q->head;
+		COMPILER_BARRIER;
+	}
+	count = min(count, q->capacity - (tail - q->cached_head));
+	if (count == 0) return 0;
+	
+	u64 start = tail & (q->capacity-1);
+	u64 first_part = min(count, q->capacity - start);
+	memcpy(q->items + start*q->item_size, items, first_part*q->item_size);
+	memcpy(q->items, (u8*)items + first_part*q->item_size, (count-first_part)*q->item_size);
+	
+	COMPILER_BARRIER;
+	q->tail = tail + count;
+	return count;
+}
+u64 spsc_queue_pop_batch(Spsc_Queue *q, void *items, u64 max_count) {
+	u64 head = q->head;
+	if (q->cached_tail - head < max_count) {
+		q->cached_tail = q->tail;
+		COMPILER_BARRIER;
+	}
+	u64 count = min(max_count, q->cached_tail - head);
+	if (count == 0) return 0;
+	
+	u64 start = head & (q->capacity-1);
+	u64 first_part = min(count, q->capacity - start);
+	memcpy(items, q->items + start*q->item_size, first_part*q->item_size);
+	memcpy((u8*)items + first_part*q->item_size, q->items, (count-first_part)*q->item_size);
+	
+	COMPILER_BARRIER;
+	q->head = head + count;
+	return count;
+}
+bool spsc_queue_push(Spsc_Queue *q, void *item) {
+	return spsc_queue_push_batch(q, item, 1) == 1;
+}
+bool spsc_queue_pop(Spsc_Queue *q, void *item) {
+	return spsc_queue_pop_batch(q, item, 1) == 1;
+}
+
+///
+// Multi producer, multi consumer queue
+// A cell is free for the producer at position pos when sequence == pos, and it's ready for
+// the consumer at position pos when sequence == pos+1.
+
+inline volatile u64 *mpmc_queue_sequence(Mpmc_Queue *q, u64 pos) {
+	return (volatile u64*)(q->cells + (pos & (q->capacity-1))*q->cell_stride);
+}
+
+void mpmc_queue_init_raw(Mpmc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0 && capacity > 0, "Bad queue item size or capacity");
+	memset(q, 0, sizeof(Mpmc_Queue));
+	q->capacity = max(get_next_power_of_two(capacity), 2);
+	q->item_size = item_size;
+	q->cell_stride = align_next(sizeof(u64) + item_size, sizeof(u64));
+	q->allocator = allocator;
+	q->cells = (u8*)alloc_aligned(allocator, q->capacity*q->cell_stride, QUEUE_CACHE_LINE_SIZE);
+	for (u64 i = 0; i < q->capacity; i++) {
+		*mpmc_queue_sequence(q, i) = i;
+	}
+}
+void mpmc_queue_destroy(Mpmc_Queue *q) {
+	dealloc(q->allocator, q->cells);
+}
+
+u64 mpmc_queue_push_batch(Mpmc_Queue *q, void *items, u64 count) {
+	count = min(count, q->capacity);
+	u64 pos = q->enqueue_pos;
+	u64 claimed;
+	while (true) {
+		// Claim as many cells in a row as are free for us
+		claimed = 0;
+		while (claimed < count && *mpmc_queue_sequence(q, pos+claimed) == pos+claimed) claimed += 1;
+		
+		if (claimed == 0) {
+			s64 diff = (s64)*mpmc_queue_sequence(q, pos) - (s64)pos;
+			// Full: the consumer of the previous lap hasn't gotten this cell yet
+			if (diff < 0) return 0;
+			// Another producer took it, try again from where they left off
+			pos = q->enqueue_pos;
+			continue;
+		}
+		
+		if (compare_and_swap_64((volatile uint64_t*)&q->enqueue_pos, pos+claimed, pos)) break;
+		pos = q->enqueue_pos;
+	}
+	
+	for (u64 i = 0; i < claimed; i++) {
+		volatile u64 *sequence = mpmc_queue_sequence(q, pos+i);
+		memcpy((u8*)sequence + sizeof(u64), (u8*)items + i*q->item_size, q->item_size);
+		COMPILER_BARRIER;
+		*sequence = pos+i+1;
+	}
+	return claimed;
+}
+u64 mpmc_queue_pop_batch(Mpmc_Queue *q, void *items, u64 max_count) {
+	max_count = min(max_count, q->capacity);
+	u64 pos = q->dequeue_pos;
+	u64 claimed;
+	while (true) {
+		claimed = 0;
+		while (claimed < max_count && *mpmc_queue_sequence(q, pos+claimed) == pos+claimed+1) claimed += 1;
+		
+		if (claimed == 0) {
+			s64 diff = (s64)*mpmc_queue_sequence(q, pos) - (s64)(pos+1);
+			// Empty: the producer for this cell hasn't finished yet
+			if (diff < 0) return 0;
+			pos = q->dequeue_pos;
+			continue;
+		}
+		
+		if (compare_and_swap_64((volatile uint64_t*)&q->dequeue_pos, pos+claimed, pos)) break;
+		pos = q->dequeue_pos;
+	}
+	
+	for (u64 i = 0; i < claimed; i++) {
+		volatile u64 *sequence = mpmc_queue_sequence(q, pos+i);
+		memcpy((u8*)items + i*q->item_size, (u8*)sequence + sizeof(u64), q->item_size);
+		COMPILER_BARRIER;
+		// Free for the producer on the next lap
+		*sequence = pos+i+q->capacity;
+	}
+	return claimed;
+}
+bool mpmc_queue_push(Mpmc_Queue *q, void *item) {
+	return mpmc_queue_push_batch(q, item, 1) == 1;
+}
+bool mpmc_queue_pop(Mpmc_Queue *q, void *item) {
+	return mpmc_queue_pop_batch(q, item, 1) == 1;
 }
 
 #endif
\ No newline at end of file
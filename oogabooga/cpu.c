@@ -23,15 +23,26 @@ typedef struct Cpu_Capabilities {
 // I think this is the standard? (sse1)
 #define COMPILER_CAN_DO_SSE 1
 
+// Ordering for the atomic_* procedures in concurrency.c.
+// Loads take relaxed/acquire/seq_cst and stores take relaxed/release/seq_cst.
+// Values match gcc/clang's __ATOMIC_* so they can be passed straight through.
+typedef enum Memory_Order {
+	MEMORY_ORDER_RELAXED = 0,
+	MEMORY_ORDER_ACQUIRE = 2,
+	MEMORY_ORDER_RELEASE = 3,
+	MEMORY_ORDER_SEQ_CST = 5,
+} Memory_Order;
+
 ///
 // Compiler specific stuff
-#if COMPILER_MVSC
+#if COMPILER_MSVC
 	#define inline __forceinline
 	#define alignat(x) __declspec(align(x))
 	#define noreturn __declspec(noreturn)
+	#define NO_INLINE __declspec(noinline)
     #define COMPILER_HAS_MEMCPY_INTRINSICS 1
-    inline void 
-    crash() noreturn {
+    noreturn inline void 
+    crash() {
 		__debugbreak();
 		volatile int *a = 0;
 		*a = 5;
@@ -50,7 +61,8 @@ typedef struct Cpu_Capabilities {
     	return i;
     }
     
-    #if _M_IX86_FP >= 2
+    // x64 always has SSE2, _M_IX86_FP is only defined for 32 bit
+    #if defined(_M_X64) || _M_IX86_FP >= 2
 		#define COMPILER_CAN_DO_SSE2 1
 		#define COMPILER_CAN_DO_SSE41 1
 	#else
@@ -73,7 +85,24 @@ typedef struct Cpu_Capabilities {
 		#define COMPILER_CAN_DO_AVX512 0
 	#endif
 	
-	#define DEPRECATED(proc, msg) __declspec(deprecated(msg)) func
+	#define DEPRECATED(proc, msg) __declspec(deprecated(msg)) proc
+	
+	#pragma intrinsic(_BitScanForward64)
+	#pragma intrinsic(_BitScanReverse64)
+	
+	// Index of lowest/highest set bit. x must not be 0.
+	inline u64 
+	bit_scan_forward_64(u64 x) {
+		unsigned long index;
+		_BitScanForward64(&index, x);
+		return (u64)index;
+	}
+	inline u64 
+	bit_scan_reverse_64(u64 x) {
+		unsigned long index;
+		_BitScanReverse64(&index, x);
+		return (u64)index;
+	}
 	
 	#pragma intrinsic(_InterlockedCompareExchange8)
 	#pragma intrinsic(_InterlockedCompareExchange16)
@@ -105,7 +134,176 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	inline uint32_t 
+	exchange_32(volatile uint32_t *a, uint32_t b) {
+	    return (uint32_t)_InterlockedExchange((volatile long*)a, (long)b);
+	}
+	
+	// x64 loads and stores already are acquire/release, so those only need to stop the compiler.
+	// Every Interlocked read-modify-write is a full barrier, so they ignore the order.
+	inline uint8_t 
+	atomic_load_8(volatile uint8_t *a, Memory_Order order) {
+	    uint8_t result = *a;
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    return result;
+	}
+	inline void 
+	atomic_store_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    if (order == MEMORY_ORDER_SEQ_CST) {
+	        _InterlockedExchange8((volatile char*)a, (char)b);
+	        return;
+	    }
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    *a = b;
+	}
+	inline uint8_t 
+	atomic_fetch_add_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return (uint8_t)_InterlockedExchangeAdd8((volatile char*)a, (char)b);
+	}
+	inline uint8_t 
+	atomic_fetch_sub_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return (uint8_t)_InterlockedExchangeAdd8((volatile char*)a, (char)(0 - b));
+	}
+	inline uint8_t 
+	atomic_exchange_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return (uint8_t)_InterlockedExchange8((volatile char*)a, (char)b);
+	}
+	inline uint8_t 
+	atomic_fetch_or_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return (uint8_t)_InterlockedOr8((volatile char*)a, (char)b);
+	}
+	inline uint8_t 
+	atomic_fetch_and_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return (uint8_t)_InterlockedAnd8((volatile char*)a, (char)b);
+	}
+	inline uint16_t 
+	atomic_load_16(volatile uint16_t *a, Memory_Order order) {
+	    uint16_t result = *a;
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    return result;
+	}
+	inline void 
+	atomic_store_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    if (order == MEMORY_ORDER_SEQ_CST) {
+	        _InterlockedExchange16((volatile short*)a, (short)b);
+	        return;
+	    }
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    *a = b;
+	}
+	inline uint16_t 
+	atomic_fetch_add_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return (uint16_t)_InterlockedExchangeAdd16((volatile short*)a, (short)b);
+	}
+	inline uint16_t 
+	atomic_fetch_sub_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return (uint16_t)_InterlockedExchangeAdd16((volatile short*)a, (short)(0 - b));
+	}
+	inline uint16_t 
+	atomic_exchange_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return (uint16_t)_InterlockedExchange16((volatile short*)a, (short)b);
+	}
+	inline uint16_t 
+	atomic_fetch_or_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return (uint16_t)_InterlockedOr16((volatile short*)a, (short)b);
+	}
+	inline uint16_t 
+	atomic_fetch_and_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return (uint16_t)_InterlockedAnd16((volatile short*)a, (short)b);
+	}
+	inline uint32_t 
+	atomic_load_32(volatile uint32_t *a, Memory_Order order) {
+	    uint32_t result = *a;
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    return result;
+	}
+	inline void 
+	atomic_store_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    if (order == MEMORY_ORDER_SEQ_CST) {
+	        _InterlockedExchange((volatile long*)a, (long)b);
+	        return;
+	    }
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    *a = b;
+	}
+	inline uint32_t 
+	atomic_fetch_add_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return (uint32_t)_InterlockedExchangeAdd((volatile long*)a, (long)b);
+	}
+	inline uint32_t 
+	atomic_fetch_sub_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return (uint32_t)_InterlockedExchangeAdd((volatile long*)a, (long)(0 - b));
+	}
+	inline uint32_t 
+	atomic_exchange_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return (uint32_t)_InterlockedExchange((volatile long*)a, (long)b);
+	}
+	inline uint32_t 
+	atomic_fetch_or_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return (uint32_t)_InterlockedOr((volatile long*)a, (long)b);
+	}
+	inline uint32_t 
+	atomic_fetch_and_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return (uint32_t)_InterlockedAnd((volatile long*)a, (long)b);
+	}
+	inline uint64_t 
+	atomic_load_64(volatile uint64_t *a, Memory_Order order) {
+	    uint64_t result = *a;
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    return result;
+	}
+	inline void 
+	atomic_store_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    if (order == MEMORY_ORDER_SEQ_CST) {
+	        _InterlockedExchange64((volatile long long*)a, (long long)b);
+	        return;
+	    }
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    *a = b;
+	}
+	inline uint64_t 
+	atomic_fetch_add_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return (uint64_t)_InterlockedExchangeAdd64((volatile long long*)a, (long long)b);
+	}
+	inline uint64_t 
+	atomic_fetch_sub_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return (uint64_t)_InterlockedExchangeAdd64((volatile long long*)a, (long long)(0 - b));
+	}
+	inline uint64_t 
+	atomic_exchange_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return (uint64_t)_InterlockedExchange64((volatile long long*)a, (long long)b);
+	}
+	inline uint64_t 
+	atomic_fetch_or_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return (uint64_t)_InterlockedOr64((volatile long long*)a, (long long)b);
+	}
+	inline uint64_t 
+	atomic_fetch_and_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return (uint64_t)_InterlockedAnd64((volatile long long*)a, (long long)b);
+	}
+	inline void* 
+	atomic_load_ptr(void *volatile *a, Memory_Order order) {
+	    void *result = *a;
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    return result;
+	}
+	inline void 
+	atomic_store_ptr(void *volatile *a, void *b, Memory_Order order) {
+	    if (order == MEMORY_ORDER_SEQ_CST) {
+	        _InterlockedExchangePointer(a, b);
+	        return;
+	    }
+	    if (order != MEMORY_ORDER_RELAXED) _ReadWriteBarrier();
+	    *a = b;
+	}
+	inline void* 
+	atomic_exchange_ptr(void *volatile *a, void *b, Memory_Order order) {
+	    return _InterlockedExchangePointer(a, b);
+	}
+	
 	#define MEMORY_BARRIER _ReadWriteBarrier()
+	// Only stops the compiler from reordering memory accesses across it
+	#define COMPILER_BARRIER _ReadWriteBarrier()
 	
 	#define thread_local __declspec(thread)
 	
@@ -116,6 +314,7 @@ typedef struct Cpu_Capabilities {
 	#define inline __attribute__((always_inline)) inline
 	#define alignat(x) __attribute__((aligned(x)))	
     #define noreturn __attribute__((noreturn))
+    #define NO_INLINE __attribute__((noinline))
     #define COMPILER_HAS_MEMCPY_INTRINSICS 1
     
     inline void noreturn
@@ -172,6 +371,16 @@ typedef struct Cpu_Capabilities {
 	
 	#define DEPRECATED(proc, msg) __attribute__((deprecated(msg))) proc 
 	
+	// Index of lowest/highest set bit. x must not be 0.
+	inline u64 
+	bit_scan_forward_64(u64 x) {
+		return (u64)__builtin_ctzll(x);
+	}
+	inline u64 
+	bit_scan_reverse_64(u64 x) {
+		return 63 - (u64)__builtin_clzll(x);
+	}
+	
 	inline bool 
 	compare_and_swap_8(volatile uint8_t *a, uint8_t b, uint8_t old) {
 	    unsigned char result;
@@ -225,7 +434,148 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	inline uint32_t 
+	exchange_32(volatile uint32_t *a, uint32_t b) {
+	    // xchg with memory is always locked
+	    __asm__ __volatile__(
+	        "xchgl %0, %1"
+	        : "+r" (b), "+m" (*a)
+	        :
+	        : "memory"
+	    );
+	    return b;
+	}
+	
+	// Memory_Order has the same values as __ATOMIC_*, and since these are always inlined the
+	// order folds to a constant. If it doesn't (-O0) gcc and clang fall back to seq_cst.
+	inline uint8_t 
+	atomic_load_8(volatile uint8_t *a, Memory_Order order) {
+	    return __atomic_load_n(a, (int)order);
+	}
+	inline void 
+	atomic_store_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    __atomic_store_n(a, b, (int)order);
+	}
+	inline uint8_t 
+	atomic_fetch_add_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return __atomic_fetch_add(a, b, (int)order);
+	}
+	inline uint8_t 
+	atomic_fetch_sub_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return __atomic_fetch_sub(a, b, (int)order);
+	}
+	inline uint8_t 
+	atomic_exchange_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return __atomic_exchange_n(a, b, (int)order);
+	}
+	inline uint8_t 
+	atomic_fetch_or_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return __atomic_fetch_or(a, b, (int)order);
+	}
+	inline uint8_t 
+	atomic_fetch_and_8(volatile uint8_t *a, uint8_t b, Memory_Order order) {
+	    return __atomic_fetch_and(a, b, (int)order);
+	}
+	inline uint16_t 
+	atomic_load_16(volatile uint16_t *a, Memory_Order order) {
+	    return __atomic_load_n(a, (int)order);
+	}
+	inline void 
+	atomic_store_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    __atomic_store_n(a, b, (int)order);
+	}
+	inline uint16_t 
+	atomic_fetch_add_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return __atomic_fetch_add(a, b, (int)order);
+	}
+	inline uint16_t 
+	atomic_fetch_sub_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return __atomic_fetch_sub(a, b, (int)order);
+	}
+	inline uint16_t 
+	atomic_exchange_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return __atomic_exchange_n(a, b, (int)order);
+	}
+	inline uint16_t 
+	atomic_fetch_or_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return __atomic_fetch_or(a, b, (int)order);
+	}
+	inline uint16_t 
+	atomic_fetch_and_16(volatile uint16_t *a, uint16_t b, Memory_Order order) {
+	    return __atomic_fetch_and(a, b, (int)order);
+	}
+	inline uint32_t 
+	atomic_load_32(volatile uint32_t *a, Memory_Order order) {
+	    return __atomic_load_n(a, (int)order);
+	}
+	inline void 
+	atomic_store_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    __atomic_store_n(a, b, (int)order);
+	}
+	inline uint32_t 
+	atomic_fetch_add_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return __atomic_fetch_add(a, b, (int)order);
+	}
+	inline uint32_t 
+	atomic_fetch_sub_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return __atomic_fetch_sub(a, b, (int)order);
+	}
+	inline uint32_t 
+	atomic_exchange_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return __atomic_exchange_n(a, b, (int)order);
+	}
+	inline uint32_t 
+	atomic_fetch_or_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return __atomic_fetch_or(a, b, (int)order);
+	}
+	inline uint32_t 
+	atomic_fetch_and_32(volatile uint32_t *a, uint32_t b, Memory_Order order) {
+	    return __atomic_fetch_and(a, b, (int)order);
+	}
+	inline uint64_t 
+	atomic_load_64(volatile uint64_t *a, Memory_Order order) {
+	    return __atomic_load_n(a, (int)order);
+	}
+	inline void 
+	atomic_store_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    __atomic_store_n(a, b, (int)order);
+	}
+	inline uint64_t 
+	atomic_fetch_add_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return __atomic_fetch_add(a, b, (int)order);
+	}
+	inline uint64_t 
+	atomic_fetch_sub_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return __atomic_fetch_sub(a, b, (int)order);
+	}
+	inline uint64_t 
+	atomic_exchange_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return __atomic_exchange_n(a, b, (int)order);
+	}
+	inline uint64_t 
+	atomic_fetch_or_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return __atomic_fetch_or(a, b, (int)order);
+	}
+	inline uint64_t 
+	atomic_fetch_and_64(volatile uint64_t *a, uint64_t b, Memory_Order order) {
+	    return __atomic_fetch_and(a, b, (int)order);
+	}
+	inline void* 
+	atomic_load_ptr(void *volatile *a, Memory_Order order) {
+	    return __atomic_load_n(a, (int)order);
+	}
+	inline void 
+	atomic_store_ptr(void *volatile *a, void *b, Memory_Order order) {
+	    __atomic_store_n(a, b, (int)order);
+	}
+	inline void* 
+	atomic_exchange_ptr(void *volatile *a, void *b, Memory_Order order) {
+	    return __atomic_exchange_n(a, b, (int)order);
+	}
+	
 	#define MEMORY_BARRIER {__asm__ __volatile__("" ::: "memory");__sync_synchronize();}
+	// Only stops the compiler from reordering memory accesses across it
+	#define COMPILER_BARRIER __asm__ __volatile__("" ::: "memory")
 	
 	#define thread_local __thread
 	
@@ -238,22 +588,8 @@ typedef struct Cpu_Capabilities {
 #endif
 	
 #else
-	#define inline inline
-    #define COMPILER_HAS_MEMCPY_INTRINSICS 0
-    
-    inline u64 
-    rdtsc() { return 0; }
-    inline Cpu_Info_X86 cpuid(u32 function_id) {return (Cpu_Info_X86){0};}
-    #define COMPILER_CAN_DO_SSE2 0
-    #define COMPILER_CAN_DO_AVX 0
-    #define COMPILER_CAN_DO_AVX2 0
-    #define COMPILER_CAN_DO_AVX512 0
-    
-    #define DEPRECATED(proc, msg) 
-    
-    #define MEMORY_BARRIER
-    
-    #warning "Compiler is not explicitly supported, some things will probably not work as expected"
+	// The heap, locks and job system are built on the atomics above, there's no portable fallback
+	#error "Compiler is not supported, cpu.c needs atomics and intrinsics for MSVC, GCC or Clang"
 #endif
 
 
@@ -14,6 +14,8 @@
 	Draw_Quad *draw_quad_projected(Draw_Quad quad, Matrix4 world_to_clip);
 	Draw_Quad *draw_quad(Draw_Quad quad);
 	Draw_Quad *draw_quad_xform(Draw_Quad quad, Matrix4 xform);
+	Matrix4 draw_frame_get_world_to_clip();
+	u32 *get_draw_frame_quad_order();
 	void draw_text_xform(Gfx_Font *font, string text, u32 raster_height, Matrix4 xform, Vector2 scale, Vector4 color);
 	void draw_text(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color);
 	Gfx_Text_Metrics draw_text_and_measure(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color);
@@ -26,22 +28,22 @@
 #define Z_STACK_MAX 4096
 #define SCISSOR_STACK_MAX 4096
 
+// #Volatile Ordered biggest first so there's no padding in the middle. The renderers stream through
+// all of these every frame so keep it small.
 typedef struct Draw_Quad {
 	// BEWARE !! These are in ndc
 	Vector2 bottom_left, top_left, top_right, bottom_right;
 	// r, g, b, a
 	Vector4 color;
-	Gfx_Image *image;
-	Gfx_Filter_Mode image_min_filter;
-	Gfx_Filter_Mode image_mag_filter;
-	s32 z;
-	u8 type;
-	bool has_scissor;
 	// x1, y1, x2, y2
 	Vector4 uv;
-	Vector4 scissor;
-	
 	Vector4 userdata[VERTEX_2D_USER_DATA_COUNT]; // #Volatile do NOT change this to a pointer
+	Gfx_Image *image;
+	s32 z;
+	u16 scissor_index; // 0 for none, otherwise 1 + index in scissor_buffer
+	u8 type;
+	u8 image_min_filter; // Gfx_Filter_Mode
+	u8 image_mag_filter; // Gfx_Filter_Mode
 	
 } Draw_Quad;
 
@@ -53,12 +55,20 @@ typedef struct Draw_Frame {
 	Matrix4 projection;
 	Matrix4 view;
 	
+	// projection * inverse(view), see draw_frame_get_world_to_clip().
+	// Remembers what it was made from so writing projection and view directly is fine.
+	Matrix4 world_to_clip;
+	Matrix4 world_to_clip_projection;
+	Matrix4 world_to_clip_view;
+	bool has_world_to_clip;
+	
 	bool enable_z_sorting;
 	s32 z_stack[Z_STACK_MAX];
 	u64 z_count;
 
-	Vector4 scissor_stack[SCISSOR_STACK_MAX];
+	u16 scissor_stack[SCISSOR_STACK_MAX]; // Values for Draw_Quad.scissor_index
 	u64 scissor_count;
+	u64 num_scissors; // In scissor_buffer
 	
 	void *cbuffer;
 	
@@ -68,6 +78,12 @@ typedef struct Draw_Frame {
 // #Global
 ogb_instance Draw_Quad *quad_buffer;
 ogb_instance u64 allocated_quads;
+// Every scissor pushed this frame, pointed to by Draw_Quad.scissor_index
+ogb_instance Vector4 *scissor_buffer;
+ogb_instance u64 allocated_scissors;
+// Sort keys for get_draw_frame_quad_order(), twice allocated_quads for the radix sort
+ogb_instance u64 *quad_sort_keys;
+ogb_instance u64 allocated_quad_sort_keys;
 // This frame is passed to the platform layer and rendered in os_update.
 // Resets every frame.
 ogb_instance Draw_Frame draw_frame;
@@ -75,6 +91,10 @@ ogb_instance Draw_Frame draw_frame;
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Draw_Quad *quad_buffer;
 u64 allocated_quads;
+Vector4 *scissor_buffer;
+u64 allocated_scissors;
+u64 *quad_sort_keys;
+u64 allocated_quad_sort_keys;
 Draw_Frame draw_frame = ZERO(Draw_Frame);
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
@@ -100,8 +120,19 @@ void pop_z_layer() {
 
 void push_window_scissor(Vector2 min, Vector2 max) {
 	assert(draw_frame.scissor_count < SCISSOR_STACK_MAX, "Too many scissors pushed. You can pop with pop_window_scissor() when you are done drawing to it.");
+	assert(draw_frame.num_scissors < U16_MAX, "Too many scissors pushed in one frame, max is %d", U16_MAX);
 	
-	draw_frame.scissor_stack[draw_frame.scissor_count] = v4(min.x, min.y, max.x, max.y);
+	if (draw_frame.num_scissors >= allocated_scissors) {
+		// #Memory
+		u64 new_count = max(get_next_power_of_two(draw_frame.num_scissors+1), 64);
+		scissor_buffer = reallocate(get_heap_allocator(), scissor_buffer, allocated_scissors*sizeof(Vector4), new_count*sizeof(Vector4));
+		allocated_scissors = new_count;
+	}
+	
+	scissor_buffer[draw_frame.num_scissors] = v4(min.x, min.y, max.x, max.y);
+	draw_frame.num_scissors += 1;
+	
+	draw_frame.scissor_stack[draw_frame.scissor_count] = (u16)draw_frame.num_scissors;
 	draw_frame.scissor_count += 1;
 }
 void pop_window_scissor() {
@@ -133,45 +164,81 @@ Draw_Quad *draw_quad_projected(Draw_Quad quad, Matrix4 world_to_clip) {
 	quad.z = 0;
 	if (draw_frame.z_count > 0)  quad.z = draw_frame.z_stack[draw_frame.z_count-1];
 	
-	quad.has_scissor = false;
+	quad.scissor_index = 0;
 	if (draw_frame.scissor_count > 0) {
-		quad.scissor = draw_frame.scissor_stack[draw_frame.scissor_count-1];
-		quad.has_scissor = true;
+		quad.scissor_index = draw_frame.scissor_stack[draw_frame.scissor_count-1];
 	}
 	
-	memset(quad.userdata, 0, sizeof(quad.userdata));
-	
 	if (draw_frame.num_quads >= allocated_quads) {
 		// #Memory
 		
 		u64 new_count = max(get_next_power_of_two(draw_frame.num_quads+1), 128);
 		
-		Draw_Quad *new_buffer = alloc(get_heap_allocator(), new_count*sizeof(Draw_Quad));
-		
-		if (quad_buffer) {
-			memcpy(new_buffer, quad_buffer, draw_frame.num_quads*sizeof(Draw_Quad));
-			dealloc(get_heap_allocator(), quad_buffer);
-		}
-		
-		quad_buffer = new_buffer;
+		quad_buffer = reallocate(get_heap_allocator(), quad_buffer, allocated_quads*sizeof(Draw_Quad), new_count*sizeof(Draw_Quad));
 		allocated_quads = new_count;
 	}
 	
+	memset(quad.userdata, 0, sizeof(quad.userdata));
+	
 	quad_buffer[draw_frame.num_quads] = quad;
 	draw_frame.num_quads += 1;
 	
 	return &quad_buffer[draw_frame.num_quads-1];
 }
+// Only redoes the inverse when projection or view changed since last time, comparing is a lot
+// cheaper than inverting for every quad.
+Matrix4 draw_frame_get_world_to_clip() {
+	if (!draw_frame.has_world_to_clip
+	 || !bytes_match(&draw_frame.world_to_clip_projection, &draw_frame.projection, sizeof(Matrix4))
+	 || !bytes_match(&draw_frame.world_to_clip_view, &draw_frame.view, sizeof(Matrix4))) {
+		draw_frame.world_to_clip = m4_mul(draw_frame.projection, m4_inverse(draw_frame.view));
+		draw_frame.world_to_clip_projection = draw_frame.projection;
+		draw_frame.world_to_clip_view = draw_frame.view;
+		draw_frame.has_world_to_clip = true;
+	}
+	return draw_frame.world_to_clip;
+}
+
+// Indices into quad_buffer in the order they should be drawn. That's by z if
+// draw_frame.enable_z_sorting, otherwise the order they were drawn in.
+// Only valid until the next call.
+u32 *get_draw_frame_quad_order() {
+	u64 count = draw_frame.num_quads;
+	
+	if (allocated_quad_sort_keys < allocated_quads) {
+		// #Memory #Heapalloc
+		if (quad_sort_keys) dealloc(get_heap_allocator(), quad_sort_keys);
+		quad_sort_keys = alloc(get_heap_allocator(), allocated_quads*2*sizeof(u64));
+		allocated_quad_sort_keys = allocated_quads;
+	}
+	
+	u64 *keys = quad_sort_keys;
+	u32 *order = (u32*)quad_sort_keys;
+	
+	if (!draw_frame.enable_z_sorting) {
+		for (u64 i = 0; i < count; i++) order[i] = (u32)i;
+		return order;
+	}
+	
+	// Sort 8 byte keys instead of moving whole quads around. z is in the low bits, which is all
+	// radix_sort looks at, and the index is in the high bits. It's stable so equal z keeps order.
+	for (u64 i = 0; i < count; i++) {
+		keys[i] = ((u64)i << 32) | (u32)quad_buffer[i].z;
+	}
+	radix_sort(keys, keys + allocated_quad_sort_keys, count, sizeof(u64), 0, MAX_Z_BITS);
+	
+	// Packed down in place, order[i] is never past keys[i]
+	for (u64 i = 0; i < count; i++) order[i] = (u32)(keys[i] >> 32);
+	
+	return order;
+}
+
 Draw_Quad *draw_quad(Draw_Quad quad) {
-	return draw_quad_projected(quad, m4_mul(draw_frame.projection, m4_inverse(draw_frame.view)));
+	return draw_quad_projected(quad, draw_frame_get_world_to_clip());
 }
 
 Draw_Quad *draw_quad_xform(Draw_Quad quad, Matrix4 xform) {
-	Matrix4 world_to_clip = m4_scalar(1.0);
-	world_to_clip         = m4_mul(world_to_clip, draw_frame.projection);
-	world_to_clip         = m4_mul(world_to_clip, m4_inverse(draw_frame.view));
-	world_to_clip         = m4_mul(world_to_clip, xform);
-	return draw_quad_projected(quad, world_to_clip);
+	return draw_quad_projected(quad, m4_mul(draw_frame_get_world_to_clip(), xform));
 }
 
 Draw_Quad *draw_rect(Vector2 position, Vector2 size, Vector4 color) {
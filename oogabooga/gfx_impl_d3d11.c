@@ -60,8 +60,9 @@ void *d3d11_staging_quad_buffer = 0;
 ID3D11Buffer *d3d11_cbuffer = 0;
 u64 d3d11_cbuffer_size = 0;
 
-Draw_Quad *sort_quad_buffer = 0;
-u64 sort_quad_buffer_size = 0;
+// Texture slot for each quad in draw order, -1 if it has no image
+s8 *d3d11_quad_texture_indices = 0;
+u64 d3d11_quad_texture_indices_count = 0;
 
 const char* d3d11_stringify_category(D3D11_MESSAGE_CATEGORY category) {
     switch (category) {
@@ -604,10 +605,179 @@ void d3d11_draw_call(int number_of_rendered_quads, ID3D11ShaderResourceView **te
     ID3D11DeviceContext_Draw(d3d11_context, number_of_rendered_quads * 6, 0);
 }
 
-void d3d11_process_draw_frame() {
+// Quads per job when building vertices. Each job writes its own range of the staging buffer so
+// the result is the same as doing it all on one thread.
+#define D3D11_QUAD_VERTEX_BATCH 1024
+
+typedef struct D3D11_Quad_Vertex_Job {
+	u32 *order; // From get_draw_frame_quad_order()
+	u64 first_quad; // Quad that goes in the first 6 vertices of the staging buffer, index in order
+} D3D11_Quad_Vertex_Job;
 
+// Texture slots are already resolved in d3d11_quad_texture_indices, so quads don't depend on each other.
+void d3d11_build_quad_vertices(u64 first, u64 last, void *userdata) {
+	D3D11_Quad_Vertex_Job *job = (D3D11_Quad_Vertex_Job*)userdata;
+	
+	for (u64 k = first; k < last; k++) {
+		Draw_Quad *q = &quad_buffer[job->order[job->first_quad + k]];
+		s8 texture_index = d3d11_quad_texture_indices[job->first_quad + k];
+		D3D11_Vertex* pointer = (D3D11_Vertex*)d3d11_staging_quad_buffer + k*6;
+		
+		if (q->type == QUAD_TYPE_TEXT) {
+		
+		    // This is meant to fix the annoying artifacts that shows up when sampling text from an atlas
+		    // presumably for floating point precision issues or something.
+		
+		    // #Incomplete
+		    // If we want to animate text with small movements then it will look wonky.
+		    // This should be optional probably.
+		    // Also, we might want to do this on non-text if rendering with linear filtering
+		    // from a large texture atlas.
+		
+			float pixel_width = 2.0/(float)window.width;
+			float pixel_height = 2.0/(float)window.height;
+
+			bool xeven = window.width % 2 == 0;
+			bool yeven = window.height % 2 == 0;
+			
+			q->bottom_left.x  = round(q->bottom_left.x  / pixel_width)  * pixel_width;
+		    q->bottom_left.y  = round(q->bottom_left.y  / pixel_height) * pixel_height;
+		    q->top_left.x     = round(q->top_left.x     / pixel_width)  * pixel_width;
+		    q->top_left.y     = round(q->top_left.y     / pixel_height) * pixel_height;
+		    q->top_right.x    = round(q->top_right.x    / pixel_width)  * pixel_width;
+		    q->top_right.y    = round(q->top_right.y    / pixel_height) * pixel_height;
+		    q->bottom_right.x = round(q->bottom_right.x / pixel_width)  * pixel_width;
+		    q->bottom_right.y = round(q->bottom_right.y / pixel_height) * pixel_height;
+		}
+		
+		// We will write to 6 vertices for the one quad (two tris)
+		 {
+		
+			D3D11_Vertex* BL  = pointer + 0;
+			D3D11_Vertex* TL  = pointer + 1;
+			D3D11_Vertex* TR  = pointer + 2;
+			D3D11_Vertex* BL2 = pointer + 3;
+			D3D11_Vertex* TR2 = pointer + 4;
+			D3D11_Vertex* BR  = pointer + 5;
+			
+			BL->position = v4(q->bottom_left.x,  q->bottom_left.y,  0, 1);
+			TL->position = v4(q->top_left.x,     q->top_left.y,     0, 1);
+			TR->position = v4(q->top_right.x,    q->top_right.y,    0, 1);
+			BR->position = v4(q->bottom_right.x, q->bottom_right.y, 0, 1);
+			
+			
+			if (q->image) {
+
+				BL->uv = v2(q->uv.x1, q->uv.y1);
+				TL->uv = v2(q->uv.x1, q->uv.y2);
+				TR->uv = v2(q->uv.x2, q->uv.y2);
+				BR->uv = v2(q->uv.x2, q->uv.y1);
+				// #Hack #Bug #Cleanup
+				// When a window dimension is uneven it slightly under/oversamples on an axis by a
+				// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
+				// (It undersamples by a fourth of the atlas texture?)
+				// Anything > 0.25 < will slightly over/undersample on my machine.
+				// I have no idea about #Portability here.
+				// - Charlie M 26th July 2024
+				if (window.width % 2 != 0) {
+					BL->uv.x += (2.0/(float)q->image->width)*0.25;
+					TL->uv.x += (2.0/(float)q->image->width)*0.25;
+					TR->uv.x += (2.0/(float)q->image->width)*0.25;
+					BR->uv.x += (2.0/(float)q->image->width)*0.25;
+				}
+				if (window.height % 2 != 0) {
+					BL->uv.y -= (2.0/(float)q->image->height)*0.25;
+					TL->uv.y -= (2.0/(float)q->image->height)*0.25;
+					TR->uv.y -= (2.0/(float)q->image->height)*0.25;
+					BR->uv.y -= (2.0/(float)q->image->height)*0.25;
+				}
+
+				u8 sampler = -1;
+				if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
+							&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
+						sampler = 0;
+				if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
+							&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
+						sampler = 1;
+				if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
+							&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
+						sampler = 2;
+				if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
+							&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
+						sampler = 3;
+				BL->sampler=TL->sampler=TR->sampler=BR->sampler = (u8)sampler;
+						
+			}
+			BL->texture_index=TL->texture_index=TR->texture_index=BR->texture_index = texture_index;
+			
+			BL->self_uv = v2(0, 0);
+			TL->self_uv = v2(0, 1);
+			TR->self_uv = v2(1, 1);
+			BR->self_uv = v2(1, 0);
+			
+			// #Speed
+			memcpy(BL->userdata, q->userdata, sizeof(q->userdata));
+			memcpy(TL->userdata, q->userdata, sizeof(q->userdata));
+			memcpy(TR->userdata, q->userdata, sizeof(q->userdata));
+			memcpy(BR->userdata, q->userdata, sizeof(q->userdata));
+			
+			BL->color = TL->color = TR->color = BR->color = q->color;
+			
+			BL->type=TL->type=TR->type=BR->type = (u8)q->type;
+			
+			Vector4 scissor = ZERO(Vector4);
+			if (q->scissor_index) scissor = scissor_buffer[q->scissor_index-1];
+			
+			float t = scissor.y1;
+			scissor.y1 = scissor.y2;
+			scissor.y2 = t;
+			
+			scissor.y1 = window.pixel_height - scissor.y1;
+			scissor.y2 = window.pixel_height - scissor.y2;
+			
+			BL->has_scissor=TL->has_scissor=TR->has_scissor=BR->has_scissor = q->scissor_index != 0;
+			BL->scissor=TL->scissor=TR->scissor=BR->scissor = scissor;
+			
+			*BL2 = *BL;
+			*TR2 = *TR;
+		}
+	}
+}
+
+// Builds vertices for quad_count quads starting at order[first_quad], then uploads and draws them.
+void d3d11_draw_quads(u32 *order, u64 first_quad, u64 quad_count, ID3D11ShaderResourceView **textures, u64 num_textures) {
 	HRESULT hr;
 	
+	D3D11_Quad_Vertex_Job job = { order, first_quad };
+	tm_scope("Quad processing") {
+		// Doesn't start the job system, but uses it if it's there.
+		// Not worth waking the workers for small frames.
+		bool wide = job_system_initted && quad_count > D3D11_QUAD_VERTEX_BATCH;
+		if (!wide) d3d11_build_quad_vertices(0, quad_count, &job);
+		else parallel_for(quad_count, D3D11_QUAD_VERTEX_BATCH, d3d11_build_quad_vertices, &job);
+	}
+	
+	tm_scope("Write to gpu") {
+	    D3D11_MAPPED_SUBRESOURCE buffer_mapping;
+		tm_scope("The Map call") {
+			hr = ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
+		d3d11_check_hr(hr);
+		}
+		tm_scope("The memcpy") {
+			memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, quad_count*sizeof(D3D11_Vertex)*6);
+		}
+		tm_scope("The Unmap call") {
+			ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
+		}
+	}
+	
+	///
+	// Draw call
+	tm_scope("Draw call") d3d11_draw_call(quad_count, textures, num_textures);
+}
+
+void d3d11_process_draw_frame() {
+	
 	ID3D11DeviceContext_ClearRenderTargetView(d3d11_context, d3d11_window_render_target_view, (float*)&window.clear_color);
 	
 	///
@@ -633,6 +803,13 @@ void d3d11_process_draw_frame() {
 		
 		log_verbose("Grew quad vbo to %d bytes.", d3d11_quad_vbo_size);
 	}
+	
+	if (d3d11_quad_texture_indices_count < allocated_quads) {
+		// #Memory #Heapalloc
+		if (d3d11_quad_texture_indices) dealloc(get_heap_allocator(), d3d11_quad_texture_indices);
+		d3d11_quad_texture_indices = alloc(get_heap_allocator(), allocated_quads*sizeof(s8));
+		d3d11_quad_texture_indices_count = allocated_quads;
+	}
 
 	if (draw_frame.num_quads > 0) {
 		///
@@ -644,24 +821,19 @@ void d3d11_process_draw_frame() {
 		u64 num_textures = 0;
 		s8 last_texture_index = 0;
 		
-		D3D11_Vertex* head = (D3D11_Vertex*)d3d11_staging_quad_buffer;
-		D3D11_Vertex* pointer = head;
-		u64 number_of_rendered_quads = 0;
+		u64 first_quad_in_batch = 0;
 		
-		tm_scope("Quad processing") {
-			if (draw_frame.enable_z_sorting) tm_scope("Z sorting") {
-				if (!sort_quad_buffer || (sort_quad_buffer_size < allocated_quads*sizeof(Draw_Quad))) {
-					// #Memory #Heapalloc
-					if (sort_quad_buffer) dealloc(get_heap_allocator(), sort_quad_buffer);
-					sort_quad_buffer = alloc(get_heap_allocator(), allocated_quads*sizeof(Draw_Quad));
-					sort_quad_buffer_size = allocated_quads*sizeof(Draw_Quad);
-				}
-				radix_sort(quad_buffer, sort_quad_buffer, draw_frame.num_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
-			}
+		u32 *order = 0;
+		tm_scope("Z sorting") {
+			order = get_draw_frame_quad_order();
+		}
 		
+		// Texture slots depend on the quads before, so this part is serial. It's cheap, the
+		// expensive part is building the vertices which is done wide in d3d11_draw_quads.
+		tm_scope("Texture slots") {
 			for (u64 i = 0; i < draw_frame.num_quads; i++)  {
 				
-				Draw_Quad *q = &quad_buffer[i];
+				Draw_Quad *q = &quad_buffer[order[i]];
 				
 				assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
 				assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
@@ -683,21 +855,13 @@ void d3d11_process_draw_frame() {
 						// Otherwise use a new slot
 						if (texture_index <= -1) {
 							if (num_textures >= 32) {
-								// If max textures reached, make a draw call and start over
-								D3D11_MAPPED_SUBRESOURCE buffer_mapping;
-								ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
-								memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(D3D11_Vertex)*6);
-								ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
-								d3d11_draw_call(number_of_rendered_quads, textures, num_textures);
-								head = (D3D11_Vertex*)d3d11_staging_quad_buffer;
+								// If max textures reached, draw what we have and start over
+								d3d11_draw_quads(order, first_quad_in_batch, i-first_quad_in_batch, textures, num_textures);
+								first_quad_in_batch = i;
 								num_textures = 0;
-								texture_index = 0;
-								number_of_rendered_quads = 0;
-								pointer = head;
-							} else {
-								texture_index = (s8)num_textures;
-								num_textures += 1;
 							}
+							texture_index = (s8)num_textures;
+							num_textures += 1;
 						}
 					}
 					textures[texture_index] = q->image->gfx_handle;
@@ -705,144 +869,11 @@ void d3d11_process_draw_frame() {
 					last_texture_index = texture_index;
 				}
 				
-				if (q->type == QUAD_TYPE_TEXT) {
-				
-				    // This is meant to fix the annoying artifacts that shows up when sampling text from an atlas
-				    // presumably for floating point precision issues or something.
-				
-				    // #Incomplete
-				    // If we want to animate text with small movements then it will look wonky.
-				    // This should be optional probably.
-				    // Also, we might want to do this on non-text if rendering with linear filtering
-				    // from a large texture atlas.
-				
-					float pixel_width = 2.0/(float)window.width;
-					float pixel_height = 2.0/(float)window.height;
-
-                    bool xeven = window.width % 2 == 0;
-                    bool yeven = window.height % 2 == 0;
-					
-					q->bottom_left.x  = round(q->bottom_left.x  / pixel_width)  * pixel_width;
-				    q->bottom_left.y  = round(q->bottom_left.y  / pixel_height) * pixel_height;
-				    q->top_left.x     = round(q->top_left.x     / pixel_width)  * pixel_width;
-				    q->top_left.y     = round(q->top_left.y     / pixel_height) * pixel_height;
-				    q->top_right.x    = round(q->top_right.x    / pixel_width)  * pixel_width;
-				    q->top_right.y    = round(q->top_right.y    / pixel_height) * pixel_height;
-				    q->bottom_right.x = round(q->bottom_right.x / pixel_width)  * pixel_width;
-				    q->bottom_right.y = round(q->bottom_right.y / pixel_height) * pixel_height;
-				}
-				
-				// We will write to 6 vertices for the one quad (two tris)
-				 {
-				
-					D3D11_Vertex* BL  = pointer + 0;
-					D3D11_Vertex* TL  = pointer + 1;
-					D3D11_Vertex* TR  = pointer + 2;
-					D3D11_Vertex* BL2 = pointer + 3;
-					D3D11_Vertex* TR2 = pointer + 4;
-					D3D11_Vertex* BR  = pointer + 5;
-					pointer += 6;
-					
-					BL->position = v4(q->bottom_left.x,  q->bottom_left.y,  0, 1);
-					TL->position = v4(q->top_left.x,     q->top_left.y,     0, 1);
-					TR->position = v4(q->top_right.x,    q->top_right.y,    0, 1);
-					BR->position = v4(q->bottom_right.x, q->bottom_right.y, 0, 1);
-					
-					
-					if (q->image) {
-
-						BL->uv = v2(q->uv.x1, q->uv.y1);
-						TL->uv = v2(q->uv.x1, q->uv.y2);
-						TR->uv = v2(q->uv.x2, q->uv.y2);
-						BR->uv = v2(q->uv.x2, q->uv.y1);
-						// #Hack #Bug #Cleanup
-						// When a window dimension is uneven it slightly under/oversamples on an axis by a
-						// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
-						// (It undersamples by a fourth of the atlas texture?)
-						// Anything > 0.25 < will slightly over/undersample on my machine.
-						// I have no idea about #Portability here.
-						// - Charlie M 26th July 2024
-						if (window.width % 2 != 0) {
-							BL->uv.x += (2.0/(float)q->image->width)*0.25;
-							TL->uv.x += (2.0/(float)q->image->width)*0.25;
-							TR->uv.x += (2.0/(float)q->image->width)*0.25;
-							BR->uv.x += (2.0/(float)q->image->width)*0.25;
-						}
-						if (window.height % 2 != 0) {
-							BL->uv.y -= (2.0/(float)q->image->height)*0.25;
-							TL->uv.y -= (2.0/(float)q->image->height)*0.25;
-							TR->uv.y -= (2.0/(float)q->image->height)*0.25;
-							BR->uv.y -= (2.0/(float)q->image->height)*0.25;
-						}
-
-						u8 sampler = -1;
-						if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
-									&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
-								sampler = 0;
-						if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
-									&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
-								sampler = 1;
-						if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
-									&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
-								sampler = 2;
-						if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
-									&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
-								sampler = 3;
-						BL->sampler=TL->sampler=TR->sampler=BR->sampler = (u8)sampler;
-								
-					}
-					BL->texture_index=TL->texture_index=TR->texture_index=BR->texture_index = texture_index;
-					
-					BL->self_uv = v2(0, 0);
-					TL->self_uv = v2(0, 1);
-					TR->self_uv = v2(1, 1);
-					BR->self_uv = v2(1, 0);
-					
-					// #Speed
-					memcpy(BL->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(TL->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(TR->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(BR->userdata, q->userdata, sizeof(q->userdata));
-					
-					BL->color = TL->color = TR->color = BR->color = q->color;
-					
-					BL->type=TL->type=TR->type=BR->type = (u8)q->type;
-					
-					float t = q->scissor.y1;
-					q->scissor.y1 = q->scissor.y2;
-					q->scissor.y2 = t;
-					
-					q->scissor.y1 = window.pixel_height - q->scissor.y1;
-					q->scissor.y2 = window.pixel_height - q->scissor.y2;
-					
-					BL->has_scissor=TL->has_scissor=TR->has_scissor=BR->has_scissor = q->has_scissor;
-					BL->scissor=TL->scissor=TR->scissor=BR->scissor = q->scissor;
-					
-					*BL2 = *BL;
-					*TR2 = *TR;
-					
-					number_of_rendered_quads += 1;
-				}
-			}
-		}
-		
-		tm_scope("Write to gpu") {
-		    D3D11_MAPPED_SUBRESOURCE buffer_mapping;
-			tm_scope("The Map call") {
-				hr = ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
-			d3d11_check_hr(hr);
-			}
-			tm_scope("The memcpy") {
-				memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(D3D11_Vertex)*6);
-			}
-			tm_scope("The Unmap call") {
-				ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
+				d3d11_quad_texture_indices[i] = texture_index;
 			}
 		}
 		
-		///
-		// Draw call
-		tm_scope("Draw call") d3d11_draw_call(number_of_rendered_quads, textures, num_textures);
+		d3d11_draw_quads(order, first_quad_in_batch, draw_frame.num_quads-first_quad_in_batch, textures, num_textures);
     }
     
     reset_draw_frame(&draw_frame);
@@ -0,0 +1,691 @@
+
+///
+///
+// Software renderer
+///
+// Renders draw_frame on the CPU into software_framebuffer (RGBA8, top row first) instead of a
+// window. For headless builds (tests, CI, servers that want screenshots) and machines with no GPU.
+// #Incomplete Nothing is presented to the window if there is one.
+//
+// It takes the same Draw_Frame as the d3d11 renderer and should give the same picture: quad
+// types, scissor, z sorting, samplers and blending (src alpha, inv src alpha, alpha = src alpha)
+// all work the same way. Pixel shader extensions don't exist here, so
+// shader_recompile_with_extension() fails.
+//
+// The framebuffer is split into SOFTWARE_TILE_SIZE tiles. Every quad is set up once and binned
+// to the tiles it touches, and then the tiles are rasterized in parallel with parallel_for().
+// A tile draws its quads in order, so blending comes out the same as drawing them one by one.
+// It only goes wide if the job system is running, it won't start it for you.
+//
+// Quads are drawn as the same two triangles (BL TL TR, BL TR BR) as on the GPU, with D3D's
+// pixel center and top-left fill rules so edges shared by the triangles, or by neighbouring
+// quads, are only drawn once. Edge functions are evaluated 4 pixels at a time with SSE.
+
+#define SOFTWARE_TILE_SIZE 64
+
+const Gfx_Handle GFX_INVALID_HANDLE = 0;
+
+typedef struct Software_Texture {
+	u32 width, height, channels;
+	u8 *pixels;
+} Software_Texture;
+
+// Draw_Quad turned into what the rasterizer needs, in pixels with y down
+typedef struct Software_Quad {
+	Vector2 corners[4]; // bottom_left, top_left, top_right, bottom_right
+	Vector4 color;
+	Vector4 uv;
+	Software_Texture *texture;
+	bool linear; // Filter for the texture, min or mag depending on the size on screen
+	u8 type;
+	// Pixels which may be touched, clipped to the framebuffer and the scissor. max is exclusive.
+	s32 min_x, min_y, max_x, max_y;
+} Software_Quad;
+
+// value(x, y) = dx*x + dy*y + c
+typedef struct Software_Plane {
+	float32 dx, dy, c;
+} Software_Plane;
+
+// #Global
+ogb_instance Software_Quad *software_quads;
+ogb_instance u64 software_quads_allocated;
+ogb_instance u32 software_tile_count_x, software_tile_count_y;
+// Quads for tile i are software_tile_quads[software_tile_offsets[i]..software_tile_offsets[i+1]]
+ogb_instance u32 *software_tile_offsets;
+ogb_instance u32 *software_tile_quads;
+ogb_instance u64 software_tile_quads_allocated;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Software_Framebuffer software_framebuffer = {0};
+Software_Quad *software_quads = 0;
+u64 software_quads_allocated = 0;
+u32 software_tile_count_x = 0, software_tile_count_y = 0;
+u32 *software_tile_offsets = 0;
+u32 *software_tile_quads = 0;
+u64 software_tile_quads_allocated = 0;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void software_resize_framebuffer(u32 width, u32 height) {
+	Allocator heap = get_heap_allocator();
+	if (software_framebuffer.pixels) dealloc(heap, software_framebuffer.pixels);
+	if (software_tile_offsets) dealloc(heap, software_tile_offsets);
+
+	software_framebuffer.width  = width;
+	software_framebuffer.height = height;
+	software_framebuffer.stride = (width + 3) & ~3u;
+	software_framebuffer.pixels = (u32*)alloc_aligned(heap, max((u64)software_framebuffer.stride*height, 4)*sizeof(u32), 16);
+	memset(software_framebuffer.pixels, 0, (u64)software_framebuffer.stride*height*sizeof(u32));
+
+	software_tile_count_x = (width  + SOFTWARE_TILE_SIZE-1) / SOFTWARE_TILE_SIZE;
+	software_tile_count_y = (height + SOFTWARE_TILE_SIZE-1) / SOFTWARE_TILE_SIZE;
+	software_tile_offsets = (u32*)alloc(heap, ((u64)software_tile_count_x*software_tile_count_y + 1)*sizeof(u32));
+
+	log_verbose("Software framebuffer is %ux%u", width, height);
+}
+
+void gfx_init() {
+	// Headless doesn't have a window to take the size from
+	if (window.width <= 0 || window.height <= 0) {
+		window.width  = 1280;
+		window.height = 720;
+		window.clear_color = v4(0.392f, 0.584f, 0.929f, 1.0f);
+	}
+	window.enable_vsync = false;
+
+	software_resize_framebuffer(window.width, window.height);
+	reset_draw_frame(&draw_frame);
+
+	log_info("Software renderer init done");
+}
+
+///
+// Pixels
+
+inline u32 software_pack_color(Vector4 c) {
+	u32 r = (u32)(clamp(c.r, 0.0f, 1.0f)*255.0f + 0.5f);
+	u32 g = (u32)(clamp(c.g, 0.0f, 1.0f)*255.0f + 0.5f);
+	u32 b = (u32)(clamp(c.b, 0.0f, 1.0f)*255.0f + 0.5f);
+	u32 a = (u32)(clamp(c.a, 0.0f, 1.0f)*255.0f + 0.5f);
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+inline Vector4 software_unpack_color(u32 c) {
+	const float32 s = 1.0f/255.0f;
+	return v4((c & 0xff)*s, ((c >> 8) & 0xff)*s, ((c >> 16) & 0xff)*s, (c >> 24)*s);
+}
+// #Volatile same as d3d11_blend_state
+inline u32 software_blend(u32 dst, Vector4 src) {
+	Vector4 d = software_unpack_color(dst);
+	float32 inv = 1.0f - src.a;
+	return software_pack_color(v4(src.r*src.a + d.r*inv, src.g*src.a + d.g*inv, src.b*src.a + d.b*inv, src.a));
+}
+
+inline Vector4 software_fetch_texel(Software_Texture *t, s32 x, s32 y) {
+	x = clamp(x, 0, (s32)t->width-1);
+	y = clamp(y, 0, (s32)t->height-1);
+	u8 *p = t->pixels + ((u64)y*t->width + x)*t->channels;
+	const float32 s = 1.0f/255.0f;
+	switch (t->channels) {
+		case 1: return v4(p[0]*s, 0, 0, 1);
+		case 2: return v4(p[0]*s, p[1]*s, 0, 1);
+		case 4: return v4(p[0]*s, p[1]*s, p[2]*s, p[3]*s);
+		default: return v4(1, 0, 1, 1);
+	}
+}
+// Clamped addressing like the d3d11 samplers. Row 0 is v=0.
+Vector4 software_sample(Software_Texture *t, bool linear, float32 u, float32 v) {
+	float32 x = u*(float32)t->width;
+	float32 y = v*(float32)t->height;
+	if (!linear) return software_fetch_texel(t, (s32)floorf(x), (s32)floorf(y));
+
+	x -= 0.5f;
+	y -= 0.5f;
+	float32 x0 = floorf(x);
+	float32 y0 = floorf(y);
+	float32 fx = x - x0;
+	float32 fy = y - y0;
+	s32 ix = (s32)x0;
+	s32 iy = (s32)y0;
+	Vector4 a = software_fetch_texel(t, ix,   iy);
+	Vector4 b = software_fetch_texel(t, ix+1, iy);
+	Vector4 c = software_fetch_texel(t, ix,   iy+1);
+	Vector4 d = software_fetch_texel(t, ix+1, iy+1);
+	Vector4 top    = v4_add(v4_mulf(a, 1.0f-fx), v4_mulf(b, fx));
+	Vector4 bottom = v4_add(v4_mulf(c, 1.0f-fx), v4_mulf(d, fx));
+	return v4_add(v4_mulf(top, 1.0f-fy), v4_mulf(bottom, fy));
+}
+
+// #Volatile same as ps_main in the d3d11 shader
+Vector4 software_shade(Software_Quad *q, float32 u, float32 v, float32 self_u, float32 self_v) {
+	if (q->type == QUAD_TYPE_CIRCLE) {
+		float32 dx = self_u - 0.5f;
+		float32 dy = self_v - 0.5f;
+		if (dx*dx + dy*dy > 0.25f) return v4(0, 0, 0, 0);
+	} else if (q->type != QUAD_TYPE_REGULAR && q->type != QUAD_TYPE_TEXT) {
+		return v4(1, 1, 0, 1);
+	}
+
+	if (!q->texture) return q->color;
+
+	Vector4 texel = software_sample(q->texture, q->linear, u, v);
+	if (q->type == QUAD_TYPE_TEXT) return v4(q->color.r, q->color.g, q->color.b, q->color.a*texel.r);
+	return v4_mul(texel, q->color);
+}
+
+///
+// Setup & binning
+
+// userdata is the order from get_draw_frame_quad_order()
+void software_setup_quads(u64 first, u64 last, void *userdata) {
+	u32 *order = (u32*)userdata;
+	float32 width  = (float32)software_framebuffer.width;
+	float32 height = (float32)software_framebuffer.height;
+
+	for (u64 i = first; i < last; i++) {
+		Draw_Quad *q = &quad_buffer[order[i]];
+		Software_Quad *s = &software_quads[i];
+
+		assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
+		assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
+
+		Vector2 ndc[4] = {q->bottom_left, q->top_left, q->top_right, q->bottom_right};
+
+		// #Volatile same as d3d11_process_draw_frame
+		if (q->type == QUAD_TYPE_TEXT) {
+			float pixel_width  = 2.0/(float)window.width;
+			float pixel_height = 2.0/(float)window.height;
+			for (u64 j = 0; j < 4; j++) {
+				ndc[j].x = roundf(ndc[j].x / pixel_width)  * pixel_width;
+				ndc[j].y = roundf(ndc[j].y / pixel_height) * pixel_height;
+			}
+		}
+
+		float32 min_x = F32_MAX, min_y = F32_MAX, max_x = -F32_MAX, max_y = -F32_MAX;
+		for (u64 j = 0; j < 4; j++) {
+			Vector2 p = v2((ndc[j].x + 1.0f)*0.5f*width, (1.0f - ndc[j].y)*0.5f*height);
+			s->corners[j] = p;
+			min_x = min(min_x, p.x);
+			min_y = min(min_y, p.y);
+			max_x = max(max_x, p.x);
+			max_y = max(max_y, p.y);
+		}
+
+		// A pixel is drawn if its center is inside, so this might be a pixel too generous
+		s->min_x = (s32)clamp(floorf(min_x), 0.0f, width);
+		s->min_y = (s32)clamp(floorf(min_y), 0.0f, height);
+		s->max_x = (s32)clamp(ceilf(max_x),  0.0f, width);
+		s->max_y = (s32)clamp(ceilf(max_y),  0.0f, height);
+
+		if (q->scissor_index) {
+			// Scissor is in window pixels with y up, and a pixel is kept if its center is inside
+			Vector4 scissor = scissor_buffer[q->scissor_index-1];
+			s->min_x = max(s->min_x, (s32)clamp(ceilf(scissor.x1 - 0.5f), 0.0f, width));
+			s->max_x = min(s->max_x, (s32)clamp(ceilf(scissor.x2 - 0.5f), 0.0f, width));
+			s->min_y = max(s->min_y, (s32)clamp(ceilf(height - scissor.y2 - 0.5f), 0.0f, height));
+			s->max_y = min(s->max_y, (s32)clamp(ceilf(height - scissor.y1 - 0.5f), 0.0f, height));
+		}
+
+		s->color = q->color;
+		s->uv = q->uv;
+		s->type = q->type;
+		s->texture = q->image ? q->image->gfx_handle : 0;
+		s->linear = false;
+		if (s->texture) {
+			// No mips, so min vs mag is just whether a pixel covers more than a texel
+			float32 texels = fabsf(q->uv.x2 - q->uv.x1)*(float32)s->texture->width;
+			float32 pixels = max(max_x - min_x, 1.0f);
+			Gfx_Filter_Mode filter = texels > pixels ? q->image_min_filter : q->image_mag_filter;
+			s->linear = filter == GFX_FILTER_MODE_LINEAR;
+		}
+	}
+}
+
+inline bool software_quad_tiles(Software_Quad *s, u32 *tx0, u32 *ty0, u32 *tx1, u32 *ty1) {
+	if (s->min_x >= s->max_x || s->min_y >= s->max_y) return false;
+	*tx0 = (u32)s->min_x / SOFTWARE_TILE_SIZE;
+	*ty0 = (u32)s->min_y / SOFTWARE_TILE_SIZE;
+	*tx1 = (u32)(s->max_x-1) / SOFTWARE_TILE_SIZE;
+	*ty1 = (u32)(s->max_y-1) / SOFTWARE_TILE_SIZE;
+	return true;
+}
+
+void software_bin_quads(u64 quad_count) {
+	u64 tile_count = (u64)software_tile_count_x*software_tile_count_y;
+	u32 *offsets = software_tile_offsets;
+	memset(offsets, 0, (tile_count+1)*sizeof(u32));
+
+	// Count, then turn the counts into where each tile's list starts, then fill
+	u64 total = 0;
+	for (u64 i = 0; i < quad_count; i++) {
+		u32 tx0, ty0, tx1, ty1;
+		if (!software_quad_tiles(&software_quads[i], &tx0, &ty0, &tx1, &ty1)) continue;
+		for (u32 ty = ty0; ty <= ty1; ty++) {
+			for (u32 tx = tx0; tx <= tx1; tx++) offsets[ty*software_tile_count_x + tx + 1] += 1;
+		}
+		total += (u64)(tx1-tx0+1)*(ty1-ty0+1);
+	}
+	for (u64 i = 0; i < tile_count; i++) offsets[i+1] += offsets[i];
+
+	if (total > software_tile_quads_allocated) {
+		// #Memory
+		u64 new_count = max(get_next_power_of_two(total), 1024);
+		if (software_tile_quads) dealloc(get_heap_allocator(), software_tile_quads);
+		software_tile_quads = (u32*)alloc(get_heap_allocator(), new_count*sizeof(u32));
+		software_tile_quads_allocated = new_count;
+	}
+
+	// Fill with offsets[i] as the cursor, which moves it to where tile i+1 starts. Shift back after.
+	for (u64 i = 0; i < quad_count; i++) {
+		u32 tx0, ty0, tx1, ty1;
+		if (!software_quad_tiles(&software_quads[i], &tx0, &ty0, &tx1, &ty1)) continue;
+		for (u32 ty = ty0; ty <= ty1; ty++) {
+			for (u32 tx = tx0; tx <= tx1; tx++) {
+				software_tile_quads[offsets[ty*software_tile_count_x + tx]++] = (u32)i;
+			}
+		}
+	}
+	for (s64 i = (s64)tile_count; i > 0; i--) offsets[i] = offsets[i-1];
+	offsets[0] = 0;
+}
+
+///
+// Rasterization
+
+Software_Plane software_make_plane(Vector2 a, Vector2 b, Vector2 c, float32 va, float32 vb, float32 vc, float32 inv_det) {
+	Software_Plane p;
+	p.dx = ((vb-va)*(c.y-a.y) - (vc-va)*(b.y-a.y))*inv_det;
+	p.dy = ((vc-va)*(b.x-a.x) - (vb-va)*(c.x-a.x))*inv_det;
+	p.c  = va - p.dx*a.x - p.dy*a.y;
+	return p;
+}
+
+// The edge from a to b, positive on the inside
+typedef struct Software_Edge {
+	float32 a, b, c;
+	bool inclusive; // Top-left rule: pixel centers exactly on the edge are only drawn for top or left edges
+} Software_Edge;
+Software_Edge software_make_edge(Vector2 from, Vector2 to, float32 sign) {
+	Software_Edge e;
+	e.a = -(to.y - from.y)*sign;
+	e.b =  (to.x - from.x)*sign;
+	e.c = -(e.a*from.x + e.b*from.y);
+	e.inclusive = e.a > 0 || (e.a == 0 && e.b > 0);
+	return e;
+}
+
+void software_draw_triangle(Software_Quad *q, Vector2 p0, Vector2 p1, Vector2 p2, Vector2 uv0, Vector2 uv1, Vector2 uv2, Vector2 self0, Vector2 self1, Vector2 self2, s32 clip_min_x, s32 clip_min_y, s32 clip_max_x, s32 clip_max_y) {
+	float32 det = (p1.x-p0.x)*(p2.y-p0.y) - (p2.x-p0.x)*(p1.y-p0.y);
+	if (fabsf(det) < 1e-12f) return;
+	float32 sign = det > 0 ? 1.0f : -1.0f;
+
+	Software_Edge edges[3] = {
+		software_make_edge(p0, p1, sign),
+		software_make_edge(p1, p2, sign),
+		software_make_edge(p2, p0, sign),
+	};
+
+	s32 min_x = max(clip_min_x, (s32)floorf(min(p0.x, min(p1.x, p2.x))));
+	s32 min_y = max(clip_min_y, (s32)floorf(min(p0.y, min(p1.y, p2.y))));
+	s32 max_x = min(clip_max_x, (s32)ceilf(max(p0.x, max(p1.x, p2.x))));
+	s32 max_y = min(clip_max_y, (s32)ceilf(max(p0.y, max(p1.y, p2.y))));
+	if (min_x >= max_x || min_y >= max_y) return;
+
+	// Untextured quads are the same color everywhere so those can be blended 4 at a time
+	bool constant = !q->texture && (q->type == QUAD_TYPE_REGULAR || q->type == QUAD_TYPE_TEXT);
+
+	Software_Plane u = {0}, v = {0}, self_u = {0}, self_v = {0};
+	if (!constant) {
+		float32 inv_det = 1.0f/det;
+		u      = software_make_plane(p0, p1, p2, uv0.x,   uv1.x,   uv2.x,   inv_det);
+		v      = software_make_plane(p0, p1, p2, uv0.y,   uv1.y,   uv2.y,   inv_det);
+		self_u = software_make_plane(p0, p1, p2, self0.x, self1.x, self2.x, inv_det);
+		self_v = software_make_plane(p0, p1, p2, self0.y, self1.y, self2.y, inv_det);
+	}
+
+	u32 *pixels = software_framebuffer.pixels;
+	u64 stride = software_framebuffer.stride;
+
+	// Start on a multiple of 4 so groups line up with the (padded) rows
+	s32 start_x = min_x & ~3;
+
+#if ENABLE_SIMD
+	const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128i lane_index  = _mm_setr_epi32(0, 1, 2, 3);
+	__m128 edge_a[3], edge_b[3], edge_c[3];
+	for (u64 i = 0; i < 3; i++) {
+		edge_a[i] = _mm_set1_ps(edges[i].a);
+		edge_b[i] = _mm_set1_ps(edges[i].b);
+		edge_c[i] = _mm_set1_ps(edges[i].c);
+	}
+
+	// src*a + dst*(1-a), alpha = src alpha. In 0-255 so we don't have to scale dst.
+	__m128 src_term = _mm_setr_ps(q->color.r*q->color.a*255.0f, q->color.g*q->color.a*255.0f, q->color.b*q->color.a*255.0f, q->color.a*255.0f);
+	__m128 dst_factor = _mm_setr_ps(1.0f-q->color.a, 1.0f-q->color.a, 1.0f-q->color.a, 0.0f);
+	src_term = _mm_min_ps(_mm_max_ps(src_term, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+	const __m128i zero = _mm_setzero_si128();
+
+	for (s32 y = min_y; y < max_y; y++) {
+		__m128 py = _mm_set1_ps((float32)y + 0.5f);
+		__m128 row_e[3];
+		for (u64 i = 0; i < 3; i++) row_e[i] = _mm_add_ps(_mm_mul_ps(edge_b[i], py), edge_c[i]);
+
+		u32 *row = pixels + (u64)y*stride;
+		for (s32 x = start_x; x < max_x; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float32)x), lane_offsets);
+
+			__m128i xs = _mm_add_epi32(_mm_set1_epi32(x), lane_index);
+			__m128i in_range = _mm_and_si128(
+				_mm_cmpgt_epi32(xs, _mm_set1_epi32(min_x-1)),
+				_mm_cmplt_epi32(xs, _mm_set1_epi32(max_x)));
+			__m128 mask = _mm_castsi128_ps(in_range);
+			for (u64 i = 0; i < 3; i++) {
+				__m128 e = _mm_add_ps(_mm_mul_ps(edge_a[i], px), row_e[i]);
+				__m128 inside = edges[i].inclusive ? _mm_cmpge_ps(e, _mm_setzero_ps()) : _mm_cmpgt_ps(e, _mm_setzero_ps());
+				mask = _mm_and_ps(mask, inside);
+			}
+			int bits = _mm_movemask_ps(mask);
+			if (!bits) continue;
+
+			if (constant) {
+				__m128i d = _mm_load_si128((__m128i*)(row + x));
+				__m128i lo = _mm_unpacklo_epi8(d, zero);
+				__m128i hi = _mm_unpackhi_epi8(d, zero);
+				__m128 c0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+				__m128 c1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+				__m128 c2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+				__m128 c3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+				c0 = _mm_add_ps(src_term, _mm_mul_ps(c0, dst_factor));
+				c1 = _mm_add_ps(src_term, _mm_mul_ps(c1, dst_factor));
+				c2 = _mm_add_ps(src_term, _mm_mul_ps(c2, dst_factor));
+				c3 = _mm_add_ps(src_term, _mm_mul_ps(c3, dst_factor));
+				__m128i packed = _mm_packus_epi16(
+					_mm_packs_epi32(_mm_cvtps_epi32(c0), _mm_cvtps_epi32(c1)),
+					_mm_packs_epi32(_mm_cvtps_epi32(c2), _mm_cvtps_epi32(c3)));
+				__m128i keep = _mm_castps_si128(mask);
+				packed = _mm_or_si128(_mm_and_si128(keep, packed), _mm_andnot_si128(keep, d));
+				_mm_store_si128((__m128i*)(row + x), packed);
+			} else {
+				float32 fy = (float32)y + 0.5f;
+				for (s32 lane = 0; lane < 4; lane++) {
+					if (!(bits & (1 << lane))) continue;
+					float32 fx = (float32)(x + lane) + 0.5f;
+					Vector4 src = software_shade(q,
+						u.dx*fx + u.dy*fy + u.c,
+						v.dx*fx + v.dy*fy + v.c,
+						self_u.dx*fx + self_u.dy*fy + self_u.c,
+						self_v.dx*fx + self_v.dy*fy + self_v.c);
+					row[x + lane] = software_blend(row[x + lane], src);
+				}
+			}
+		}
+	}
+#else
+	(void)start_x;
+	for (s32 y = min_y; y < max_y; y++) {
+		float32 fy = (float32)y + 0.5f;
+		u32 *row = pixels + (u64)y*stride;
+		for (s32 x = min_x; x < max_x; x++) {
+			float32 fx = (float32)x + 0.5f;
+			bool inside = true;
+			for (u64 i = 0; i < 3 && inside; i++) {
+				float32 e = edges[i].a*fx + edges[i].b*fy + edges[i].c;
+				inside = edges[i].inclusive ? e >= 0 : e > 0;
+			}
+			if (!inside) continue;
+
+			Vector4 src = constant ? q->color : software_shade(q,
+				u.dx*fx + u.dy*fy + u.c,
+				v.dx*fx + v.dy*fy + v.c,
+				self_u.dx*fx + self_u.dy*fy + self_u.c,
+				self_v.dx*fx + self_v.dy*fy + self_v.c);
+			row[x] = software_blend(row[x], src);
+		}
+	}
+#endif
+}
+
+void software_draw_tiles(u64 first, u64 last, void *userdata) {
+	u32 clear = software_pack_color(window.clear_color);
+
+	for (u64 tile = first; tile < last; tile++) {
+		s32 tile_min_x = (s32)(tile % software_tile_count_x)*SOFTWARE_TILE_SIZE;
+		s32 tile_min_y = (s32)(tile / software_tile_count_x)*SOFTWARE_TILE_SIZE;
+		s32 tile_max_x = min(tile_min_x + SOFTWARE_TILE_SIZE, (s32)software_framebuffer.width);
+		s32 tile_max_y = min(tile_min_y + SOFTWARE_TILE_SIZE, (s32)software_framebuffer.height);
+
+		for (s32 y = tile_min_y; y < tile_max_y; y++) {
+			u32 *row = software_framebuffer.pixels + (u64)y*software_framebuffer.stride;
+			for (s32 x = tile_min_x; x < tile_max_x; x++) row[x] = clear;
+		}
+
+		for (u32 i = software_tile_offsets[tile]; i < software_tile_offsets[tile+1]; i++) {
+			Software_Quad *q = &software_quads[software_tile_quads[i]];
+
+			s32 min_x = max(q->min_x, tile_min_x);
+			s32 min_y = max(q->min_y, tile_min_y);
+			s32 max_x = min(q->max_x, tile_max_x);
+			s32 max_y = min(q->max_y, tile_max_y);
+
+			Vector2 *c = q->corners;
+			Vector2 uv_bl = v2(q->uv.x1, q->uv.y1);
+			Vector2 uv_tl = v2(q->uv.x1, q->uv.y2);
+			Vector2 uv_tr = v2(q->uv.x2, q->uv.y2);
+			Vector2 uv_br = v2(q->uv.x2, q->uv.y1);
+
+			software_draw_triangle(q, c[0], c[1], c[2], uv_bl, uv_tl, uv_tr, v2(0, 0), v2(0, 1), v2(1, 1), min_x, min_y, max_x, max_y);
+			software_draw_triangle(q, c[0], c[2], c[3], uv_bl, uv_tr, uv_br, v2(0, 0), v2(1, 1), v2(1, 0), min_x, min_y, max_x, max_y);
+		}
+	}
+}
+
+void software_process_draw_frame() {
+	u64 quad_count = draw_frame.num_quads;
+	u64 tile_count = (u64)software_tile_count_x*software_tile_count_y;
+
+	// Doesn't start the job system, but uses it if it's there
+	bool wide = job_system_initted;
+
+	if (quad_count > 0) {
+		u32 *order = 0;
+		tm_scope("Z sorting") {
+			order = get_draw_frame_quad_order();
+		}
+
+		if (software_quads_allocated < allocated_quads) {
+			// #Memory
+			if (software_quads) dealloc(get_heap_allocator(), software_quads);
+			software_quads = (Software_Quad*)alloc(get_heap_allocator(), allocated_quads*sizeof(Software_Quad));
+			software_quads_allocated = allocated_quads;
+		}
+
+		tm_scope("Quad setup") {
+			if (wide) parallel_for(quad_count, 1024, software_setup_quads, order);
+			else      software_setup_quads(0, quad_count, order);
+		}
+	}
+
+	tm_scope("Binning") {
+		software_bin_quads(quad_count);
+	}
+
+	tm_scope("Rasterize") {
+		if (wide) parallel_for(tile_count, 1, software_draw_tiles, 0);
+		else      software_draw_tiles(0, tile_count, 0);
+	}
+
+	reset_draw_frame(&draw_frame);
+}
+
+void gfx_update() {
+	if (window.should_close) return;
+
+	if (window.width != (s32)software_framebuffer.width || window.height != (s32)software_framebuffer.height) {
+		software_resize_framebuffer(window.width, window.height);
+	}
+
+	software_process_draw_frame();
+}
+
+///
+// Images
+
+void gfx_init_image(Gfx_Image *image, void *initial_data) {
+	assert(image->channels > 0 && image->channels <= 4 && image->channels != 3, "Only 1, 2 or 4 channels allowed on images. Got %d", image->channels);
+
+	u64 size = (u64)image->width*image->height*image->channels;
+	Software_Texture *t = (Software_Texture*)alloc(get_heap_allocator(), sizeof(Software_Texture) + size);
+	t->width = image->width;
+	t->height = image->height;
+	t->channels = image->channels;
+	t->pixels = (u8*)(t + 1);
+	if (initial_data) memcpy(t->pixels, initial_data, size);
+	else              memset(t->pixels, 0, size);
+
+	image->gfx_handle = t;
+
+	log_verbose("Created a software image of width %d and height %d.", image->width, image->height);
+}
+void gfx_set_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *data) {
+	assert(image && data, "Bad parameters passed to gfx_set_image_data");
+	Software_Texture *t = image->gfx_handle;
+	assert(t, "Invalid image passed to gfx_set_image_data");
+	assert(x+w <= t->width && y+h <= t->height, "Specified subregion in image is out of bounds");
+
+	// #Incomplete bit-width 8 assumed
+	u64 row_size = (u64)w*t->channels;
+	for (u32 row = 0; row < h; row++) {
+		memcpy(t->pixels + ((u64)(y+row)*t->width + x)*t->channels, (u8*)data + row*row_size, row_size);
+	}
+}
+void gfx_deinit_image(Gfx_Image *image) {
+	if (image->gfx_handle) dealloc(get_heap_allocator(), image->gfx_handle);
+	image->gfx_handle = GFX_INVALID_HANDLE;
+}
+
+bool
+shader_recompile_with_extension(string ext_source, u64 cbuffer_size) {
+	log_error("The software renderer can't run shader extensions");
+	return false;
+}
+
+///
+// Png
+// Uncompressed (deflate "stored" blocks), it's for tests and screenshots so size doesn't matter.
+
+u32 software_crc32(u32 crc, u8 *data, u64 count) {
+	local_persist u32 table[256];
+	local_persist bool table_initted = false;
+	if (!table_initted) {
+		for (u32 i = 0; i < 256; i++) {
+			u32 c = i;
+			for (u32 k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+		table_initted = true;
+	}
+	crc = ~crc;
+	for (u64 i = 0; i < count; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+inline u8 *software_png_put_u32(u8 *p, u32 x) {
+	p[0] = (u8)(x >> 24); p[1] = (u8)(x >> 16); p[2] = (u8)(x >> 8); p[3] = (u8)x;
+	return p + 4;
+}
+// Writes length, type, data, crc. data has to already be at p+8.
+u8 *software_png_finish_chunk(u8 *p, const char *type, u64 data_size) {
+	software_png_put_u32(p, (u32)data_size);
+	memcpy(p + 4, type, 4);
+	u32 crc = software_crc32(0, p + 4, data_size + 4);
+	return software_png_put_u32(p + 8 + data_size, crc);
+}
+
+string software_framebuffer_encode_png(Allocator allocator) {
+	u32 width = software_framebuffer.width;
+	u32 height = software_framebuffer.height;
+
+	const u64 max_block = 65535;
+	u64 raw_size = (u64)height*(1 + (u64)width*3); // A filter byte before each row
+	u64 block_count = max((raw_size + max_block-1) / max_block, 1);
+	u64 idat_size = 2 + block_count*5 + raw_size + 4;
+	u64 size = 8 + (12+13) + (12+idat_size) + 12;
+
+	string png = ZERO(string);
+	png.data = (u8*)alloc(allocator, size);
+	png.count = size;
+	u8 *p = png.data;
+
+	const u8 signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+	memcpy(p, signature, 8);
+	p += 8;
+
+	u8 *header = p + 8;
+	software_png_put_u32(header, width);
+	software_png_put_u32(header + 4, height);
+	header[8]  = 8; // Bit depth
+	header[9]  = 2; // RGB
+	header[10] = 0;
+	header[11] = 0;
+	header[12] = 0;
+	p = software_png_finish_chunk(p, "IHDR", 13);
+
+	// zlib stream of stored blocks. Rows are written straight into the blocks, which split
+	// wherever the 65535 byte limit lands.
+	u8 *idat = p + 8;
+	u8 *z = idat;
+	*z++ = 0x78;
+	*z++ = 0x01;
+	u32 adler_a = 1, adler_b = 0;
+	u64 block_left = 0;
+	u64 raw_left = raw_size;
+	for (u32 y = 0; y < height; y++) {
+		u32 *row = software_framebuffer.pixels + (u64)y*software_framebuffer.stride;
+		for (s64 x = -1; x < (s64)width; x++) {
+			u8 bytes[3];
+			u64 byte_count;
+			if (x < 0) {
+				bytes[0] = 0; // No filter
+				byte_count = 1;
+			} else {
+				u32 c = row[x];
+				bytes[0] = (u8)c;
+				bytes[1] = (u8)(c >> 8);
+				bytes[2] = (u8)(c >> 16);
+				byte_count = 3;
+			}
+			for (u64 i = 0; i < byte_count; i++) {
+				if (block_left == 0) {
+					u64 n = min(raw_left, max_block);
+					*z++ = n == raw_left ? 1 : 0; // Final block?
+					*z++ = (u8)n;
+					*z++ = (u8)(n >> 8);
+					*z++ = (u8)~n;
+					*z++ = (u8)(~n >> 8);
+					block_left = n;
+				}
+				*z++ = bytes[i];
+				block_left -= 1;
+				raw_left -= 1;
+				adler_a = (adler_a + bytes[i]) % 65521;
+				adler_b = (adler_b + adler_a) % 65521;
+			}
+		}
+	}
+	if (raw_size == 0) {
+		*z++ = 1; *z++ = 0; *z++ = 0; *z++ = 0xff; *z++ = 0xff;
+	}
+	z = software_png_put_u32(z, (adler_b << 16) | adler_a);
+	assert((u64)(z - idat) == idat_size, "Png size mismatch");
+	p = software_png_finish_chunk(p, "IDAT", idat_size);
+
+	p = software_png_finish_chunk(p, "IEND", 0);
+	assert((u64)(p - png.data) == size, "Png size mismatch");
+
+	return png;
+}
+
+bool software_framebuffer_save_png(string path) {
+	string png = software_framebuffer_encode_png(get_heap_allocator());
+	bool ok = os_write_entire_file(path, png);
+	dealloc_string(get_heap_allocator(), png);
+	return ok;
+}
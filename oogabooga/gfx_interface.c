@@ -7,6 +7,9 @@
 	#include <d3dcommon.h>
 	typedef ID3D11ShaderResourceView * Gfx_Handle;
 	
+#elif GFX_RENDERER == GFX_RENDERER_SOFTWARE
+	typedef struct Software_Texture * Gfx_Handle;
+	
 #elif GFX_RENDERER == GFX_RENDERER_VULKAN
 	#error "We only have a D3D11 renderer at the moment"
 #elif GFX_RENDERER == GFX_RENDERER_METAL
@@ -60,6 +63,24 @@ gfx_update();
 ogb_instance bool
 shader_recompile_with_extension(string ext_source, u64 cbuffer_size);
 
+#if GFX_RENDERER == GFX_RENDERER_SOFTWARE
+// What the software renderer draws to instead of a window. It's resized to window.width and
+// window.height on gfx_update().
+typedef struct Software_Framebuffer {
+	u32 width, height;
+	u32 stride; // In pixels, rows are padded to 4 pixels
+	u32 *pixels; // RGBA8, top row first
+} Software_Framebuffer;
+
+ogb_instance Software_Framebuffer software_framebuffer;
+
+// RGB, alpha is dropped like it is when presenting to a window
+ogb_instance string
+software_framebuffer_encode_png(Allocator allocator);
+ogb_instance bool
+software_framebuffer_save_png(string path);
+#endif
+
 // initial_data can be null to leave image data uninitialized
 Gfx_Image *
 make_image(u32 width, u32 height, u32 channels, void *initial_data, Allocator allocator) {
@@ -0,0 +1,632 @@
+
+///
+///
+// Job system
+///
+// A worker thread per logical processor (minus the thread that initializes the job system,
+// which gets a slot too so it can help out while it waits).
+// Each worker has a Chase-Lev deque: the owner pushes and pops jobs at the bottom without
+// any locking, and idle workers steal from the top of other workers' deques.
+// Threads which aren't workers push to a spinlock protected injection queue instead.
+// Idle workers spin for a little while and then sleep on a semaphore until someone submits.
+//
+// Jobs run on fibers from a pool. When a job calls job_wait_counter() its fiber is parked and
+// the worker goes on with other jobs; once the counter reaches 0 the job continues on
+// whichever thread gets to it first. If all fibers are in use, jobs run on the thread's own
+// stack and job_wait_counter() runs other jobs in place until the counter reaches 0.
+//
+// Each fiber has its own temporary storage which is reset when its job is done, so talloc'd
+// memory stays valid across job_wait_counter() even if the job moved to another thread.
+// #Volatile Don't keep pointers to thread_local's (or push_context()) across job_wait_counter().
+//
+// Usage:
+//
+//    Job_Counter counter = {0};
+//    for (u64 i = 0; i < thing_count; i++) {
+//        job_submit(update_thing, &things[i], &counter);
+//    }
+//    job_wait_counter(&counter); // Runs jobs on this thread too while it waits
+//
+//    // Or, for a loop
+//    parallel_for(thing_count, 64, update_things, things); // update_things(first, last, things)
+
+typedef void(*Job_Proc)(void *data);
+// Called with the index range [first, last)
+typedef void(*Parallel_For_Proc)(u64 first, u64 last, void *userdata);
+
+// Number of submitted jobs which haven't finished yet
+typedef struct Job_Counter {
+	volatile u64 count;
+} Job_Counter;
+
+typedef struct Job {
+	Job_Proc proc;
+	void *data;
+	Job_Counter *counter;
+} Job;
+
+// Must be a power of two. If a deque is full the job just runs right away.
+#define JOB_DEQUE_CAPACITY 4096
+#ifndef JOB_WORKER_TEMPORARY_STORAGE_SIZE
+	#define JOB_WORKER_TEMPORARY_STORAGE_SIZE KB(256)
+#endif
+// 1 pins worker N to one physical core (all of its SMT siblings), round robin over the cores.
+// Worker 0 is the thread which called job_system_init and is left alone.
+#ifndef JOB_WORKERS_PIN_TO_CORES
+	#define JOB_WORKERS_PIN_TO_CORES 0
+#endif
+#ifndef JOB_WORKER_PRIORITY
+	#define JOB_WORKER_PRIORITY THREAD_PRIORITY_CLASS_DEFAULT
+#endif
+// How many times an idle worker looks for work before it goes to sleep
+#define JOB_WORKER_SPIN_COUNT 256
+// Fibers and their stacks are only allocated once they're needed
+#ifndef JOB_FIBER_COUNT
+	#define JOB_FIBER_COUNT 128
+#endif
+#ifndef JOB_FIBER_STACK_SIZE
+	#define JOB_FIBER_STACK_SIZE KB(256)
+#endif
+#ifndef JOB_FIBER_TEMPORARY_STORAGE_SIZE
+	#define JOB_FIBER_TEMPORARY_STORAGE_SIZE KB(64)
+#endif
+
+// top and bottom on their own cache lines so the owner and thieves don't fight over them
+typedef struct Job_Deque {
+	volatile s64 top;
+	u8 _pad0[64-sizeof(s64)];
+	volatile s64 bottom;
+	u8 _pad1[64-sizeof(s64)];
+	Job jobs[JOB_DEQUE_CAPACITY];
+} Job_Deque;
+
+typedef struct Job_Fiber Job_Fiber;
+
+typedef alignat(64) struct Job_Worker {
+	Job_Deque deque;
+	Thread thread;
+	Binary_Semaphore wake;
+	volatile bool sleeping;
+	u64 index;
+	u64 next_steal_index;
+	// The fiber of the last finished job, kept here so most jobs don't touch the shared pool
+	Job_Fiber *spare_fiber;
+	u8 name[32]; // thread.name points here
+} Job_Worker;
+
+typedef struct Job_Fiber {
+	Fiber fiber;
+	Fiber home; // Where the thread which is running us continues when we stop
+	Job job;
+	bool job_done;
+	Job_Counter *waiting_on; // While parked in job_wait_counter()
+	Temporary_Storage_State temporary_storage;
+	u8 *stack; // Lowest usable byte, the guard page is right below
+	Job_Fiber *next; // In the free list or the waiting list
+} Job_Fiber;
+
+typedef struct Job_Injection_Queue {
+	Spinlock lock;
+	u64 first;
+	u64 count;
+	Job jobs[JOB_DEQUE_CAPACITY];
+} Job_Injection_Queue;
+
+// 0 means one per logical processor
+void ogb_instance
+job_system_init(u64 worker_count);
+
+// Waits for the worker threads to finish their current job and exit.
+// Jobs still in the queues are not run.
+void ogb_instance
+job_system_shutdown();
+
+// If counter is not 0 it's incremented now and decremented when the job is done.
+void ogb_instance
+job_submit(Job_Proc proc, void *data, Job_Counter *counter);
+
+// Runs other jobs on the calling thread until counter reaches 0
+void ogb_instance
+job_wait_counter(Job_Counter *counter);
+
+// Calls proc for batches of (at most) batch indices in parallel and returns when all are done.
+// batch 0 picks a batch size which gives each worker a few batches.
+void ogb_instance
+parallel_for(u64 count, u64 batch, Parallel_For_Proc proc, void *userdata);
+
+// Including the slot for the thread which initialized the job system
+u64 ogb_instance
+job_get_worker_count();
+
+ogb_instance Job_Worker *job_workers;
+ogb_instance u64 job_worker_count;
+ogb_instance bool job_system_initted;
+ogb_instance volatile bool job_system_shutting_down;
+ogb_instance Job_Injection_Queue *job_injection_queue;
+ogb_instance Job_Fiber *job_fibers;
+ogb_instance Spinlock job_fiber_lock;
+ogb_instance Job_Fiber *job_free_fibers;
+ogb_instance Job_Fiber *job_waiting_fibers;
+ogb_instance volatile u64 job_waiting_fiber_count;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Job_Worker *job_workers = 0;
+u64 job_worker_count = 0;
+bool job_system_initted = false;
+volatile bool job_system_shutting_down = false;
+Job_Injection_Queue *job_injection_queue = 0;
+Job_Fiber *job_fibers = 0;
+Spinlock job_fiber_lock;
+Job_Fiber *job_free_fibers = 0;
+Job_Fiber *job_waiting_fibers = 0;
+volatile u64 job_waiting_fiber_count = 0;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+// -1 if this thread is not a worker
+thread_local s64 job_worker_index = -1;
+// The fiber the calling thread is running a job on, 0 if it's on its own stack
+thread_local Job_Fiber *job_current_fiber = 0;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void job_wake_one_worker();
+
+// Release so whoever sees the counter reach 0 also sees what the jobs wrote
+inline void job_counter_add(Job_Counter *counter, s64 n) {
+	u64 old = atomic_fetch_add_64(&counter->count, (u64)n, MEMORY_ORDER_RELEASE);
+	// A parked fiber might be waiting for this one, and the workers might all be asleep
+	if (old + n == 0 && atomic_load_64(&job_waiting_fiber_count, MEMORY_ORDER_RELAXED) > 0) {
+		job_wake_one_worker();
+	}
+}
+
+///
+// Chase-Lev deque
+// Loads and stores are plain on x64, ordering only matters between the bottom store and the
+// top load in pop which needs a full fence (and the compare_and_swap's are full fences too).
+
+bool job_deque_push(Job_Deque *d, Job job) {
+	s64 b = d->bottom;
+	s64 t = d->top;
+	if (b - t >= JOB_DEQUE_CAPACITY) return false;
+	d->jobs[b & (JOB_DEQUE_CAPACITY-1)] = job;
+	MEMORY_BARRIER;
+	d->bottom = b + 1;
+	return true;
+}
+// Only the owner pops
+bool job_deque_pop(Job_Deque *d, Job *job) {
+	s64 b = d->bottom - 1;
+	d->bottom = b;
+	_mm_mfence();
+	s64 t = d->top;
+
+	if (t > b) {
+		// Empty
+		d->bottom = b + 1;
+		return false;
+	}
+
+	*job = d->jobs[b & (JOB_DEQUE_CAPACITY-1)];
+	if (t == b) {
+		// Last one, race the thieves for it
+		bool won = compare_and_swap_64((volatile uint64_t*)&d->top, (u64)(t + 1), (u64)t);
+		d->bottom = b + 1;
+		return won;
+	}
+	return true;
+}
+// Anyone can steal. Returns false if it's empty or another thread got there first.
+bool job_deque_steal(Job_Deque *d, Job *job) {
+	s64 t = d->top;
+	MEMORY_BARRIER;
+	s64 b = d->bottom;
+	if (t >= b) return false;
+
+	*job = d->jobs[t & (JOB_DEQUE_CAPACITY-1)];
+	return compare_and_swap_64((volatile uint64_t*)&d->top, (u64)(t + 1), (u64)t);
+}
+
+bool job_injection_push(Job job) {
+	Job_Injection_Queue *q = job_injection_queue;
+	spinlock_acquire_or_wait(&q->lock);
+	bool ok = q->count < JOB_DEQUE_CAPACITY;
+	if (ok) {
+		q->jobs[(q->first + q->count) & (JOB_DEQUE_CAPACITY-1)] = job;
+		q->count += 1;
+	}
+	spinlock_release(&q->lock);
+	return ok;
+}
+bool job_injection_pop(Job *job) {
+	Job_Injection_Queue *q = job_injection_queue;
+	if (q->count == 0) return false; // Racy peek so we don't take the lock for nothing
+	spinlock_acquire_or_wait(&q->lock);
+	bool ok = q->count > 0;
+	if (ok) {
+		*job = q->jobs[q->first];
+		q->first = (q->first + 1) & (JOB_DEQUE_CAPACITY-1);
+		q->count -= 1;
+	}
+	spinlock_release(&q->lock);
+	return ok;
+}
+
+///
+// Scheduling
+
+void job_run(Job *job) {
+	job->proc(job->data);
+	if (job->counter) job_counter_add(job->counter, -1);
+}
+
+bool job_find(Job *job) {
+	Job_Worker *self = job_worker_index >= 0 ? &job_workers[job_worker_index] : 0;
+
+	if (self && job_deque_pop(&self->deque, job)) return true;
+	if (job_injection_pop(job)) return true;
+
+	u64 start = self ? self->next_steal_index++ : (u64)rdtsc();
+	for (u64 i = 0; i < job_worker_count; i++) {
+		Job_Worker *victim = &job_workers[(start + i) % job_worker_count];
+		if (victim == self) continue;
+		if (job_deque_steal(&victim->deque, job)) return true;
+	}
+	return false;
+}
+
+///
+// Fibers
+
+void job_fiber_main(void *data) {
+	Job_Fiber *f = (Job_Fiber*)data;
+	while (true) {
+		job_run(&f->job);
+		f->job_done = true;
+		fiber_switch(&f->fiber, &f->home);
+	}
+}
+
+// 0 if they're all in use
+Job_Fiber *job_fiber_get_free() {
+	Job_Fiber *f = 0;
+	Job_Worker *self = job_worker_index >= 0 ? &job_workers[job_worker_index] : 0;
+	if (self && self->spare_fiber) {
+		f = self->spare_fiber;
+		self->spare_fiber = 0;
+	} else if (job_free_fibers) { // Racy peek so we don't take the lock for nothing
+		spinlock_acquire_or_wait(&job_fiber_lock);
+		f = job_free_fibers;
+		if (f) job_free_fibers = f->next;
+		spinlock_release(&job_fiber_lock);
+	}
+	
+	if (f && !f->stack) {
+		// Stacks grow down, so an overflow hits the uncommitted page below and faults instead of
+		// quietly writing over whatever is next to it.
+		u64 stack_size = align_next(JOB_FIBER_STACK_SIZE, os.page_size);
+		u8 *reserved = (u8*)os_reserve_memory(stack_size + os.page_size);
+		f->stack = reserved + os.page_size;
+		os_commit_memory_pages(f->stack, stack_size);
+		fiber_init(&f->fiber, f->stack, stack_size, job_fiber_main, f);
+		temporary_storage_state_init(&f->temporary_storage, JOB_FIBER_TEMPORARY_STORAGE_SIZE);
+	}
+	return f;
+}
+
+// A parked fiber whose counter reached 0, or 0
+Job_Fiber *job_fiber_take_ready() {
+	if (atomic_load_64(&job_waiting_fiber_count, MEMORY_ORDER_RELAXED) == 0) return 0;
+	spinlock_acquire_or_wait(&job_fiber_lock);
+	Job_Fiber *ready = 0;
+	for (Job_Fiber **link = &job_waiting_fibers; *link; link = &(*link)->next) {
+		if (atomic_load_64(&(*link)->waiting_on->count, MEMORY_ORDER_ACQUIRE) == 0) {
+			ready = *link;
+			*link = ready->next;
+			atomic_fetch_sub_64(&job_waiting_fiber_count, 1, MEMORY_ORDER_RELAXED);
+			break;
+		}
+	}
+	spinlock_release(&job_fiber_lock);
+	if (ready) ready->waiting_on = 0;
+	return ready;
+}
+
+// Runs the fiber on this thread until its job is done or it parks.
+// Only called on a thread's own stack, so this never moves to another thread.
+void job_fiber_continue(Job_Fiber *f) {
+	assert(!job_current_fiber, "Internal job system error: continuing a fiber from a fiber");
+	
+	job_current_fiber = f;
+	temporary_storage_swap(&f->temporary_storage);
+	fiber_switch(&f->home, &f->fiber);
+	if (f->job_done && temporary_storage_current->used) reset_temporary_storage();
+	temporary_storage_swap(&f->temporary_storage);
+	job_current_fiber = 0;
+	
+	// The fiber has stopped on its stack now, so other threads can have it
+	Job_Worker *self = job_worker_index >= 0 ? &job_workers[job_worker_index] : 0;
+	if (f->job_done && self && !self->spare_fiber) {
+		self->spare_fiber = f;
+		return;
+	}
+	spinlock_acquire_or_wait(&job_fiber_lock);
+	if (f->job_done) {
+		f->next = job_free_fibers;
+		job_free_fibers = f;
+	} else {
+		f->next = job_waiting_fibers;
+		job_waiting_fibers = f;
+		atomic_fetch_add_64(&job_waiting_fiber_count, 1, MEMORY_ORDER_RELAXED);
+	}
+	spinlock_release(&job_fiber_lock);
+}
+
+// #Volatile This may come back on another thread, so the caller must not touch anything
+// thread_local which it looked up before calling this.
+NO_INLINE void job_fiber_park(Job_Fiber *f, Job_Counter *counter) {
+	f->waiting_on = counter;
+	fiber_switch(&f->fiber, &f->home);
+}
+
+// Runs a job on a fiber if there's one free, otherwise right here (also if we're already
+// on a fiber, which happens when job_submit() runs a job right away because the queue is full)
+void job_start(Job *job) {
+	Job_Fiber *f = job_current_fiber ? 0 : job_fiber_get_free();
+	if (!f) {
+		job_run(job);
+		return;
+	}
+	f->job = *job;
+	f->job_done = false;
+	job_fiber_continue(f);
+}
+
+// Something to do: continue a parked fiber if one is ready, otherwise find a job
+bool job_find_work(Job *job, Job_Fiber **ready) {
+	*ready = job_fiber_take_ready();
+	return *ready || job_find(job);
+}
+void job_do_work(Job *job, Job_Fiber *ready) {
+	if (ready) job_fiber_continue(ready);
+	else       job_start(job);
+}
+
+void job_wake_one_worker() {
+	// Make sure the pushed job is visible before we look at who's sleeping, the sleeping
+	// worker does the opposite so one of us will see the other.
+	_mm_mfence();
+	for (u64 i = 1; i < job_worker_count; i++) {
+		Job_Worker *w = &job_workers[i];
+		if (w->sleeping && compare_and_swap_bool(&w->sleeping, false, true)) {
+			binary_semaphore_signal(&w->wake);
+			return;
+		}
+	}
+}
+
+void job_worker_proc(Thread *t) {
+	Job_Worker *w = (Job_Worker*)t->data;
+	job_worker_index = (s64)w->index;
+
+	while (!job_system_shutting_down) {
+		Job job;
+		Job_Fiber *ready = 0;
+		bool found = false;
+		for (u64 i = 0; i < JOB_WORKER_SPIN_COUNT && !found && !job_system_shutting_down; i++) {
+			found = job_find_work(&job, &ready);
+			if (!found) _mm_pause();
+		}
+
+		if (!found && !job_system_shutting_down) {
+			bool ok = compare_and_swap_bool(&w->sleeping, true, false);
+			assert(ok, "Internal job system error");
+
+			// Something may have been submitted before we said we're sleeping
+			found = job_find_work(&job, &ready);
+			if (!found || !compare_and_swap_bool(&w->sleeping, false, true)) {
+				// Either nothing to do, or someone already woke us up and we need to eat the signal
+				binary_semaphore_wait(&w->wake);
+			}
+		}
+
+		if (found) {
+			job_do_work(&job, ready);
+			reset_temporary_storage();
+		}
+	}
+}
+
+void job_system_init(u64 worker_count) {
+	assert(!job_system_initted, "Job system is already initialized");
+
+	if (worker_count == 0) worker_count = os_get_number_of_logical_processors();
+	worker_count = max(worker_count, 1);
+
+	job_system_shutting_down = false;
+	job_worker_count = worker_count;
+	job_workers = (Job_Worker*)alloc_aligned(get_heap_allocator(), worker_count*sizeof(Job_Worker), 64);
+	memset(job_workers, 0, worker_count*sizeof(Job_Worker));
+	job_injection_queue = (Job_Injection_Queue*)alloc(get_heap_allocator(), sizeof(Job_Injection_Queue));
+	memset(job_injection_queue, 0, sizeof(Job_Injection_Queue));
+	spinlock_init(&job_injection_queue->lock);
+	
+	job_fibers = (Job_Fiber*)alloc(get_heap_allocator(), JOB_FIBER_COUNT*sizeof(Job_Fiber));
+	memset(job_fibers, 0, JOB_FIBER_COUNT*sizeof(Job_Fiber));
+	spinlock_init(&job_fiber_lock);
+	job_free_fibers = 0;
+	job_waiting_fibers = 0;
+	job_waiting_fiber_count = 0;
+	for (s64 i = JOB_FIBER_COUNT-1; i >= 0; i--) {
+		job_fibers[i].next = job_free_fibers;
+		job_free_fibers = &job_fibers[i];
+	}
+
+	// Slot 0 is the calling thread
+	job_worker_index = 0;
+
+	for (u64 i = 0; i < worker_count; i++) {
+		Job_Worker *w = &job_workers[i];
+		w->index = i;
+		w->next_steal_index = i + 1;
+		binary_semaphore_init(&w->wake, false);
+	}
+
+	job_system_initted = true;
+	MEMORY_BARRIER;
+
+#if JOB_WORKERS_PIN_TO_CORES
+	Cpu_Topology topology;
+	os_get_cpu_topology(&topology);
+#endif
+
+	for (u64 i = 1; i < worker_count; i++) {
+		Job_Worker *w = &job_workers[i];
+		os_thread_init(&w->thread, job_worker_proc);
+		w->thread.data = w;
+		w->thread.temporary_storage_size = JOB_WORKER_TEMPORARY_STORAGE_SIZE;
+		w->thread.name.data = w->name;
+		w->thread.name.count = format_string_to_buffer_va((char*)w->name, sizeof(w->name), "Job worker %llu", i);
+		w->thread.priority = JOB_WORKER_PRIORITY;
+#if JOB_WORKERS_PIN_TO_CORES
+		w->thread.affinity_mask = topology.core_masks[i % topology.physical_core_count];
+#endif
+		os_thread_start(&w->thread);
+	}
+}
+
+void job_system_shutdown() {
+	assert(job_system_initted, "Job system is not initialized");
+
+	job_system_shutting_down = true;
+	_mm_mfence();
+	for (u64 i = 1; i < job_worker_count; i++) {
+		Job_Worker *w = &job_workers[i];
+		if (compare_and_swap_bool(&w->sleeping, false, true)) {
+			binary_semaphore_signal(&w->wake);
+		}
+	}
+	for (u64 i = 1; i < job_worker_count; i++) {
+		os_thread_join(&job_workers[i].thread);
+		os_thread_destroy(&job_workers[i].thread);
+	}
+	for (u64 i = 0; i < job_worker_count; i++) {
+		binary_semaphore_destroy(&job_workers[i].wake);
+	}
+
+	// Parked jobs are dropped along with their fibers
+	for (u64 i = 0; i < JOB_FIBER_COUNT; i++) {
+		Job_Fiber *f = &job_fibers[i];
+		if (!f->stack) continue;
+		u64 stack_size = align_next(JOB_FIBER_STACK_SIZE, os.page_size);
+		os_release_memory(f->stack - os.page_size, stack_size + os.page_size);
+		temporary_storage_state_destroy(&f->temporary_storage);
+	}
+
+	dealloc(get_heap_allocator(), job_workers);
+	dealloc(get_heap_allocator(), job_injection_queue);
+	dealloc(get_heap_allocator(), job_fibers);
+	job_workers = 0;
+	job_injection_queue = 0;
+	job_fibers = 0;
+	job_free_fibers = 0;
+	job_waiting_fibers = 0;
+	job_waiting_fiber_count = 0;
+	job_worker_count = 0;
+	job_worker_index = -1;
+	job_system_initted = false;
+}
+
+u64 job_get_worker_count() {
+	if (!job_system_initted) job_system_init(0);
+	return job_worker_count;
+}
+
+void job_submit(Job_Proc proc, void *data, Job_Counter *counter) {
+	if (!job_system_initted) job_system_init(0);
+
+	Job job = { proc, data, counter };
+	if (counter) job_counter_add(counter, 1);
+
+	bool pushed;
+	if (job_worker_index >= 0) pushed = job_deque_push(&job_workers[job_worker_index].deque, job);
+	else                       pushed = job_injection_push(job);
+
+	if (!pushed) {
+		// Queue is full, just do it now
+		job_start(&job);
+		return;
+	}
+
+	job_wake_one_worker();
+}
+
+void job_wait_counter(Job_Counter *counter) {
+	if (atomic_load_64(&counter->count, MEMORY_ORDER_ACQUIRE) == 0) return;
+	
+	Job_Fiber *fiber = job_current_fiber;
+	if (fiber) {
+		// Let this thread do other things until the counter reaches 0
+		job_fiber_park(fiber, counter);
+		return;
+	}
+	
+	u64 spins = 0;
+	while (atomic_load_64(&counter->count, MEMORY_ORDER_ACQUIRE) != 0) {
+		Job job;
+		Job_Fiber *ready;
+		if (job_system_initted && job_find_work(&job, &ready)) {
+			job_do_work(&job, ready);
+			spins = 0;
+		} else if (spins++ < JOB_WORKER_SPIN_COUNT) {
+			_mm_pause();
+		} else {
+			// The last jobs are running on other threads
+			os_yield_thread();
+		}
+	}
+	MEMORY_BARRIER;
+}
+
+typedef struct Parallel_For_Data {
+	Parallel_For_Proc proc;
+	void *userdata;
+	u64 count;
+	u64 batch;
+	volatile u64 next;
+} Parallel_For_Data;
+
+// Each job keeps claiming batches until there are none left, so it balances itself if
+// some batches are slower than others.
+void parallel_for_job(void *data) {
+	Parallel_For_Data *p = (Parallel_For_Data*)data;
+	while (true) {
+		// Overshooting count is fine, everyone stops once next is past it
+		u64 first = atomic_fetch_add_64(&p->next, p->batch, MEMORY_ORDER_RELAXED);
+		if (first >= p->count) break;
+		p->proc(first, min(first + p->batch, p->count), p->userdata);
+	}
+}
+
+void parallel_for(u64 count, u64 batch, Parallel_For_Proc proc, void *userdata) {
+	if (count == 0) return;
+	u64 worker_count = job_get_worker_count();
+	if (batch == 0) batch = max(count / (worker_count*4), 1);
+
+	u64 batch_count = (count + batch - 1) / batch;
+	if (batch_count == 1) {
+		proc(0, count, userdata);
+		return;
+	}
+
+	Parallel_For_Data data = { proc, userdata, count, batch, 0 };
+	Job_Counter counter = {0};
+	u64 helper_count = min(batch_count, worker_count) - 1;
+	for (u64 i = 0; i < helper_count; i++) {
+		job_submit(parallel_for_job, &data, &counter);
+	}
+	parallel_for_job(&data);
+	job_wait_counter(&counter);
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
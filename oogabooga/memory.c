@@ -31,6 +31,10 @@ void* initialization_allocator_proc(u64 size, void *p, Allocator_Message message
 		case ALLOCATOR_REALLOCATE: {
 			return 0;
 		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			init_memory_head = (u8*)align_next(init_memory_head, (u64)p);
+			return initialization_allocator_proc(size, 0, ALLOCATOR_ALLOCATE, data);
+		}
 	}
 	return 0;
 }
@@ -43,18 +47,56 @@ Allocator get_initialization_allocator() {
 
 ///
 ///
-// Basic general heap allocator, free list
+// Basic general heap allocator
 ///
-// Technically thread safe but synchronization is horrible.
-// Fragmentation is catastrophic.
-// We could fix it by merging free nodes every now and then
-// BUT: We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
+// Small allocations (<= HEAP_MAX_SMALL_SIZE including metadata) are rounded up to a size
+// class. Each size class has its own free list of equally sized slots which are carved out
+// of HEAP_SMALL_CHUNK_SIZE chunks, and a bitmap of non-empty classes lets us find a slot
+// without searching anything.
+// Everything bigger (including the small chunks) goes through the free list of each
+// Heap_Block which is kept in address order so neighbouring free nodes coalesce.
+// Each thread keeps magazines of recently freed small slots so most small allocations
+// never touch heap_lock. A slot remembers which thread cache handed it out, and if another
+// thread frees it, it's pushed to that cache's lock-free remote free list.
+// Allocations bigger than HEAP_LARGE_ALLOCATION_THRESHOLD get their own pages. When they are
+// freed, all but the first page (which holds the free node) is decommitted immediately, and
+// the address space is reused by later large allocations.
+// Pages fully inside free nodes stay committed until heap_trim() is called, or right away when
+// a free node grows to HEAP_DECOMMIT_THRESHOLD if that's set. Each heap block has a bitmap of
+// which pages are decommitted so they are committed again before the memory is handed out.
+// Live bytes are counted per thread cache (so it's just a few adds, no atomics) and summed up
+// in get_heap_stats(), which is cheap enough to leave on in release. Allocations are also
+// counted per Context.allocation_tag, see heap_make_tag().
+// With GUARD_PAGE_ALLOCATIONS none of the above is used, every allocation gets its own pages
+// followed by a decommitted guard page, see heap_alloc_guarded(). Freed ranges are decommitted
+// and wait in a FIFO quarantine before their address space is reused.
+// Free list and large allocations are still synchronized with heap_lock, which is horrible.
+// We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
 
 #define MAX_HEAP_BLOCK_SIZE align_next(MB(500), os.page_size)
+#define HEAP_LARGE_ALLOCATION_THRESHOLD MB(1)
 #define DEFAULT_HEAP_BLOCK_SIZE (min(MAX_HEAP_BLOCK_SIZE, program_memory_capacity))
 #define HEAP_ALIGNMENT (sizeof(Heap_Free_Node))
+#define HEAP_SIZE_CLASS_COUNT 32
+#define HEAP_MAX_SMALL_SIZE KB(8)
+#define HEAP_SMALL_CHUNK_SIZE KB(64)
+// When a size class is empty we can take a slot from a bigger class instead of carving a new
+// one, but at most this many classes up (which is one power of two).
+#define HEAP_SIZE_CLASS_MAX_STEP_UP 4
+// Magazine capacity in bytes per size class, clamped to a reasonable slot count
+#define HEAP_MAGAZINE_SIZE KB(32)
+#define HEAP_MAGAZINE_MIN_SLOTS 4
+#define HEAP_MAGAZINE_MAX_SLOTS 128
+// Tag 0 is for allocations made without a tag
+#define HEAP_MAX_TAGS 64
+// Free nodes this big get their pages decommitted as soon as they are freed.
+// 0 means it only happens in heap_trim().
+#ifndef HEAP_DECOMMIT_THRESHOLD
+	#define HEAP_DECOMMIT_THRESHOLD 0
+#endif
 typedef struct Heap_Free_Node Heap_Free_Node;
 typedef struct Heap_Block Heap_Block;
+typedef struct Heap_Thread_Cache Heap_Thread_Cache;
 
 typedef struct Heap_Free_Node {
 	u64 size;
@@ -66,7 +108,11 @@ typedef struct Heap_Block {
 	Heap_Free_Node *free_head;
 	void* start;
 	Heap_Block *next;
-	// 32 bytes !!
+	// Bit per page, set if the page is decommitted. Only pages fully inside free nodes
+	// (except for the page with the node header) can be decommitted.
+	u64 *decommitted_pages;
+	u64 decommitted_page_count;
+	// 48 bytes !!
 #if CONFIGURATION == DEBUG
 	u64 total_allocated;
 	u64 padding;
@@ -74,27 +120,205 @@ typedef struct Heap_Block {
 } Heap_Block;
 
 #define HEAP_META_SIGNATURE 6969694206942069ull
+// Heap blocks are page aligned and thread caches are 16 byte aligned so the low bits of
+// Heap_Allocation_Metadata.block are free to tell what kind of allocation it is.
+// The top bits aren't used by pointers, so that's where the allocation tag goes.
+#define HEAP_META_SMALL_BIT 1ULL
+#define HEAP_META_LARGE_BIT 2ULL
+// Aligned allocations: size is the offset back to the real allocation, and the alignment is in
+// owner_bits. See heap_alloc_aligned().
+#define HEAP_META_OFFSET_BIT 4ULL
+// GUARD_PAGE_ALLOCATIONS: size is the size of the pages, and the pointer is the guard page.
+#define HEAP_META_GUARD_BIT 8ULL
+#define HEAP_META_TAG_SHIFT 56ULL
+#define HEAP_META_POINTER_MASK (((1ULL << HEAP_META_TAG_SHIFT)-1) & ~(HEAP_META_SMALL_BIT | HEAP_META_LARGE_BIT))
 typedef alignat(16) struct Heap_Allocation_Metadata {
 	u64 size;
-	Heap_Block *block;
+	union {
+		// Free list allocations (use heap_meta_block() once the tag is set)
+		Heap_Block *block;
+		// Size class allocations: the thread cache this was handed out from (if any) | HEAP_META_SMALL_BIT
+		// Large allocations: HEAP_META_LARGE_BIT
+		// All: tag << HEAP_META_TAG_SHIFT
+		u64 owner_bits;
+	};
 #if CONFIGURATION == DEBUG
 	u64 signature;
 	u64 padding;
 #endif
 } Heap_Allocation_Metadata;
 
+typedef struct Heap_Size_Class {
+	Heap_Free_Node *free_head;
+	// What's left of the latest chunk carved for this class
+	u8 *bump;
+	u8 *bump_end;
+} Heap_Size_Class;
+
+typedef struct Heap_Thread_Cache {
+	// Only touched by the thread owning the cache
+	Heap_Free_Node *magazines[HEAP_SIZE_CLASS_COUNT];
+	u32 magazine_counts[HEAP_SIZE_CLASS_COUNT];
+	
+	// Slots owned by this cache but freed on other threads. Any thread pushes with CAS,
+	// the owner takes the whole list at once so there's no ABA problem.
+	Heap_Free_Node *volatile remote_free_head;
+	
+	// Caches of dead threads are reused by new threads
+	Heap_Thread_Cache *next_unused;
+	Heap_Thread_Cache *next_in_all;
+	
+	// What this thread allocated minus what it freed. These go negative when allocations are
+	// freed on another thread than they were allocated on, so only the sum means anything.
+	s64 live_bytes;
+	s64 live_count;
+	s64 tagged_live_bytes[HEAP_MAX_TAGS];
+} Heap_Thread_Cache;
+
+typedef struct Heap_Stats {
+	// In live allocations, including metadata and rounding up to size classes and pages
+	u64 live_bytes;
+	u64 live_allocation_count;
+	// Heap blocks, live large allocations and the first page of freed large regions
+	u64 committed_bytes;
+	// Free pages in heap blocks which have been given back to the OS
+	u64 decommitted_bytes;
+	// Free nodes in heap blocks. Free slots of size classes are not counted here since they
+	// are carved from chunks allocated on the free lists.
+	u64 free_node_count;
+	u64 free_bytes;
+	u64 largest_free_block;
+	// 1 - largest_free_block/free_bytes. 0 means all free memory is in one piece.
+	float32 fragmentation;
+	
+	// Indexed by tag, see heap_make_tag()
+	u64 tagged_live_bytes[HEAP_MAX_TAGS];
+	u64 tag_count;
+} Heap_Stats;
+
+#define HEAP_GUARD_QUARANTINE_COUNT 1024
+#define HEAP_GUARD_FREE_RANGE_MAX 1024
+typedef struct Heap_Guard_Range {
+	u8 *start;
+	u64 size; // Including the guard page
+} Heap_Guard_Range;
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+ogb_instance Heap_Size_Class heap_size_classes[HEAP_SIZE_CLASS_COUNT];
+// Bit n is set if heap_size_classes[n] has free slots
+ogb_instance u64 heap_size_class_bitmap;
+ogb_instance Heap_Thread_Cache *heap_unused_thread_caches;
+// Address space of freed large allocations, in address order.
+// Only the first page of each (holding the node) is committed.
+ogb_instance Heap_Free_Node *heap_large_free_head;
+// Committed pages of large allocations, live or freed. Atomic so it doesn't need heap_lock.
+ogb_instance u64 heap_large_committed_bytes;
+// GUARD_PAGE_ALLOCATIONS. Freed ranges (pages + guard page, all decommitted) wait in the
+// quarantine so a dangling pointer keeps faulting for the next HEAP_GUARD_QUARANTINE_COUNT
+// frees. After that they go to the free ranges to be reused. Both are under heap_lock.
+ogb_instance Heap_Guard_Range heap_guard_quarantine[HEAP_GUARD_QUARANTINE_COUNT];
+ogb_instance u64 heap_guard_quarantine_first;
+ogb_instance u64 heap_guard_quarantine_count;
+ogb_instance Heap_Guard_Range heap_guard_free_ranges[HEAP_GUARD_FREE_RANGE_MAX];
+ogb_instance u64 heap_guard_free_range_count;
+ogb_instance Heap_Thread_Cache *heap_all_thread_caches;
+ogb_instance string heap_tag_names[HEAP_MAX_TAGS];
+ogb_instance u64 heap_tag_count;
+
+ogb_instance u64
+heap_make_tag(string name);
+
+ogb_instance string
+heap_get_tag_name(u64 tag);
+
+ogb_instance Heap_Stats
+get_heap_stats();
+
+ogb_instance void
+log_heap_stats();
+
+ogb_instance u64
+heap_trim();
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+Heap_Size_Class heap_size_classes[HEAP_SIZE_CLASS_COUNT];
+u64 heap_size_class_bitmap = 0;
+Heap_Thread_Cache *heap_unused_thread_caches = 0;
+Heap_Free_Node *heap_large_free_head = 0;
+u64 heap_large_committed_bytes = 0;
+Heap_Guard_Range heap_guard_quarantine[HEAP_GUARD_QUARANTINE_COUNT];
+u64 heap_guard_quarantine_first = 0;
+u64 heap_guard_quarantine_count = 0;
+Heap_Guard_Range heap_guard_free_ranges[HEAP_GUARD_FREE_RANGE_MAX];
+u64 heap_guard_free_range_count = 0;
+Heap_Thread_Cache *heap_all_thread_caches = 0;
+string heap_tag_names[HEAP_MAX_TAGS] = { { sizeof("untagged")-1, (u8*)"untagged" } };
+u64 heap_tag_count = 1;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+thread_local Heap_Thread_Cache *heap_thread_cache = 0;
+
+inline bool heap_meta_is_small(Heap_Allocation_Metadata *meta) {
+	return (meta->owner_bits & HEAP_META_SMALL_BIT) != 0;
+}
+inline bool heap_meta_is_large(Heap_Allocation_Metadata *meta) {
+	return (meta->owner_bits & HEAP_META_LARGE_BIT) != 0;
+}
+inline bool heap_meta_is_offset(Heap_Allocation_Metadata *meta) {
+	return (meta->owner_bits & HEAP_META_OFFSET_BIT) != 0;
+}
+inline bool heap_meta_is_guarded(Heap_Allocation_Metadata *meta) {
+	return (meta->owner_bits & HEAP_META_GUARD_BIT) != 0;
+}
+inline u8 *heap_meta_guard_page(Heap_Allocation_Metadata *meta) {
+	return (u8*)(meta->owner_bits & HEAP_META_POINTER_MASK & ~HEAP_META_GUARD_BIT);
+}
+// End of the memory that can be used after the metadata
+inline u8 *heap_meta_usable_end(Heap_Allocation_Metadata *meta) {
+	if (heap_meta_is_guarded(meta)) return heap_meta_guard_page(meta);
+	return (u8*)meta + meta->size;
+}
+inline u64 heap_meta_alignment(Heap_Allocation_Metadata *offset_meta) {
+	return offset_meta->owner_bits & ~HEAP_META_OFFSET_BIT;
+}
+inline Heap_Thread_Cache *heap_meta_owner(Heap_Allocation_Metadata *meta) {
+	return (Heap_Thread_Cache*)(meta->owner_bits & HEAP_META_POINTER_MASK);
+}
+inline void heap_meta_set_owner(Heap_Allocation_Metadata *meta, Heap_Thread_Cache *owner) {
+	meta->owner_bits = (u64)owner | HEAP_META_SMALL_BIT;
+}
+inline Heap_Block *heap_meta_block(Heap_Allocation_Metadata *meta) {
+	return (Heap_Block*)(meta->owner_bits & HEAP_META_POINTER_MASK);
+}
+inline u64 heap_meta_tag(Heap_Allocation_Metadata *meta) {
+	return meta->owner_bits >> HEAP_META_TAG_SHIFT;
+}
+inline void heap_meta_set_tag(Heap_Allocation_Metadata *meta, u64 tag) {
+	meta->owner_bits = (meta->owner_bits & ((1ULL << HEAP_META_TAG_SHIFT)-1)) | (tag << HEAP_META_TAG_SHIFT);
+}
 	
 
+// 16, 32, 48, 64, then 4 classes per power of two up to HEAP_MAX_SMALL_SIZE:
+// 80, 96, 112, 128, 160, 192, 224, 256, 320, ...
+inline u64 heap_size_to_class(u64 size) {
+	assert(size > 0 && size <= HEAP_MAX_SMALL_SIZE, "Internal heap error");
+	if (size <= 64) return (size-1)/16;
+	u64 msb = bit_scan_reverse_64(size-1);
+	return (msb-6)*4 + ((size-1) >> (msb-2));
+}
+inline u64 heap_class_to_size(u64 size_class) {
+	if (size_class < 4) return (size_class+1)*16;
+	u64 power = (size_class-4)/4 + 6;
+	u64 step  = (size_class-4)%4 + 1;
+	return (1ULL << power) + step*(1ULL << (power-2));
+}
+
 u64 get_heap_block_size_excluding_metadata(Heap_Block *block) {
 	return block->size - sizeof(Heap_Block);
 }
@@ -157,9 +381,35 @@ inline void check_meta(Heap_Allocation_Metadata *meta) {
 #endif
 // If > 256GB then prolly not legit lol
 	assert(meta->size < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");	
-	assert(is_pointer_in_program_memory(meta->block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
+	
+	if (heap_meta_is_offset(meta)) {
+		u64 alignment = heap_meta_alignment(meta);
+		assert(alignment > HEAP_ALIGNMENT && (alignment & (alignment-1)) == 0 && meta->size >= sizeof(Heap_Allocation_Metadata) && meta->size < alignment+sizeof(Heap_Allocation_Metadata), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		return;
+	}
+	
+	assert(heap_meta_tag(meta) < HEAP_MAX_TAGS, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+	
+	if (heap_meta_is_small(meta)) {
+		assert(meta->size <= HEAP_MAX_SMALL_SIZE && heap_class_to_size(heap_size_to_class(meta->size)) == meta->size, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		Heap_Thread_Cache *owner = heap_meta_owner(meta);
+		if (owner) { assert(is_pointer_in_program_memory(owner), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); }
+		return;
+	}
+	if (heap_meta_is_large(meta)) {
+		assert(meta->size > HEAP_LARGE_ALLOCATION_THRESHOLD && meta->size % os.page_size == 0 && (u64)meta % os.page_size == 0, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		return;
+	}
+	if (heap_meta_is_guarded(meta)) {
+		u8 *guard_page = heap_meta_guard_page(meta);
+		assert(meta->size % os.page_size == 0 && (u64)guard_page % os.page_size == 0 && (u8*)meta >= guard_page - meta->size && (u8*)meta < guard_page, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		return;
+	}
+	
+	Heap_Block *block = heap_meta_block(meta);
+	assert(is_pointer_in_program_memory(block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
 
-	assert((u64)meta >= (u64)meta->block->start && (u64)meta < (u64)meta->block->start+meta->block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
+	assert((u64)meta >= (u64)block->start && (u64)meta < (u64)block->start+block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
 }
 
 typedef struct {
@@ -233,6 +483,11 @@ Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 	block->start = ((u8*)block)+sizeof(Heap_Block);
 	block->size = size;
 	block->next = 0;
+	
+	u64 bitmap_size = align_next(align_next(size/os.page_size, 64)/8, os.page_size);
+	block->decommitted_pages = (u64*)os_reserve_memory(bitmap_size);
+	os_commit_memory_pages(block->decommitted_pages, bitmap_size);
+	block->decommitted_page_count = 0;
 	block->free_head = (Heap_Free_Node*)block->start;
 	block->free_head->size = get_heap_block_size_excluding_metadata(block);
 	block->free_head->next = 0;
@@ -244,28 +499,73 @@ void heap_init() {
 	if (heap_initted) return;
 	assert(HEAP_ALIGNMENT == 16);
 	assert(sizeof(Heap_Allocation_Metadata) % HEAP_ALIGNMENT == 0);
+	assert(heap_class_to_size(HEAP_SIZE_CLASS_COUNT-1) == HEAP_MAX_SMALL_SIZE);
+	assert(HEAP_SIZE_CLASS_COUNT <= 64, "Size class bitmap is a u64");
 	heap_initted = true;
 	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
 	spinlock_init(&heap_lock);
 }
 
-void *heap_alloc(u64 size) {
-
-	if (!heap_initted) heap_init();
+// First page at or after 'page' in [page, end) which is (decommitted == true) or isn't
+// (decommitted == false) decommitted. Returns end if there is none.
+u64 heap_find_page(Heap_Block *block, u64 page, u64 end, bool decommitted) {
+	while (page < end) {
+		u64 word = block->decommitted_pages[page/64];
+		if (!decommitted) word = ~word;
+		word &= ~0ULL << (page%64);
+		if (word) return min(page - page%64 + bit_scan_forward_64(word), end);
+		page = page - page%64 + 64;
+	}
+	return end;
+}
 
-	// #Sync #Speed oof
-	spinlock_acquire_or_wait(&heap_lock);
+// Commits or decommits the pages in [start, end) of the block which aren't already.
+// start and end must be page aligned. heap_lock must be held.
+void heap_set_pages_decommitted(Heap_Block *block, void *start, void *end, bool decommit) {
+	u64 page = ((u64)start - (u64)block) / os.page_size;
+	u64 last = ((u64)end - (u64)block) / os.page_size;
 	
+	while (true) {
+		u64 run_start = heap_find_page(block, page, last, !decommit);
+		if (run_start == last) break;
+		u64 run_end = heap_find_page(block, run_start, last, decommit);
+		
+		void *p = (u8*)block + run_start*os.page_size;
+		u64 size = (run_end-run_start)*os.page_size;
+		if (decommit) os_decommit_memory_pages(p, size);
+		else          os_commit_memory_pages(p, size);
+		
+		for (u64 i = run_start; i < run_end; i++) {
+			if (decommit) block->decommitted_pages[i/64] |= 1ULL << (i%64);
+			else          block->decommitted_pages[i/64] &= ~(1ULL << (i%64));
+		}
+		if (decommit) block->decommitted_page_count += run_end-run_start;
+		else          block->decommitted_page_count -= run_end-run_start;
+		
+		page = run_end;
+	}
+}
 
+// Makes free node memory in [start, end) usable. start and end must be page aligned.
+// heap_lock must be held.
+inline void heap_use_free_pages(Heap_Block *block, void *start, void *end) {
+	if (block->decommitted_page_count) heap_set_pages_decommitted(block, start, end, false);
+	os_unlock_program_memory_pages(start, (u64)end-(u64)start);
+}
 
+// Gives the pages of a free node back to the OS. heap_lock must be held.
+void heap_decommit_free_node(Heap_Block *block, Heap_Free_Node *node) {
+	u64 first_page    = align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+	u64 last_page_end = align_previous((u8*)node + node->size, os.page_size);
+	if (last_page_end > first_page) {
+		heap_set_pages_decommitted(block, (void*)first_page, (void*)last_page_end, true);
+	}
+}
 
+// Size includes metadata and is aligned. heap_lock must be held.
+Heap_Allocation_Metadata *heap_alloc_free_list(u64 size) {
 	
-	size += sizeof(Heap_Allocation_Metadata);
-	
-	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
-	
-	assert(size < MAX_HEAP_BLOCK_SIZE, "Past Charlie has been lazy and did not handle large allocations like this. I apologize on behalf of past Charlie. A quick fix could be to increase the heap block size for now. #Incomplete #Limitation");
-	
+	assert(size <= HEAP_LARGE_ALLOCATION_THRESHOLD, "Internal heap error: large allocations should not go through the free lists");
 	
 #if VERY_DEBUG
 	{
@@ -329,15 +629,13 @@ void *heap_alloc(u64 size) {
 	
 	assert(best_fit != 0, "Internal heap error");
 	
-	// Unlock best fit
-	
-	// #Copypaste
-	void *free_tail = (u8*)best_fit + best_fit->size;
+	// Unlock the pages we are going to use, and the header of the remaining free node.
+	// The rest of the free node stays locked.
+	u64 used = size;
+	if (size != best_fit->size) used += sizeof(Heap_Free_Node);
 	void *first_page = (void*)align_previous(best_fit, os.page_size);
-	void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-	if ((u8*)last_page_end > (u8*)first_page) {
-		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
-	}
+	void *last_page_end = (void*)align_next((u8*)best_fit + used, os.page_size);
+	heap_use_free_pages(best_fit_block, first_page, last_page_end);
 	
 	Heap_Free_Node *new_free_node = 0;
 	if (size != best_fit->size) {
@@ -345,15 +643,6 @@ void *heap_alloc(u64 size) {
 		new_free_node = (Heap_Free_Node*)(((u8*)best_fit)+size);
 		new_free_node->size = remainder;
 		new_free_node->next = best_fit->next;
-		
-		// Lock remaining free node
-		// #Copypaste
-		void *free_tail = (u8*)new_free_node + new_free_node->size;
-		void *next_page = (void*)align_next(new_free_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-		}
 	}
 	
 	
@@ -388,276 +677,1714 @@ void *heap_alloc(u64 size) {
 	sanity_check_block(meta->block);
 #endif
 	
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
+	return meta;
+}
+
+// heap_lock must be held.
+Heap_Allocation_Metadata *heap_pop_small_slot(u64 size_class) {
+	Heap_Size_Class *c = &heap_size_classes[size_class];
 	
+	Heap_Free_Node *slot = c->free_head;
+	c->free_head = slot->next;
+	if (!c->free_head) heap_size_class_bitmap &= ~(1ULL << size_class);
 	
-	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
-	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
-	return p;
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)slot;
+	meta->size = heap_class_to_size(size_class);
+	return meta;
 }
-void heap_dealloc(void *p) {
-	// #Sync #Speed oof
+// heap_lock must be held.
+Heap_Allocation_Metadata *heap_carve_small_slot(u64 size_class) {
+	Heap_Size_Class *c = &heap_size_classes[size_class];
+	u64 slot_size = heap_class_to_size(size_class);
 	
-	if (!heap_initted) heap_init();
+	if ((u64)(c->bump_end-c->bump) < slot_size) {
+		// Whatever is left of the previous chunk is smaller than a slot so it's just wasted
+		Heap_Allocation_Metadata *chunk = heap_alloc_free_list(HEAP_SMALL_CHUNK_SIZE);
+		c->bump = (u8*)(chunk+1);
+		c->bump_end = (u8*)chunk + HEAP_SMALL_CHUNK_SIZE;
+	}
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)c->bump;
+	c->bump += slot_size;
+	meta->size = slot_size;
+	return meta;
+}
 
-	spinlock_acquire_or_wait(&heap_lock);
+// Size includes metadata and is aligned. heap_lock must be held.
+Heap_Allocation_Metadata *heap_alloc_small(u64 size) {
+	u64 size_class = heap_size_to_class(size);
 	
-	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
-	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
-	check_meta(meta);
+	// Smallest class with a free slot that isn't too much bigger than what we asked for
+	u64 candidates = heap_size_class_bitmap >> size_class;
+	candidates &= (1ULL << (HEAP_SIZE_CLASS_MAX_STEP_UP+1))-1;
 	
-	// Yoink meta data before we start overwriting it
-	Heap_Block *block = meta->block;
-	u64 size = meta->size;
+	Heap_Allocation_Metadata *meta;
+	if (candidates) meta = heap_pop_small_slot(size_class + bit_scan_forward_64(candidates));
+	else            meta = heap_carve_small_slot(size_class);
 	
+	heap_meta_set_owner(meta, 0);
 #if CONFIGURATION == DEBUG
-	memset(p, 0x69696969, size);
+	meta->signature = HEAP_META_SIGNATURE;
 #endif
 	
-	#if VERY_DEBUG
-		sanity_check_block(block);
-	#endif
-	
-	Heap_Free_Node *new_node = cast(Heap_Free_Node*)p;
-	new_node->size = size;
-	
-	if (new_node < block->free_head) {
-		// #Copypaste
-		void *free_tail = (u8*)new_node + new_node->size;
-		void *next_page = (void*)align_next(new_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-		}
-		
-		if ((u8*)new_node+size == (u8*)block->free_head) {
-			new_node->size = size + block->free_head->size;
-			new_node->next = block->free_head->next;
-			block->free_head = new_node;
-		} else {
-			new_node->next = block->free_head;
-			block->free_head = new_node;
-		}
-		
-	} else {
+	return meta;
+}
+
+// p points to the metadata. heap_lock must be held.
+void heap_dealloc_small(void *p, u64 size) {
+	u64 size_class = heap_size_to_class(size);
+	Heap_Size_Class *c = &heap_size_classes[size_class];
 	
-		if (!block->free_head) {
-			block->free_head = new_node;
-			new_node->next = 0;
-			
-			// #Copypaste
-			void *free_tail = (u8*)new_node + new_node->size;
-			void *next_page = (void*)align_next(new_node, os.page_size);
-			void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-			if ((u8*)last_page_end > (u8*)next_page) {
-				os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-			}
-			
-		} else {
-			Heap_Free_Node *node = block->free_head;
-		
-			while (true) {
-			
-				assert(node != 0, "We didn't find where the free node should be! This is likely heap corruption (or, hopefully not, an internal error)");
-				
-				// In retrospect, I don't remember a good reason to care about where the
-				// free nodes are... maybe I'm just dumb right now? #Speed #Memory
-				// ... ACtually, it's probably to easily know when to merge free nodes.
-				// BUT. Maybe it's not worth the performance hit? Then again, if the heap
-				// allocator slows down your program you should rethink your memory management
-				// anyways...
-				
-				if (new_node >= node) {
-					u8* node_tail = (u8*)node + node->size;
-					if (cast(u8*)new_node == node_tail) {
-						
-						// We need to account for the cases where we coalesce free blocks with start/end in the middle
-						// of a page.
-						
-						u64 new_node_size = new_node->size;
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_previous(node_tail, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-
-						if ((u8*)next_page < (u8*)node) next_page = (u8*)next_page + os.page_size;
-						
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
-						
-						node->size += new_node_size;
-						
-						break;
-					} else {
-						new_node->next = node->next;
-						node->next = new_node;
-						
-						u8* new_node_tail = (u8*)new_node + new_node->size;
-						if (new_node->next && (u8*)new_node->next == new_node_tail) {
-							new_node->size += new_node->next->size;
-							new_node->next = new_node->next->next;
-						}
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_next(new_node, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
-						
-						break;
-					}
-				}
-				
-				node = node->next;
-			}
-		}
-	}
+	Heap_Free_Node *slot = (Heap_Free_Node*)p;
+	slot->size = size;
+	slot->next = c->free_head;
+	c->free_head = slot;
 	
+	heap_size_class_bitmap |= 1ULL << size_class;
+}
 
-#if CONFIGURATION == DEBUG
-	block->total_allocated -= size;
-#endif
-
-#if VERY_DEBUG
-	sanity_check_block(block);
-#endif
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
+inline u32 heap_magazine_capacity(u64 size_class) {
+	u64 slots = HEAP_MAGAZINE_SIZE / heap_class_to_size(size_class);
+	return (u32)clamp(slots, HEAP_MAGAZINE_MIN_SLOTS, HEAP_MAGAZINE_MAX_SLOTS);
 }
 
-void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return heap_alloc(size);
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			heap_dealloc(p);
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			if (!p) {
-				return heap_alloc(size);
-			}
-			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
-			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
-			check_meta(meta);
-			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
-			heap_dealloc(p);
-			return new;
-		}
+// Gives slots in a magazine back to the global size class until there are only 'keep' left.
+// heap_lock must be held.
+void heap_thread_cache_flush(Heap_Thread_Cache *cache, u64 size_class, u32 keep) {
+	u64 size = heap_class_to_size(size_class);
+	while (cache->magazine_counts[size_class] > keep) {
+		Heap_Free_Node *slot = cache->magazines[size_class];
+		cache->magazines[size_class] = slot->next;
+		cache->magazine_counts[size_class] -= 1;
+		heap_dealloc_small(slot, size);
 	}
-	return 0;
 }
 
-Allocator get_heap_allocator() {
-	Allocator heap_allocator;
+// Only call on the thread owning the cache
+void heap_thread_cache_push(Heap_Thread_Cache *cache, Heap_Free_Node *slot, u64 size) {
+	u64 size_class = heap_size_to_class(size);
+	slot->size = size;
+	slot->next = cache->magazines[size_class];
+	cache->magazines[size_class] = slot;
+	cache->magazine_counts[size_class] += 1;
 	
-	heap_allocator.proc = heap_allocator_proc;
-	heap_allocator.data = 0;
-	
-	return heap_allocator;
+	u32 capacity = heap_magazine_capacity(size_class);
+	if (cache->magazine_counts[size_class] > capacity) {
+		// Give half back so other threads can have them
+		spinlock_acquire_or_wait(&heap_lock);
+		heap_thread_cache_flush(cache, size_class, capacity/2);
+		spinlock_release(&heap_lock);
+	}
 }
 
-///
-///
-// Temporary storage
-///
-
-#ifndef TEMPORARY_STORAGE_SIZE
-	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
-#endif
-
-ogb_instance void* talloc(u64);
-ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
-
-// #Global
-ogb_instance Allocator 
-get_temporary_allocator();
-
-#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-thread_local void * temporary_storage = 0;
-thread_local void * temporary_storage_pointer = 0;
-thread_local bool   has_warned_temporary_storage_overflow = false;
-thread_local Allocator temp_allocator;
-
-ogb_instance Allocator 
-get_temporary_allocator() {
-	return temp_allocator;
+// Only call on the thread owning the cache
+void heap_thread_cache_take_remote_frees(Heap_Thread_Cache *cache) {
+	Heap_Free_Node *node;
+	do {
+		node = cache->remote_free_head;
+	} while (!compare_and_swap_64((volatile u64*)&cache->remote_free_head, 0, (u64)node));
+	
+	while (node) {
+		Heap_Free_Node *next = node->next;
+		heap_thread_cache_push(cache, node, node->size);
+		node = next;
+	}
 }
-#endif
-
-ogb_instance void* 
-temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
-
-ogb_instance void 
-temporary_storage_init(u64 arena_size);
 
-ogb_instance void* 
-talloc(u64 size);
-
-ogb_instance void 
-reset_temporary_storage();
-
-
-#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return talloc(size);
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			return 0;
-		}
-	}
-	return 0;
+// Any thread
+void heap_thread_cache_push_remote(Heap_Thread_Cache *cache, Heap_Free_Node *slot, u64 size) {
+	slot->size = size;
+	Heap_Free_Node *head;
+	do {
+		head = cache->remote_free_head;
+		slot->next = head;
+	} while (!compare_and_swap_64((volatile u64*)&cache->remote_free_head, (u64)slot, (u64)head));
 }
 
-void temporary_storage_init(u64 arena_size) {
+Heap_Thread_Cache *heap_get_thread_cache() {
+	if (heap_thread_cache) return heap_thread_cache;
 	
-	temporary_storage = heap_alloc(arena_size);
-	assert(temporary_storage, "Failed allocating temporary storage");
-	temporary_storage_pointer = temporary_storage;
-
-	temp_allocator.proc = temp_allocator_proc;
-	temp_allocator.data = 0;
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Thread_Cache *cache = heap_unused_thread_caches;
+	if (cache) {
+		heap_unused_thread_caches = cache->next_unused;
+	} else {
+		// Caches are never freed, they go to heap_unused_thread_caches when their thread exits
+		u64 size = align_next(sizeof(Heap_Thread_Cache)+sizeof(Heap_Allocation_Metadata), HEAP_ALIGNMENT);
+		assert(size <= HEAP_MAX_SMALL_SIZE);
+		Heap_Allocation_Metadata *meta = heap_alloc_small(size);
+		cache = (Heap_Thread_Cache*)(meta+1);
+		memset(cache, 0, sizeof(Heap_Thread_Cache));
+		cache->next_in_all = heap_all_thread_caches;
+		heap_all_thread_caches = cache;
+	}
+	cache->next_unused = 0;
+	spinlock_release(&heap_lock);
 	
-	temp_allocator.proc = temp_allocator_proc;
+	heap_thread_cache = cache;
+	
+	// Slots that were freed after the previous thread using this cache exited
+	heap_thread_cache_take_remote_frees(cache);
+	
+	return cache;
 }
 
-void* talloc(u64 size) {
+// Called when a thread exits. Gives all slots in the calling threads cache back to the global
+// size classes. Slots handed out from this cache and freed later end up in its remote free list
+// and are taken back when the next thread gets this cache.
+void heap_thread_cache_release() {
+	Heap_Thread_Cache *cache = heap_thread_cache;
+	if (!cache) return;
 	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
+	heap_thread_cache_take_remote_frees(cache);
+	
+	spinlock_acquire_or_wait(&heap_lock);
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i++) {
+		heap_thread_cache_flush(cache, i, 0);
+	}
+	cache->next_unused = heap_unused_thread_caches;
+	heap_unused_thread_caches = cache;
+	spinlock_release(&heap_lock);
 	
-	void* p = temporary_storage_pointer;
+	heap_thread_cache = 0;
+}
+
+// Size includes metadata and is aligned.
+Heap_Allocation_Metadata *heap_alloc_small_cached(u64 size) {
+	Heap_Thread_Cache *cache = heap_get_thread_cache();
+	u64 size_class = heap_size_to_class(size);
 	
-	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
+	if (!cache->magazines[size_class] && cache->remote_free_head) {
+		heap_thread_cache_take_remote_frees(cache);
+	}
 	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
+	Heap_Allocation_Metadata *meta;
+	Heap_Free_Node *slot = cache->magazines[size_class];
+	if (slot) {
+		cache->magazines[size_class] = slot->next;
+		cache->magazine_counts[size_class] -= 1;
+		
+		meta = (Heap_Allocation_Metadata*)slot;
+		meta->size = heap_class_to_size(size_class);
+#if CONFIGURATION == DEBUG
+		meta->signature = HEAP_META_SIGNATURE;
+#endif
+	} else {
+		// Refill half the magazine from the global size class while we have the lock anyways.
+		// We don't take bigger slots or make new chunks just for the magazine though.
+		u32 refill = heap_magazine_capacity(size_class)/2;
+		u64 slot_size = heap_class_to_size(size_class);
+		Heap_Size_Class *c = &heap_size_classes[size_class];
+		
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		meta = heap_alloc_small(size);
+		for (u32 i = 0; i < refill; i++) {
+			Heap_Allocation_Metadata *extra;
+			if (c->free_head)                               extra = heap_pop_small_slot(size_class);
+			else if ((u64)(c->bump_end-c->bump) >= slot_size) extra = heap_carve_small_slot(size_class);
+			else break;
+			
+			Heap_Free_Node *node = (Heap_Free_Node*)extra;
+			node->size = slot_size;
+			node->next = cache->magazines[size_class];
+			cache->magazines[size_class] = node;
+			cache->magazine_counts[size_class] += 1;
 		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
+		spinlock_release(&heap_lock);
 	}
 	
-	return p;
+	heap_meta_set_owner(meta, cache);
+	check_meta(meta);
+	
+	return meta;
 }
 
-void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
-	has_warned_temporary_storage_overflow = true;
+// Size includes metadata and is aligned to os.page_size.
+Heap_Allocation_Metadata *heap_alloc_large(u64 size) {
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	// Best fit in address space of previously freed large allocations
+	Heap_Free_Node *node = heap_large_free_head;
+	Heap_Free_Node *previous = 0;
+	Heap_Free_Node *best_fit = 0;
+	Heap_Free_Node *before_best_fit = 0;
+	while (node) {
+		if (node->size >= size && (!best_fit || node->size < best_fit->size)) {
+			best_fit = node;
+			before_best_fit = previous;
+			if (node->size == size) break;
+		}
+		previous = node;
+		node = node->next;
+	}
+	
+	Heap_Allocation_Metadata *meta;
+	if (best_fit) {
+		Heap_Free_Node *next = best_fit->next;
+		u64 remainder = best_fit->size - size;
+		if (remainder > HEAP_LARGE_ALLOCATION_THRESHOLD) {
+			Heap_Free_Node *rest = (Heap_Free_Node*)((u8*)best_fit + size);
+			os_commit_memory_pages(rest, os.page_size);
+			rest->size = remainder;
+			rest->next = next;
+			next = rest;
+			atomic_fetch_add_64(&heap_large_committed_bytes, os.page_size, MEMORY_ORDER_RELAXED);
+		} else {
+			size = best_fit->size;
+		}
+		
+		if (before_best_fit) before_best_fit->next = next;
+		else                 heap_large_free_head = next;
+		
+		meta = (Heap_Allocation_Metadata*)best_fit;
+		atomic_fetch_add_64(&heap_large_committed_bytes, size - os.page_size, MEMORY_ORDER_RELAXED);
+	} else {
+		meta = (Heap_Allocation_Metadata*)os_reserve_next_memory_pages(size);
+		atomic_fetch_add_64(&heap_large_committed_bytes, size, MEMORY_ORDER_RELAXED);
+	}
+	
+	// #Sync #Speed oof
+	spinlock_release(&heap_lock);
+	
+	// First page of a free region is already committed
+	if (best_fit) os_commit_memory_pages((u8*)meta + os.page_size, size - os.page_size);
+	else          os_unlock_program_memory_pages(meta, size);
+	
+	meta->size = size;
+	meta->owner_bits = HEAP_META_LARGE_BIT;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	return meta;
 }
 
-#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
\ No newline at end of file
+// p points to the metadata.
+void heap_dealloc_large(void *p, u64 size) {
+	
+	// Everything but the page with the free node goes back to the OS right away
+	os_decommit_memory_pages((u8*)p + os.page_size, size - os.page_size);
+	
+	Heap_Free_Node *region = (Heap_Free_Node*)p;
+	region->size = size;
+	
+	atomic_fetch_sub_64(&heap_large_committed_bytes, size - os.page_size, MEMORY_ORDER_RELAXED);
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	Heap_Free_Node *previous = 0;
+	Heap_Free_Node *next = heap_large_free_head;
+	while (next && next < region) {
+		previous = next;
+		next = next->next;
+	}
+	
+	// Merge with neighbours. The merged region only needs one page for its node.
+	if (next && (u8*)region + region->size == (u8*)next) {
+		region->size += next->size;
+		region->next = next->next;
+		os_decommit_memory_pages(next, os.page_size);
+		atomic_fetch_sub_64(&heap_large_committed_bytes, os.page_size, MEMORY_ORDER_RELAXED);
+	} else {
+		region->next = next;
+	}
+	
+	if (previous && (u8*)previous + previous->size == (u8*)region) {
+		previous->size += region->size;
+		previous->next = region->next;
+		os_decommit_memory_pages(region, os.page_size);
+		atomic_fetch_sub_64(&heap_large_committed_bytes, os.page_size, MEMORY_ORDER_RELAXED);
+	} else if (previous) {
+		previous->next = region;
+	} else {
+		heap_large_free_head = region;
+	}
+	
+	// #Sync #Speed oof
+	spinlock_release(&heap_lock);
+}
+
+// GUARD_PAGE_ALLOCATIONS. Size includes metadata and is aligned to HEAP_ALIGNMENT.
+// The allocation is pushed up against a decommitted guard page so the first byte past it faults.
+Heap_Allocation_Metadata *heap_alloc_guarded(u64 size) {
+	u64 pages_size = align_next(size, os.page_size);
+	u64 range_size = pages_size + os.page_size;
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	u8 *range = 0;
+	// Take from the end of the first free range that fits. The rest stays free.
+	for (u64 i = 0; i < heap_guard_free_range_count; i++) {
+		Heap_Guard_Range *r = &heap_guard_free_ranges[i];
+		if (r->size < range_size) continue;
+		r->size -= range_size;
+		range = r->start + r->size;
+		if (r->size == 0) {
+			heap_guard_free_range_count -= 1;
+			*r = heap_guard_free_ranges[heap_guard_free_range_count];
+		}
+		break;
+	}
+	bool reused = range != 0;
+	if (!reused) range = (u8*)os_reserve_next_memory_pages(range_size);
+	atomic_fetch_add_64(&heap_large_committed_bytes, pages_size, MEMORY_ORDER_RELAXED);
+	spinlock_release(&heap_lock);
+	
+	u8 *guard_page = range + pages_size;
+	if (reused) {
+		// The guard page is still decommitted from when it was freed
+		os_commit_memory_pages(range, pages_size);
+	} else {
+		// Reserved pages are only locked in debug
+		os_unlock_program_memory_pages(range, pages_size);
+		os_decommit_memory_pages(guard_page, os.page_size);
+	}
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(guard_page - size);
+	meta->size = pages_size;
+	meta->owner_bits = (u64)guard_page | HEAP_META_GUARD_BIT;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	return meta;
+}
+// Assumes heap_lock. Merges with a neighbour if it can so ranges don't only ever get smaller.
+void heap_guard_add_free_range(Heap_Guard_Range range) {
+	for (u64 i = 0; i < heap_guard_free_range_count; i++) {
+		Heap_Guard_Range *r = &heap_guard_free_ranges[i];
+		if (r->start + r->size == range.start) {
+			r->size += range.size;
+			return;
+		}
+		if (range.start + range.size == r->start) {
+			r->start = range.start;
+			r->size += range.size;
+			return;
+		}
+	}
+	// #Incomplete If there are this many separate ranges we just lose the address space.
+	// Nothing is committed in it so it only costs address space.
+	if (heap_guard_free_range_count < HEAP_GUARD_FREE_RANGE_MAX) {
+		heap_guard_free_ranges[heap_guard_free_range_count] = range;
+		heap_guard_free_range_count += 1;
+	}
+}
+// The pages are decommitted so anything still pointing to them faults, at least until the
+// range has made it through the quarantine.
+void heap_dealloc_guarded(Heap_Allocation_Metadata *meta) {
+	u64 pages_size = meta->size;
+	Heap_Guard_Range range = { heap_meta_guard_page(meta) - pages_size, pages_size + os.page_size };
+	
+	os_decommit_memory_pages(range.start, range.size);
+	atomic_fetch_sub_64(&heap_large_committed_bytes, pages_size, MEMORY_ORDER_RELAXED);
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	if (heap_guard_quarantine_count == HEAP_GUARD_QUARANTINE_COUNT) {
+		heap_guard_add_free_range(heap_guard_quarantine[heap_guard_quarantine_first]);
+		heap_guard_quarantine_first = (heap_guard_quarantine_first + 1) % HEAP_GUARD_QUARANTINE_COUNT;
+		heap_guard_quarantine_count -= 1;
+	}
+	heap_guard_quarantine[(heap_guard_quarantine_first + heap_guard_quarantine_count) % HEAP_GUARD_QUARANTINE_COUNT] = range;
+	heap_guard_quarantine_count += 1;
+	spinlock_release(&heap_lock);
+}
+
+// Counted on the calling thread's cache so there's no synchronization.
+inline void heap_account(u64 tag, s64 bytes, s64 count) {
+	Heap_Thread_Cache *cache = heap_get_thread_cache();
+	cache->live_bytes += bytes;
+	cache->live_count += count;
+	cache->tagged_live_bytes[tag] += bytes;
+}
+
+void *heap_alloc(u64 size) {
+
+	if (!heap_initted) heap_init();
+	
+	size += sizeof(Heap_Allocation_Metadata);
+	size = align_next(size, HEAP_ALIGNMENT);
+
+	Heap_Allocation_Metadata *meta;
+	if (GUARD_PAGE_ALLOCATIONS) {
+		meta = heap_alloc_guarded(size);
+	} else if (size <= HEAP_MAX_SMALL_SIZE) {
+		meta = heap_alloc_small_cached(size);
+	} else if (size > HEAP_LARGE_ALLOCATION_THRESHOLD) {
+		meta = heap_alloc_large(align_next(size, os.page_size));
+	} else {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		meta = heap_alloc_free_list(size);
+		spinlock_release(&heap_lock);
+	}
+	
+	u64 tag = context.allocation_tag;
+	assert(tag < heap_tag_count, "Context.allocation_tag %llu was not made with heap_make_tag()", tag);
+	heap_meta_set_tag(meta, tag);
+	heap_account(tag, (s64)meta->size, 1);
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
+	return p;
+}
+
+// Alignments over HEAP_ALIGNMENT allocate enough to move the pointer forward to the alignment,
+// with room for metadata right before it which points back to the real allocation.
+void *heap_alloc_aligned(u64 size, u64 alignment) {
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	if (alignment <= HEAP_ALIGNMENT) return heap_alloc(size);
+	
+	u8 *p = (u8*)heap_alloc(size + sizeof(Heap_Allocation_Metadata) + alignment - HEAP_ALIGNMENT);
+	u8 *aligned = (u8*)align_next(p + sizeof(Heap_Allocation_Metadata), alignment);
+	
+	Heap_Allocation_Metadata *offset_meta = (Heap_Allocation_Metadata*)aligned - 1;
+	offset_meta->size = (u64)(aligned - p);
+	offset_meta->owner_bits = alignment | HEAP_META_OFFSET_BIT;
+#if CONFIGURATION == DEBUG
+	offset_meta->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	return aligned;
+}
+
+// In debug, pages of free nodes are locked so we catch use after free.
+// This locks the pages touching [start, end) which are fully inside the free node, except
+// the page with the node header.
+void heap_lock_free_node_pages(Heap_Free_Node *node, void *start, void *end) {
+	u64 first_page    = max(align_previous(start, os.page_size), align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size));
+	u64 last_page_end = min(align_next(end, os.page_size), align_previous((u8*)node + node->size, os.page_size));
+	if (last_page_end > first_page) {
+		os_lock_program_memory_pages((void*)first_page, last_page_end-first_page);
+	}
+}
+
+// p points to the metadata. heap_lock must be held.
+void heap_dealloc_free_list(void *p, Heap_Block *block, u64 size) {
+	#if VERY_DEBUG
+		sanity_check_block(block);
+	#endif
+	
+	Heap_Free_Node *new_node = cast(Heap_Free_Node*)p;
+	new_node->size = size;
+	
+	// Find where the new node goes so the free list stays in address order, which is what
+	// lets us merge neighbouring free nodes.
+	Heap_Free_Node *previous = 0;
+	Heap_Free_Node *next = block->free_head;
+	while (next && next < new_node) {
+		previous = next;
+		next = next->next;
+	}
+	
+	u8 *lock_end = (u8*)p + size;
+	if (next && (u8*)new_node + new_node->size == (u8*)next) {
+		new_node->size += next->size;
+		new_node->next = next->next;
+		// Header of next is not a header anymore
+		lock_end += sizeof(Heap_Free_Node);
+	} else {
+		new_node->next = next;
+	}
+	
+	Heap_Free_Node *merged = new_node;
+	if (previous && (u8*)previous + previous->size == (u8*)new_node) {
+		previous->size += new_node->size;
+		previous->next = new_node->next;
+		merged = previous;
+	} else if (previous) {
+		previous->next = new_node;
+	} else {
+		block->free_head = new_node;
+	}
+	
+	heap_lock_free_node_pages(merged, p, lock_end);
+	
+	if (HEAP_DECOMMIT_THRESHOLD && merged->size >= HEAP_DECOMMIT_THRESHOLD) {
+		heap_decommit_free_node(block, merged);
+	}
+
+#if CONFIGURATION == DEBUG
+	block->total_allocated -= size;
+#endif
+
+#if VERY_DEBUG
+	sanity_check_block(block);
+#endif
+}
+
+void heap_dealloc(void *p) {
+	
+	if (!heap_initted) heap_init();
+	
+	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
+	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
+	check_meta(meta);
+	
+	if (heap_meta_is_offset(meta)) {
+		// Aligned allocation, the real one is further back
+		p = (u8*)meta + sizeof(Heap_Allocation_Metadata) - meta->size - sizeof(Heap_Allocation_Metadata);
+		meta = (Heap_Allocation_Metadata*)p;
+		check_meta(meta);
+	}
+	
+	// Yoink meta data before we start overwriting it
+	u64 size = meta->size;
+	Heap_Block *block = heap_meta_block(meta);
+	bool small = heap_meta_is_small(meta);
+	Heap_Thread_Cache *owner = heap_meta_owner(meta);
+	
+	heap_account(heap_meta_tag(meta), -(s64)size, -1);
+	
+	if (heap_meta_is_guarded(meta)) {
+		heap_dealloc_guarded(meta);
+		return;
+	}
+	if (heap_meta_is_large(meta)) {
+		heap_dealloc_large(p, size);
+		return;
+	}
+	
+#if CONFIGURATION == DEBUG
+	memset(p, 0x69696969, size);
+#endif
+	
+	if (small) {
+		if (owner && owner == heap_thread_cache) {
+			heap_thread_cache_push(owner, (Heap_Free_Node*)p, size);
+		} else if (owner) {
+			heap_thread_cache_push_remote(owner, (Heap_Free_Node*)p, size);
+		} else {
+			// #Sync #Speed oof
+			spinlock_acquire_or_wait(&heap_lock);
+			heap_dealloc_small(p, size);
+			spinlock_release(&heap_lock);
+		}
+	} else {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		heap_dealloc_free_list(p, block, size);
+		spinlock_release(&heap_lock);
+	}
+}
+
+// Resizes a free list allocation without moving it, by taking from the free node right
+// after it or giving the tail back. Size includes metadata and is aligned.
+// Returns false if there isn't enough free space right after it. heap_lock must be held.
+bool heap_resize_free_list(Heap_Allocation_Metadata *meta, u64 size) {
+	Heap_Block *block = heap_meta_block(meta);
+	
+	if (size == meta->size) return true;
+	
+	if (size < meta->size) {
+		u64 tail = meta->size - size;
+		meta->size = size;
+		heap_dealloc_free_list((u8*)meta + size, block, tail);
+		return true;
+	}
+	
+	u8 *end = (u8*)meta + meta->size;
+	u64 needed = size - meta->size;
+	
+	// Free list is in address order
+	Heap_Free_Node *previous = 0;
+	Heap_Free_Node *next = block->free_head;
+	while (next && (u8*)next < end) {
+		previous = next;
+		next = next->next;
+	}
+	if ((u8*)next != end || next->size < needed) return false;
+	
+	u64 used = needed;
+	if (needed != next->size) used += sizeof(Heap_Free_Node);
+	void *first_page = (void*)align_previous(end, os.page_size);
+	void *last_page_end = (void*)align_next(end + used, os.page_size);
+	heap_use_free_pages(block, first_page, last_page_end);
+	
+	Heap_Free_Node *replacement = next->next;
+	if (needed != next->size) {
+		Heap_Free_Node *rest = (Heap_Free_Node*)(end + needed);
+		rest->size = next->size - needed;
+		rest->next = next->next;
+		replacement = rest;
+	}
+	if (previous) previous->next = replacement;
+	else          block->free_head = replacement;
+	
+	meta->size = size;
+#if CONFIGURATION == DEBUG
+	block->total_allocated += needed;
+#endif
+
+#if VERY_DEBUG
+	sanity_check_block(block);
+#endif
+	
+	return true;
+}
+
+// Resizes a large allocation without moving it. It can grow into a freed large region right
+// after it, or into fresh pages if it's at the end of program memory.
+// Size includes metadata and is aligned to os.page_size.
+bool heap_resize_large(Heap_Allocation_Metadata *meta, u64 size) {
+	
+	if (size == meta->size) return true;
+	
+	if (size < meta->size) {
+		u64 tail = meta->size - size;
+		meta->size = size;
+		heap_dealloc_large((u8*)meta + size, tail);
+		return true;
+	}
+	
+	u8 *end = (u8*)meta + meta->size;
+	u64 needed = size - meta->size;
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	Heap_Free_Node *previous = 0;
+	Heap_Free_Node *region = heap_large_free_head;
+	while (region && (u8*)region < end) {
+		previous = region;
+		region = region->next;
+	}
+	if ((u8*)region != end) region = 0;
+	
+	u64 from_region = 0;
+	u64 from_program_memory = 0;
+	if (region && region->size >= needed) {
+		from_region = needed;
+	} else if ((region && (u8*)region + region->size == (u8*)program_memory_next) || end == (u8*)program_memory_next) {
+		from_region = region ? region->size : 0;
+		from_program_memory = needed - from_region;
+	} else {
+		spinlock_release(&heap_lock);
+		return false;
+	}
+	
+	if (region) {
+		Heap_Free_Node *replacement = region->next;
+		if (region->size != from_region) {
+			Heap_Free_Node *rest = (Heap_Free_Node*)(end + from_region);
+			os_commit_memory_pages(rest, os.page_size);
+			rest->size = region->size - from_region;
+			rest->next = region->next;
+			replacement = rest;
+			atomic_fetch_add_64(&heap_large_committed_bytes, os.page_size, MEMORY_ORDER_RELAXED);
+		}
+		if (previous) previous->next = replacement;
+		else          heap_large_free_head = replacement;
+		atomic_fetch_add_64(&heap_large_committed_bytes, from_region - os.page_size, MEMORY_ORDER_RELAXED);
+	}
+	if (from_program_memory) {
+		void *fresh = os_reserve_next_memory_pages(from_program_memory);
+		assert(fresh == end + from_region, "Internal heap error: program memory is not contiguous");
+		atomic_fetch_add_64(&heap_large_committed_bytes, from_program_memory, MEMORY_ORDER_RELAXED);
+	}
+	
+	// #Sync #Speed oof
+	spinlock_release(&heap_lock);
+	
+	// First page of the region is already committed
+	if (from_region > os.page_size) os_commit_memory_pages(end + os.page_size, from_region - os.page_size);
+	if (from_program_memory) os_unlock_program_memory_pages(end + from_region, from_program_memory);
+	
+	meta->size = size;
+	return true;
+}
+
+// Moves a live allocation's bytes to another tag
+void heap_retag(Heap_Allocation_Metadata *meta, u64 tag) {
+	u64 old_tag = heap_meta_tag(meta);
+	if (old_tag == tag) return;
+	heap_account(old_tag, -(s64)meta->size, -1);
+	heap_account(tag, (s64)meta->size, 1);
+	heap_meta_set_tag(meta, tag);
+}
+
+// Resizes in place when it can, otherwise it's heap_alloc + copy + heap_dealloc.
+void *heap_realloc(void *p, u64 size) {
+	if (!p) return heap_alloc(size);
+	
+	if (!heap_initted) heap_init();
+	
+	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_realloc: it is out of program memory bounds!");
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p - sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	
+	if (heap_meta_is_offset(meta)) {
+		// Aligned allocations are always moved so they stay aligned
+		Heap_Allocation_Metadata *real_meta = (Heap_Allocation_Metadata*)((u8*)meta - meta->size);
+		check_meta(real_meta);
+		u64 old_size = heap_meta_usable_end(real_meta) - (u8*)p;
+		u64 tag = heap_meta_tag(real_meta);
+		
+		void *new = heap_alloc_aligned(size, heap_meta_alignment(meta));
+		memcpy(new, p, min(size, old_size));
+		heap_dealloc(p);
+		
+		Heap_Allocation_Metadata *new_meta = (Heap_Allocation_Metadata*)new - 1;
+		if (heap_meta_is_offset(new_meta)) new_meta = (Heap_Allocation_Metadata*)((u8*)new_meta - new_meta->size);
+		heap_retag(new_meta, tag);
+		return new;
+	}
+	
+	u64 new_size = align_next(size + sizeof(Heap_Allocation_Metadata), HEAP_ALIGNMENT);
+	u64 old_size = meta->size;
+	u64 tag = heap_meta_tag(meta);
+	
+	bool resized = false;
+	if (heap_meta_is_guarded(meta)) {
+		// Always moved so the old pointer faults
+	} else if (heap_meta_is_small(meta)) {
+		// Same rule as when we take slots from bigger classes
+		resized = new_size <= meta->size && heap_size_to_class(new_size) + HEAP_SIZE_CLASS_MAX_STEP_UP >= heap_size_to_class(meta->size);
+	} else if (heap_meta_is_large(meta)) {
+		resized = new_size > HEAP_LARGE_ALLOCATION_THRESHOLD && heap_resize_large(meta, align_next(new_size, os.page_size));
+	} else if (new_size > HEAP_MAX_SMALL_SIZE && new_size <= HEAP_LARGE_ALLOCATION_THRESHOLD) {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		resized = heap_resize_free_list(meta, new_size);
+		spinlock_release(&heap_lock);
+	}
+	if (resized) {
+		heap_account(tag, (s64)meta->size - (s64)old_size, 0);
+		return p;
+	}
+	
+	void *new = heap_alloc(size);
+	memcpy(new, p, min(size, (u64)(heap_meta_usable_end(meta) - (u8*)p)));
+	heap_dealloc(p);
+	
+	// Keep the tag it was allocated with
+	heap_retag((Heap_Allocation_Metadata*)new - 1, tag);
+	return new;
+}
+
+void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return heap_alloc(size);
+			break;
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			heap_dealloc(p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			return heap_realloc(p, size);
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return heap_alloc_aligned(size, (u64)p);
+		}
+	}
+	return 0;
+}
+
+Allocator get_heap_allocator() {
+	Allocator heap_allocator;
+	
+	heap_allocator.proc = heap_allocator_proc;
+	heap_allocator.data = 0;
+	
+	return heap_allocator;
+}
+
+// Heap allocations made while Context.allocation_tag is the returned tag are counted
+// separately in get_heap_stats(). The name is not copied.
+//
+//     u64 audio_tag = heap_make_tag(STR("audio"));
+//
+//     Context c = get_context();
+//     c.allocation_tag = audio_tag;
+//     push_context(c);
+//     ...
+//     pop_context();
+//
+u64 heap_make_tag(string name) {
+	spinlock_acquire_or_wait(&heap_lock);
+	assert(heap_tag_count < HEAP_MAX_TAGS, "Out of heap tags (HEAP_MAX_TAGS is %d)", HEAP_MAX_TAGS);
+	u64 tag = heap_tag_count;
+	heap_tag_names[tag] = name;
+	heap_tag_count += 1;
+	spinlock_release(&heap_lock);
+	return tag;
+}
+string heap_get_tag_name(u64 tag) {
+	assert(tag < heap_tag_count, "Invalid heap tag %llu", tag);
+	return heap_tag_names[tag];
+}
+
+// Walks the free nodes of heap blocks, so it's O(number of free nodes) but the rest is
+// just summing up counters.
+Heap_Stats get_heap_stats() {
+	if (!heap_initted) heap_init();
+	
+	Heap_Stats stats = ZERO(Heap_Stats);
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		stats.committed_bytes += block->size - block->decommitted_page_count*os.page_size;
+		stats.decommitted_bytes += block->decommitted_page_count*os.page_size;
+		for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+			stats.free_node_count += 1;
+			stats.free_bytes += node->size;
+			stats.largest_free_block = max(stats.largest_free_block, node->size);
+		}
+	}
+	stats.committed_bytes += atomic_load_64(&heap_large_committed_bytes, MEMORY_ORDER_RELAXED);
+	
+	// Caches are never removed from this list so we can read them without the lock, but the
+	// counters of other threads may be a tiny bit stale.
+	Heap_Thread_Cache *caches = heap_all_thread_caches;
+	stats.tag_count = heap_tag_count;
+	
+	spinlock_release(&heap_lock);
+	
+	s64 live_bytes = 0;
+	s64 live_count = 0;
+	s64 tagged_live_bytes[HEAP_MAX_TAGS] = {0};
+	for (Heap_Thread_Cache *cache = caches; cache; cache = cache->next_in_all) {
+		live_bytes += cache->live_bytes;
+		live_count += cache->live_count;
+		for (u64 i = 0; i < stats.tag_count; i++) {
+			tagged_live_bytes[i] += cache->tagged_live_bytes[i];
+		}
+	}
+	stats.live_bytes = (u64)max(live_bytes, 0);
+	stats.live_allocation_count = (u64)max(live_count, 0);
+	for (u64 i = 0; i < stats.tag_count; i++) {
+		stats.tagged_live_bytes[i] = (u64)max(tagged_live_bytes[i], 0);
+	}
+	
+	if (stats.free_bytes) {
+		stats.fragmentation = 1.0f - (float32)((float64)stats.largest_free_block/(float64)stats.free_bytes);
+	}
+	
+	return stats;
+}
+
+// Gives the pages of all free nodes in heap blocks back to the OS. They are committed again
+// when they are allocated. Good to call after something that used a lot of memory and freed it,
+// like loading a level. Returns how many bytes were decommitted.
+u64 heap_trim() {
+	if (!heap_initted) heap_init();
+	
+	u64 decommitted = 0;
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		u64 count_before = block->decommitted_page_count;
+		for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+			heap_decommit_free_node(block, node);
+		}
+		decommitted += (block->decommitted_page_count-count_before)*os.page_size;
+	}
+	spinlock_release(&heap_lock);
+	
+	return decommitted;
+}
+
+void log_heap_stats() {
+	Heap_Stats stats = get_heap_stats();
+	log_info("Heap: %.2f MB live in %llu allocations, %.2f MB committed (%.2f MB decommitted), %llu free nodes (%.2f MB, largest %.2f MB), fragmentation %.2f",
+		(float64)stats.live_bytes/(float64)MB(1), stats.live_allocation_count,
+		(float64)stats.committed_bytes/(float64)MB(1), (float64)stats.decommitted_bytes/(float64)MB(1),
+		stats.free_node_count, (float64)stats.free_bytes/(float64)MB(1), (float64)stats.largest_free_block/(float64)MB(1),
+		(float64)stats.fragmentation);
+	for (u64 i = 0; i < stats.tag_count; i++) {
+		if (!stats.tagged_live_bytes[i]) continue;
+		log_info("\t%s: %.2f MB", heap_get_tag_name(i), (float64)stats.tagged_live_bytes[i]/(float64)MB(1));
+	}
+}
+
+///
+///
+// Temporary storage
+///
+
+#ifndef TEMPORARY_STORAGE_SIZE
+	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
+#endif
+
+// When a thread's temporary storage runs out we chain another block onto it rather than
+// wrapping around. Blocks that weren't needed by the time of reset_temporary_storage() are
+// released, so a spike of temp usage doesn't hold on to memory.
+// get_temporary_storage_high_water_mark() tells you how much you actually need, so you can
+// tune TEMPORARY_STORAGE_SIZE (or Thread.temporary_storage_size) from real data.
+typedef struct Temporary_Storage_Block Temporary_Storage_Block;
+typedef struct Temporary_Storage_Block {
+	Temporary_Storage_Block *next;
+	u64 size; // Excluding this header
+	u64 used;
+} Temporary_Storage_Block;
+
+ogb_instance void* talloc(u64);
+ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
+
+// #Global
+ogb_instance Allocator 
+get_temporary_allocator();
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local Temporary_Storage_Block * temporary_storage = 0;
+thread_local Temporary_Storage_Block * temporary_storage_current = 0;
+thread_local u64  temporary_storage_high_water_mark = 0;
+thread_local bool has_warned_temporary_storage_overflow = false;
+// So the last allocation can be resized in place
+thread_local void * temporary_storage_last_allocation = 0;
+thread_local Allocator temp_allocator;
+
+ogb_instance Allocator 
+get_temporary_allocator() {
+	return temp_allocator;
+}
+#endif
+
+ogb_instance void* 
+temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+
+ogb_instance void 
+temporary_storage_init(u64 arena_size);
+
+ogb_instance void 
+temporary_storage_destroy();
+
+ogb_instance void* 
+talloc(u64 size);
+
+ogb_instance void* 
+talloc_aligned(u64 size, u64 alignment);
+
+ogb_instance void 
+reset_temporary_storage();
+
+// Most bytes used in temporary storage between two resets on this thread
+ogb_instance u64 
+get_temporary_storage_high_water_mark();
+
+// A whole temporary storage, so a thread's can be swapped for another one. The job system
+// gives each fiber its own so talloc'd memory stays valid when a job moves to another thread.
+typedef struct Temporary_Storage_State {
+	Temporary_Storage_Block *first;
+	Temporary_Storage_Block *current;
+	u64 high_water_mark;
+	void *last_allocation;
+} Temporary_Storage_State;
+
+ogb_instance void 
+temporary_storage_state_init(Temporary_Storage_State *state, u64 arena_size);
+
+ogb_instance void 
+temporary_storage_state_destroy(Temporary_Storage_State *state);
+
+// Swaps the calling thread's temporary storage with *state
+ogb_instance void 
+temporary_storage_swap(Temporary_Storage_State *state);
+
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return talloc(size);
+			break;
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			if (!p) return talloc(size);
+			
+			// Only the last allocation can be resized. Otherwise return 0 so reallocate()
+			// falls back to copying.
+			Temporary_Storage_Block *block = temporary_storage_current;
+			u64 offset = (u64)p - (u64)(block+1);
+			if (p == temporary_storage_last_allocation && offset + size <= block->size) {
+				block->used = offset + size;
+				return p;
+			}
+			return 0;
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return talloc_aligned(size, (u64)p);
+		}
+	}
+	return 0;
+}
+
+Temporary_Storage_Block *temporary_storage_make_block(u64 size) {
+	Temporary_Storage_Block *block = (Temporary_Storage_Block*)heap_alloc(sizeof(Temporary_Storage_Block) + size);
+	assert(block, "Failed allocating temporary storage");
+	block->next = 0;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+void temporary_storage_init(u64 arena_size) {
+	
+	temporary_storage = temporary_storage_make_block(arena_size);
+	temporary_storage_current = temporary_storage;
+	temporary_storage_high_water_mark = 0;
+
+	temp_allocator.proc = temp_allocator_proc;
+	temp_allocator.data = 0;
+}
+
+void temporary_storage_destroy() {
+	Temporary_Storage_Block *block = temporary_storage;
+	while (block) {
+		Temporary_Storage_Block *next = block->next;
+		heap_dealloc(block);
+		block = next;
+	}
+	temporary_storage = 0;
+	temporary_storage_current = 0;
+}
+
+void* talloc(u64 size) {
+	
+	Temporary_Storage_Block *block = temporary_storage_current;
+	
+	if (block->used + size > block->size) {
+		
+		// Blocks chained on in an earlier frame are kept until a reset where they went unused
+		while (block->next && size > block->next->size) {
+			Temporary_Storage_Block *too_small = block->next;
+			block->next = too_small->next;
+			heap_dealloc(too_small);
+		}
+		
+		if (!block->next) {
+			if (!has_warned_temporary_storage_overflow) {
+				os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, chaining more blocks. Consider a bigger TEMPORARY_STORAGE_SIZE, see get_temporary_storage_high_water_mark().\n"));
+				has_warned_temporary_storage_overflow = true;
+			}
+			block->next = temporary_storage_make_block(max(size, temporary_storage->size));
+		}
+		
+		block = block->next;
+		block->used = 0;
+		temporary_storage_current = block;
+	}
+	
+	void* p = (u8*)(block+1) + block->used;
+	block->used += size;
+	temporary_storage_last_allocation = p;
+	
+	return p;
+}
+
+void* talloc_aligned(u64 size, u64 alignment) {
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	
+	Temporary_Storage_Block *block = temporary_storage_current;
+	u8 *next = (u8*)(block+1) + block->used;
+	u64 padding = align_next(next, alignment) - (u64)next;
+	if (block->used + padding + size <= block->size) {
+		block->used += padding;
+		return talloc(size);
+	}
+	
+	// Goes in another block, so leave room to align it there
+	u8 *p = (u8*)talloc(size + alignment - 1);
+	u8 *aligned = (u8*)align_next(p, alignment);
+	temporary_storage_last_allocation = aligned;
+	return aligned;
+}
+
+u64 temporary_storage_get_used() {
+	u64 used = 0;
+	for (Temporary_Storage_Block *block = temporary_storage; block; block = block->next) {
+		used += block->used;
+		if (block == temporary_storage_current) break;
+	}
+	return used;
+}
+
+void reset_temporary_storage() {
+	
+	temporary_storage_high_water_mark = max(temporary_storage_high_water_mark, temporary_storage_get_used());
+	
+	// Trim the blocks this frame didn't get to
+	Temporary_Storage_Block *unused = temporary_storage_current->next;
+	temporary_storage_current->next = 0;
+	while (unused) {
+		Temporary_Storage_Block *next = unused->next;
+		heap_dealloc(unused);
+		unused = next;
+	}
+	
+	temporary_storage_current = temporary_storage;
+	temporary_storage->used = 0;
+	temporary_storage_last_allocation = 0;
+}
+
+u64 get_temporary_storage_high_water_mark() {
+	return max(temporary_storage_high_water_mark, temporary_storage_get_used());
+}
+
+void temporary_storage_state_init(Temporary_Storage_State *state, u64 arena_size) {
+	state->first = temporary_storage_make_block(arena_size);
+	state->current = state->first;
+	state->high_water_mark = 0;
+	state->last_allocation = 0;
+}
+void temporary_storage_state_destroy(Temporary_Storage_State *state) {
+	Temporary_Storage_Block *block = state->first;
+	while (block) {
+		Temporary_Storage_Block *next = block->next;
+		heap_dealloc(block);
+		block = next;
+	}
+	*state = ZERO(Temporary_Storage_State);
+}
+
+void temporary_storage_swap(Temporary_Storage_State *state) {
+	Temporary_Storage_State thread_state = {
+		temporary_storage,
+		temporary_storage_current,
+		temporary_storage_high_water_mark,
+		temporary_storage_last_allocation,
+	};
+	temporary_storage = state->first;
+	temporary_storage_current = state->current;
+	temporary_storage_high_water_mark = state->high_water_mark;
+	temporary_storage_last_allocation = state->last_allocation;
+	*state = thread_state;
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+///
+///
+// Arena
+///
+// Linear allocator on its own range of reserved address space. Pages are committed as the
+// arena grows, so it's fine to reserve way more than you will ever use.
+// Nothing is freed individually. Use arena_pos() and arena_pop_to() to free everything
+// pushed after a certain point:
+//
+//     u64 pos = arena_pos(arena);
+//     do_stuff_with(arena);
+//     arena_pop_to(arena, pos);
+//
+
+#define ARENA_DEFAULT_RESERVE_SIZE GB(1)
+#define ARENA_COMMIT_SIZE KB(64)
+#define ARENA_ALIGNMENT 16
+
+typedef struct Arena {
+	u64 pos;
+	u64 committed;
+	u64 reserved;
+	// So we can grow the last allocation in place on realloc
+	u64 last_allocation_pos;
+} Arena;
+
+// The Arena itself lives at the start of its reserved memory
+#define ARENA_HEADER_SIZE align_next(sizeof(Arena), ARENA_ALIGNMENT)
+
+Arena *arena_make(u64 reserve_size) {
+	reserve_size = align_next(max(reserve_size, ARENA_COMMIT_SIZE), os.page_size);
+	
+	Arena *arena = (Arena*)os_reserve_memory(reserve_size);
+	os_commit_memory_pages(arena, ARENA_COMMIT_SIZE);
+	
+	arena->pos = ARENA_HEADER_SIZE;
+	arena->committed = ARENA_COMMIT_SIZE;
+	arena->reserved = reserve_size;
+	arena->last_allocation_pos = arena->pos;
+	
+	return arena;
+}
+void arena_destroy(Arena *arena) {
+	os_release_memory(arena, arena->reserved);
+}
+
+// Makes sure everything up to pos is committed
+void arena_commit_to(Arena *arena, u64 pos) {
+	if (pos <= arena->committed) return;
+	
+	assert(pos <= arena->reserved, "Arena is out of reserved memory (%llu bytes). Make it with a bigger reserve_size.", arena->reserved);
+	
+	u64 new_committed = min(align_next(pos, ARENA_COMMIT_SIZE), arena->reserved);
+	os_commit_memory_pages((u8*)arena + arena->committed, new_committed - arena->committed);
+	arena->committed = new_committed;
+}
+
+// The arena itself is page aligned so aligning the position aligns the pointer.
+void *arena_push_aligned_uninitialized(Arena *arena, u64 size, u64 alignment) {
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	u64 start = align_next(arena->pos, max(alignment, ARENA_ALIGNMENT));
+	u64 end = start + size;
+	
+	arena_commit_to(arena, end);
+	
+	arena->pos = end;
+	arena->last_allocation_pos = start;
+	return (u8*)arena + start;
+}
+void *arena_push_uninitialized(Arena *arena, u64 size) {
+	return arena_push_aligned_uninitialized(arena, size, ARENA_ALIGNMENT);
+}
+void *arena_push(Arena *arena, u64 size) {
+	void *p = arena_push_uninitialized(arena, size);
+#if DO_ZERO_INITIALIZATION
+	memset(p, 0, size);
+#endif
+	return p;
+}
+
+u64 arena_pos(Arena *arena) {
+	return arena->pos;
+}
+void arena_pop_to(Arena *arena, u64 pos) {
+	pos = max(pos, ARENA_HEADER_SIZE);
+	assert(pos <= arena->pos, "arena_pop_to: pos is ahead of the arena. Did you mix up positions of different arenas?");
+	
+#if CONFIGURATION == DEBUG
+	memset((u8*)arena + pos, 0x69, arena->pos - pos);
+#endif
+	
+	arena->pos = pos;
+	arena->last_allocation_pos = min(arena->last_allocation_pos, pos);
+}
+void arena_reset(Arena *arena) {
+	arena_pop_to(arena, ARENA_HEADER_SIZE);
+}
+
+void *arena_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
+	Arena *arena = (Arena*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return arena_push_uninitialized(arena, size);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			if (!p) return arena_push_uninitialized(arena, size);
+			
+			u64 p_pos = (u64)p - (u64)arena;
+			assert(p_pos >= ARENA_HEADER_SIZE && p_pos <= arena->pos, "Pointer passed to arena reallocate is not in the arena");
+			
+			if (p_pos == arena->last_allocation_pos) {
+				// Last thing we pushed, so we can just move the end
+				arena_commit_to(arena, p_pos + size);
+				arena->pos = p_pos + size;
+				return p;
+			}
+			
+			// We don't know the old size, but it can't be more than what's after p
+			u64 old_size_max = arena->pos - p_pos;
+			void *new = arena_push_uninitialized(arena, size);
+			memcpy(new, p, min(size, old_size_max));
+			return new;
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return arena_push_aligned_uninitialized(arena, size, (u64)p);
+		}
+	}
+	return 0;
+}
+Allocator get_arena_allocator(Arena *arena) {
+	Allocator a;
+	a.proc = arena_allocator_proc;
+	a.data = arena;
+	return a;
+}
+
+///
+// Scratch arenas
+// Each thread has SCRATCH_ARENA_COUNT of these for temporary work which is popped when done.
+// If a function gets an arena to push results on, that arena might be one of the scratch
+// arenas of the thread, so ask for a scratch arena that isn't that one:
+//
+//     String make_thing(Arena *result_arena) {
+//         Arena *scratch = get_scratch_arena(result_arena);
+//         u64 scratch_pos = arena_pos(scratch);
+//         ... work on scratch, push the result on result_arena ...
+//         arena_pop_to(scratch, scratch_pos);
+//     }
+//
+
+#define SCRATCH_ARENA_COUNT 2
+#ifndef SCRATCH_ARENA_RESERVE_SIZE
+	#define SCRATCH_ARENA_RESERVE_SIZE GB(1)
+#endif
+
+thread_local Arena *scratch_arenas[SCRATCH_ARENA_COUNT] = {0};
+
+Arena *get_scratch_arena(Arena *not_this) {
+	for (u64 i = 0; i < SCRATCH_ARENA_COUNT; i++) {
+		if (!scratch_arenas[i]) scratch_arenas[i] = arena_make(SCRATCH_ARENA_RESERVE_SIZE);
+		if (scratch_arenas[i] != not_this) return scratch_arenas[i];
+	}
+	panic("Unreachable");
+	return 0;
+}
+
+// Called when a thread exits
+void scratch_arenas_destroy() {
+	for (u64 i = 0; i < SCRATCH_ARENA_COUNT; i++) {
+		if (scratch_arenas[i]) arena_destroy(scratch_arenas[i]);
+		scratch_arenas[i] = 0;
+	}
+}
+
+///
+///
+// Frame storage
+///
+// Like temporary storage, but what's allocated on frame N stays valid until the end of
+// frame N+1. It's two arenas which take turns: reset_frame_storage() frees the older one
+// and starts allocating on it, so the previous frame's allocations are left alone.
+// Call reset_frame_storage() once per frame, next to reset_temporary_storage().
+//
+//     Interpolation_Data *d = falloc(sizeof(Interpolation_Data)); // Frame N
+//     reset_frame_storage();
+//     use(d);                                                     // Frame N+1, still valid
+//     reset_frame_storage();
+//     // d is gone now
+//
+// Arenas grow as needed so nothing is ever overwritten while in use, but we warn once if a
+// frame goes over FRAME_STORAGE_SIZE so you know to look at get_frame_storage_high_water_mark().
+
+#ifndef FRAME_STORAGE_SIZE
+	#define FRAME_STORAGE_SIZE MB(4)
+#endif
+#ifndef FRAME_STORAGE_RESERVE_SIZE
+	#define FRAME_STORAGE_RESERVE_SIZE GB(1)
+#endif
+
+thread_local Arena *frame_storage_arenas[2] = {0};
+// Index of the arena for this frame
+thread_local u64  frame_storage_current = 0;
+thread_local u64  frame_storage_high_water_mark = 0;
+thread_local bool has_warned_frame_storage_overflow = false;
+
+Arena *get_frame_storage_arena() {
+	if (!frame_storage_arenas[frame_storage_current]) {
+		frame_storage_arenas[frame_storage_current] = arena_make(FRAME_STORAGE_RESERVE_SIZE);
+	}
+	return frame_storage_arenas[frame_storage_current];
+}
+
+u64 get_frame_storage_used() {
+	Arena *arena = frame_storage_arenas[frame_storage_current];
+	if (!arena) return 0;
+	return arena_pos(arena) - ARENA_HEADER_SIZE;
+}
+
+void *falloc_aligned(u64 size, u64 alignment) {
+	Arena *arena = get_frame_storage_arena();
+	void *p = arena_push_aligned_uninitialized(arena, size, alignment);
+	
+	if (!has_warned_frame_storage_overflow && get_frame_storage_used() > FRAME_STORAGE_SIZE) {
+		os_write_string_to_stdout(STR("WARNING: frame storage went over FRAME_STORAGE_SIZE this frame. Nothing is overwritten, but consider a bigger FRAME_STORAGE_SIZE, see get_frame_storage_high_water_mark().\n"));
+		has_warned_frame_storage_overflow = true;
+	}
+	
+	return p;
+}
+void *falloc(u64 size) {
+	return falloc_aligned(size, ARENA_ALIGNMENT);
+}
+
+void reset_frame_storage() {
+	frame_storage_high_water_mark = max(frame_storage_high_water_mark, get_frame_storage_used());
+	
+	// The older generation becomes the current one, the one we just used is left alone
+	frame_storage_current = (frame_storage_current+1) % 2;
+	Arena *arena = frame_storage_arenas[frame_storage_current];
+	if (arena) arena_reset(arena);
+}
+
+// Most bytes allocated in one frame on this thread
+u64 get_frame_storage_high_water_mark() {
+	return max(frame_storage_high_water_mark, get_frame_storage_used());
+}
+
+void *frame_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
+	if (message == ALLOCATOR_ALLOCATE) return falloc(size);
+	if (message == ALLOCATOR_ALLOCATE_ALIGNED) return falloc_aligned(size, (u64)p);
+	if (message == ALLOCATOR_REALLOCATE && p) {
+		Arena *arena = get_frame_storage_arena();
+		// p was allocated in the previous frame so it's not in the current arena.
+		// Returning 0 makes reallocate() allocate a new block and copy old_size bytes.
+		if ((u8*)p < (u8*)arena + ARENA_HEADER_SIZE || (u8*)p > (u8*)arena + arena->pos) return 0;
+	}
+	// Otherwise it's the same as an arena allocator on the current frame arena
+	return arena_allocator_proc(size, p, message, get_frame_storage_arena());
+}
+Allocator get_frame_allocator() {
+	Allocator a;
+	a.proc = frame_allocator_proc;
+	a.data = 0;
+	return a;
+}
+
+// Called when a thread exits
+void frame_storage_destroy() {
+	for (u64 i = 0; i < 2; i++) {
+		if (frame_storage_arenas[i]) arena_destroy(frame_storage_arenas[i]);
+		frame_storage_arenas[i] = 0;
+	}
+}
+
+///
+///
+// Pool
+///
+// Fixed size items which never move once allocated.
+// Items live in chunks of pages on the pool's own arena. Each chunk starts with a bitmap of
+// which items are live, so iterating all live items doesn't have to touch free ones.
+// Freed items are kept in an intrusive free list so alloc & free are O(1).
+//
+//     Pool pool;
+//     pool_init(&pool, Entity);
+//
+//     Entity *e = pool_alloc(&pool);
+//     pool_free(&pool, e);
+//
+//     Pool_Iterator it = pool_iterate(&pool);
+//     while (pool_iterator_next(&it)) {
+//         Entity *e = (Entity*)it.item;
+//     }
+//
+//     pool_deinit(&pool);
+//
+
+#define POOL_CHUNK_SIZE KB(64)
+#define POOL_DEFAULT_RESERVE_SIZE GB(1)
+
+typedef struct Pool {
+	Arena *arena;
+	u8 *first_chunk;
+	
+	u64 item_size;
+	u64 alignment;
+	u64 stride;
+	u64 items_per_chunk;
+	u64 chunk_size;
+	u64 bitmap_size;
+	u64 chunk_count;
+	
+	// Items at and after this index have never been handed out
+	u64 next_unused_index;
+	void *free_head;
+	
+	u64 count;
+} Pool;
+
+#define pool_init(pool_ptr, Item_Type) pool_init_raw((pool_ptr), sizeof(Item_Type), 0, POOL_DEFAULT_RESERVE_SIZE)
+#define pool_init_reserve(pool_ptr, Item_Type, reserve_size) pool_init_raw((pool_ptr), sizeof(Item_Type), 0, (reserve_size))
+// Every item is aligned to alignment, for example 64 to keep items on their own cache lines
+#define pool_init_aligned(pool_ptr, Item_Type, alignment) pool_init_raw((pool_ptr), sizeof(Item_Type), (alignment), POOL_DEFAULT_RESERVE_SIZE)
+
+// alignment 0 means items are aligned to pointer size
+void pool_init_raw(Pool *pool, u64 item_size, u64 alignment, u64 reserve_size) {
+	memset(pool, 0, sizeof(Pool));
+	
+	alignment = max(alignment, sizeof(void*));
+	assert((alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	assert(alignment <= POOL_CHUNK_SIZE, "Pool alignment can't be more than POOL_CHUNK_SIZE");
+	
+	pool->item_size = item_size;
+	pool->alignment = alignment;
+	// Free items hold the free list pointer
+	pool->stride = align_next(max(item_size, sizeof(void*)), alignment);
+	
+	// As many items as fit in a chunk, in multiples of 64 so the bitmap is whole u64s.
+	// Big items get bigger chunks so there's at least 64 per chunk.
+	u64 bitmap_alignment = max(alignment, 16);
+	u64 chunk_size = POOL_CHUNK_SIZE;
+	u64 items_per_chunk = (chunk_size / pool->stride) & ~63ULL;
+	while (items_per_chunk >= 64 && align_next(items_per_chunk/8, bitmap_alignment) + items_per_chunk*pool->stride > chunk_size) {
+		items_per_chunk -= 64;
+	}
+	if (items_per_chunk < 64) {
+		items_per_chunk = 64;
+		chunk_size = align_next(align_next(items_per_chunk/8, bitmap_alignment) + items_per_chunk*pool->stride, max(os.page_size, alignment));
+	}
+	
+	pool->items_per_chunk = items_per_chunk;
+	pool->chunk_size = chunk_size;
+	pool->bitmap_size = align_next(items_per_chunk/8, bitmap_alignment);
+	
+	// Chunks are pushed right after each other from here, so they all stay aligned
+	pool->arena = arena_make(reserve_size);
+	arena_push_aligned_uninitialized(pool->arena, 0, alignment);
+	pool->first_chunk = (u8*)pool->arena + arena_pos(pool->arena);
+}
+void pool_deinit(Pool *pool) {
+	arena_destroy(pool->arena);
+	memset(pool, 0, sizeof(Pool));
+}
+
+inline u64 *pool_get_bitmap(Pool *pool, u64 chunk_index) {
+	return (u64*)(pool->first_chunk + chunk_index*pool->chunk_size);
+}
+inline void *pool_get_item(Pool *pool, u64 index) {
+	u64 chunk_index = index / pool->items_per_chunk;
+	u64 index_in_chunk = index % pool->items_per_chunk;
+	return pool->first_chunk + chunk_index*pool->chunk_size + pool->bitmap_size + index_in_chunk*pool->stride;
+}
+inline u64 pool_get_index(Pool *pool, void *item) {
+	u64 offset = (u64)item - (u64)pool->first_chunk;
+	u64 chunk_index = offset / pool->chunk_size;
+	u64 offset_in_chunk = offset % pool->chunk_size;
+	assert((u8*)item >= pool->first_chunk && chunk_index < pool->chunk_count, "Pointer is not in this pool");
+	assert(offset_in_chunk >= pool->bitmap_size && (offset_in_chunk-pool->bitmap_size) % pool->stride == 0, "Pointer is not to the start of a pool item");
+	return chunk_index*pool->items_per_chunk + (offset_in_chunk-pool->bitmap_size)/pool->stride;
+}
+
+void *pool_alloc_uninitialized(Pool *pool) {
+	void *item;
+	if (pool->free_head) {
+		item = pool->free_head;
+		pool->free_head = *(void**)item;
+	} else {
+		if (pool->next_unused_index == pool->chunk_count*pool->items_per_chunk) {
+			u8 *chunk = (u8*)arena_push_uninitialized(pool->arena, pool->chunk_size);
+			assert(chunk == pool->first_chunk + pool->chunk_count*pool->chunk_size, "Internal pool error: chunks are not contiguous");
+			memset(chunk, 0, pool->bitmap_size);
+			pool->chunk_count += 1;
+		}
+		item = pool_get_item(pool, pool->next_unused_index);
+		pool->next_unused_index += 1;
+	}
+	
+	u64 index = pool_get_index(pool, item);
+	u64 *bitmap = pool_get_bitmap(pool, index / pool->items_per_chunk);
+	u64 index_in_chunk = index % pool->items_per_chunk;
+	bitmap[index_in_chunk/64] |= 1ULL << (index_in_chunk%64);
+	
+	pool->count += 1;
+	
+	return item;
+}
+void *pool_alloc(Pool *pool) {
+	void *item = pool_alloc_uninitialized(pool);
+#if DO_ZERO_INITIALIZATION
+	memset(item, 0, pool->item_size);
+#endif
+	return item;
+}
+
+void pool_free(Pool *pool, void *item) {
+	u64 index = pool_get_index(pool, item);
+	u64 *bitmap = pool_get_bitmap(pool, index / pool->items_per_chunk);
+	u64 index_in_chunk = index % pool->items_per_chunk;
+	u64 bit = 1ULL << (index_in_chunk%64);
+	assert(bitmap[index_in_chunk/64] & bit, "Pool item was freed twice or never allocated");
+	bitmap[index_in_chunk/64] &= ~bit;
+	
+#if CONFIGURATION == DEBUG
+	memset(item, 0x69, pool->stride);
+#endif
+	
+	*(void**)item = pool->free_head;
+	pool->free_head = item;
+	
+	pool->count -= 1;
+}
+
+bool pool_is_live(Pool *pool, void *item) {
+	u64 index = pool_get_index(pool, item);
+	u64 *bitmap = pool_get_bitmap(pool, index / pool->items_per_chunk);
+	u64 index_in_chunk = index % pool->items_per_chunk;
+	return (bitmap[index_in_chunk/64] & (1ULL << (index_in_chunk%64))) != 0;
+}
+
+typedef struct Pool_Iterator {
+	Pool *pool;
+	void *item;
+	
+	u64 chunk_index;
+	u64 word_index;
+	// Live bits of the current word we haven't visited yet
+	u64 word;
+} Pool_Iterator;
+
+Pool_Iterator pool_iterate(Pool *pool) {
+	Pool_Iterator it = ZERO(Pool_Iterator);
+	it.pool = pool;
+	if (pool->chunk_count) it.word = pool_get_bitmap(pool, 0)[0];
+	return it;
+}
+// Moves it.item to the next live item. Returns false when there are no more.
+bool pool_iterator_next(Pool_Iterator *it) {
+	Pool *pool = it->pool;
+	u64 words_per_chunk = pool->items_per_chunk/64;
+	while (!it->word) {
+		it->word_index += 1;
+		if (it->word_index == words_per_chunk) {
+			it->word_index = 0;
+			it->chunk_index += 1;
+		}
+		if (it->chunk_index >= pool->chunk_count) {
+			it->item = 0;
+			return false;
+		}
+		it->word = pool_get_bitmap(pool, it->chunk_index)[it->word_index];
+	}
+	
+	u64 index_in_chunk = it->word_index*64 + bit_scan_forward_64(it->word);
+	it->word &= it->word - 1;
+	
+	it->item = pool->first_chunk + it->chunk_index*pool->chunk_size + pool->bitmap_size + index_in_chunk*pool->stride;
+	return true;
+}
+
+// Frees all items but keeps the memory
+void pool_reset(Pool *pool) {
+	for (u64 i = 0; i < pool->chunk_count; i++) {
+		memset(pool_get_bitmap(pool, i), 0, pool->bitmap_size);
+	}
+	pool->next_unused_index = 0;
+	pool->free_head = 0;
+	pool->count = 0;
+}
+
+// Allocations through this must be no bigger than the pool item size
+void *pool_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
+	Pool *pool = (Pool*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			assert(size <= pool->item_size, "Pool allocator can't allocate %llu bytes, pool items are %llu bytes", size, pool->item_size);
+			return pool_alloc_uninitialized(pool);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			pool_free(pool, p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			assert(size <= pool->item_size, "Pool allocator can't reallocate to %llu bytes, pool items are %llu bytes", size, pool->item_size);
+			if (!p) return pool_alloc_uninitialized(pool);
+			return p;
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			assert(size <= pool->item_size, "Pool allocator can't allocate %llu bytes, pool items are %llu bytes", size, pool->item_size);
+			assert((u64)p <= pool->alignment, "Pool items are aligned to %llu, make the pool with pool_init_aligned() to get %llu", pool->alignment, (u64)p);
+			return pool_alloc_uninitialized(pool);
+		}
+	}
+	return 0;
+}
+Allocator get_pool_allocator(Pool *pool) {
+	Allocator a;
+	a.proc = pool_allocator_proc;
+	a.data = pool;
+	return a;
+}
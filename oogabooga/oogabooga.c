@@ -102,6 +102,23 @@
 					tm_scope_var
 					tm_scope_accum
 					
+		- GUARD_PAGE_ALLOCATIONS
+			Give every heap allocation its own pages with an inaccessible page right after it,
+			and make freed pages inaccessible. Buffer overruns and use after free then crash
+			right at the instruction that does it, instead of at some later alloc/dealloc.
+			
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define GUARD_PAGE_ALLOCATIONS 1
+				
+			Note:
+				Only for hunting memory bugs. Every allocation takes at least 2 pages and freed
+				address space is never reused.
+				Allocations are aligned to 16 bytes so overruns of less than that may not crash.
+					
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
             Useful if you only need the oogabooga standard library for something like a game server.
@@ -112,6 +129,26 @@
             Example:
             
                 #define OOGABOOGA_HEADLESS 1
+                
+            Note:
+                Headless builds can still draw with the software renderer (see GFX_RENDERER), they
+                just don't get a window. That's how the drawing code is tested on Linux.
+                
+		- GFX_RENDERER
+			Which renderer to use. Defaults to GFX_RENDERER_D3D11 on windows and
+			GFX_RENDERER_SOFTWARE elsewhere.
+			
+			GFX_RENDERER_D3D11:    Direct3D 11
+			GFX_RENDERER_SOFTWARE: Draws on the CPU into software_framebuffer, which you can save
+			                       to a png. Doesn't need a GPU or a window.
+			
+			Example:
+			
+				#define GFX_RENDERER GFX_RENDERER_SOFTWARE
+				
+			Note:
+				In a headless build, graphics are only compiled in if you define this to
+				GFX_RENDERER_SOFTWARE yourself.
 		
 
 */
@@ -122,9 +159,17 @@
 
 #define OGB_VERSION (OGB_VERSION_MAJOR*1000000+OGB_VERSION_MINOR*1000+OGB_VERSION_PATCH)
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	// Needs to be defined before any system header is included so we get
+	// pthread_getattr_np, syscall() etc.
+	#define _GNU_SOURCE
+#endif
+
 #include <math.h>
 #include <immintrin.h>
-#include <intrin.h>
+#ifdef _WIN32
+	#include <intrin.h>
+#endif
 #include <stdint.h>
 
 typedef uint8_t  u8;
@@ -152,6 +197,7 @@ typedef f64 float64;
 
 #define F32_MAX 3.402823466e+38F
 #define F32_MIN 1.175494351e-38F
+#define U16_MAX 65535
 
 typedef u8 bool;
 #define false 0
@@ -197,6 +243,10 @@ typedef u8 bool;
 	#define ENABLE_SIMD 1
 #endif
 
+#ifndef GUARD_PAGE_ALLOCATIONS
+	#define GUARD_PAGE_ALLOCATIONS 0
+#endif
+
 #ifndef INITIAL_PROGRAM_MEMORY_SIZE
     #define INITIAL_PROGRAM_MEMORY_SIZE MB(5)
 #endif
@@ -236,9 +286,21 @@ typedef u8 bool;
 	#define TARGET_OS WINDOWS
 	#define OS_PATHS_HAVE_BACKSLASH 1
 #elif defined(__linux__)
-	// Include whatever #Incomplete #Portability
+	#ifndef OOGABOOGA_HEADLESS
+		#error "Linux is only supported for headless builds (#define OOGABOOGA_HEADLESS 1)"
+	#endif
+	#include <stddef.h>
+	#include <stdarg.h>
+	#include <string.h>
+	#include <limits.h>
+	#include <unistd.h>
+	#include <pthread.h>
+	// Windows-isms that leak into platform independent code
+	#define __cdecl
+	#define _In_
+	#define max(a, b) ((a) > (b) ? (a) : (b))
+	#define min(a, b) ((a) < (b) ? (a) : (b))
 	#define TARGET_OS LINUX
-	#error "Linux is not supported yet";
 	#define OS_PATHS_HAVE_BACKSLASH 0
 #elif defined(__APPLE__) && defined(__MACH__)
 	// Include whatever #Incomplete #Portability
@@ -263,17 +325,24 @@ typedef u8 bool;
 
 #include "simd.c"        
 
-// #Incomplete
-// We might want to make this configurable ?
-#define GFX_RENDERER_D3D11  0
-#define GFX_RENDERER_VULKAN 1
-#define GFX_RENDERER_METAL  2
+#define GFX_RENDERER_D3D11    0
+#define GFX_RENDERER_VULKAN   1
+#define GFX_RENDERER_METAL    2
+#define GFX_RENDERER_SOFTWARE 3
+
+// Headless only gets graphics if it explicitly asked for the software renderer
+#if !defined(OOGABOOGA_HEADLESS) || (defined(GFX_RENDERER) && GFX_RENDERER == GFX_RENDERER_SOFTWARE)
+	#define OOGABOOGA_HAS_GFX 1
+#else
+	#define OOGABOOGA_HAS_GFX 0
+#endif
+
 #ifndef GFX_RENDERER
 // #Portability
 	#if TARGET_OS == WINDOWS
 		#define GFX_RENDERER GFX_RENDERER_D3D11
 	#elif TARGET_OS == LINUX
-		#define GFX_RENDERER GFX_RENDERER_VULKAN
+		#define GFX_RENDERER GFX_RENDERER_SOFTWARE
 	#elif TARGET_OS == MACOS
 		#define GFX_RENDERER GFX_RENDERER_METAL
 	#endif
@@ -311,16 +380,19 @@ typedef u8 bool;
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "jobs.c"
 #include "input.c"
 
-#ifndef OOGABOOGA_HEADLESS
+#if OOGABOOGA_HAS_GFX
 
     #include "gfx_interface.c"
 
     #include "font.c"
 
     #include "drawing.c"
+#endif
 
+#ifndef OOGABOOGA_HEADLESS
     #include "audio.c"
 #endif
 
@@ -336,10 +408,12 @@ typedef u8 bool;
     	#error "Current OS is not supported"
     #endif
 
-    #ifndef OOGABOOGA_HEADLESS
+    #if OOGABOOGA_HAS_GFX
         // #Portability
         #if GFX_RENDERER == GFX_RENDERER_D3D11
             #include "gfx_impl_d3d11.c"
+        #elif GFX_RENDERER == GFX_RENDERER_SOFTWARE
+            #include "gfx_impl_software.c"
         #elif GFX_RENDERER == GFX_RENDERER_VULKAN
             #error "We only have a D3D11 renderer at the moment"
         #elif GFX_RENDERER == GFX_RENDERER_METAL
@@ -387,10 +461,11 @@ void oogabooga_init(u64 program_memory_size) {
 	heap_init();
 	temporary_storage_init(TEMPORARY_STORAGE_SIZE);
 	log_info("Ooga booga version is %d.%02d.%03d", OGB_VERSION_MAJOR, OGB_VERSION_MINOR, OGB_VERSION_PATCH);
-#ifndef OOGABOOGA_HEADLESS
-	gfx_init();
-#else
+#ifdef OOGABOOGA_HEADLESS
     log_info("Headless mode on");
+#endif
+#if OOGABOOGA_HAS_GFX
+	gfx_init();
 #endif
 	log_verbose("CPU has sse1:   %cs", features.sse1 ? "true" : "false");
 	log_verbose("CPU has sse2:   %cs", features.sse2 ? "true" : "false");
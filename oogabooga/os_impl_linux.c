@@ -0,0 +1,997 @@
+
+// #Incomplete #Portability
+// Only headless builds are supported on Linux for now. That means no window, no
+// graphics and no audio, but the rest of the standard library (memory, threading,
+// files, profiling, tests) should behave the same as on Windows.
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <linux/futex.h>
+
+#define VIRTUAL_MEMORY_BASE ((void*)0x0000690000000000ULL)
+
+// We reserve (but don't commit) this much address space up front so that program
+// memory can keep growing contiguously like it does on windows.
+#ifndef LINUX_PROGRAM_MEMORY_RESERVE_SIZE
+	#define LINUX_PROGRAM_MEMORY_RESERVE_SIZE GB(64)
+#endif
+
+void* heap_alloc(u64);
+void heap_dealloc(void*);
+
+// Linker provided symbols
+extern char __executable_start;
+extern char _end;
+
+u64 linux_get_thread_id() {
+	return (u64)syscall(SYS_gettid);
+}
+
+long linux_futex(volatile u32 *addr, int op, u32 val, const struct timespec *timeout) {
+	return syscall(SYS_futex, (u32*)addr, op, val, timeout, 0, 0);
+}
+void linux_futex_wait(volatile u32 *addr, u32 expected) {
+	linux_futex(addr, FUTEX_WAIT_PRIVATE, expected, 0);
+}
+void linux_futex_wake(volatile u32 *addr, u32 count) {
+	linux_futex(addr, FUTEX_WAKE_PRIVATE, count, 0);
+}
+
+void os_init(u64 program_memory_capacity) {
+
+	// #Volatile
+	// Any printing uses vsnprintf, and printing may happen in init,
+	// especially on errors, so this needs to happen first.
+	os.crt = dlopen("libc.so.6", RTLD_NOW | RTLD_LOCAL);
+	assert(os.crt != 0, "Could not load libc.so.6");
+	os.crt_vsnprintf = (Crt_Vsnprintf_Proc)dlsym(os.crt, "vsnprintf");
+	assert(os.crt_vsnprintf, "Missing vsnprintf in crt");
+
+	context.thread_id = linux_get_thread_id();
+
+	os.page_size = (u64)sysconf(_SC_PAGESIZE);
+	// mmap works with page granularity
+	os.granularity = os.page_size;
+
+	os.static_memory_start = &__executable_start;
+	os.static_memory_end = &_end;
+
+	program_memory_mutex = os_make_mutex();
+	os_grow_program_memory(program_memory_capacity);
+
+	heap_init();
+}
+
+
+
+
+///
+///
+// Threading
+///
+
+
+///
+// Thread primitive
+
+void *linux_thread_invoker(void *param) {
+
+	Thread *t = (Thread*)param;
+
+	temporary_storage_init(t->temporary_storage_size);
+
+	context = t->initial_context;
+	context.thread_id = linux_get_thread_id();
+
+	if (t->name.count) os_set_current_thread_name(t->name);
+	// Always applied because linux threads inherit the cpu mask, nice value and SCHED_FIFO of the
+	// thread that started them. A 0 mask is all processors and DEFAULT is SCHED_OTHER at nice 0.
+	os_set_current_thread_affinity(t->affinity_mask);
+	os_set_current_thread_priority(t->priority);
+
+	// os_thread_start waits for this so t->id is valid when it returns
+	*(volatile u64*)&t->id = context.thread_id;
+
+	t->proc(t);
+
+	temporary_storage_destroy();
+	scratch_arenas_destroy();
+	frame_storage_destroy();
+	heap_thread_cache_release();
+
+	return 0;
+}
+
+
+////// DEPRECATED   vvvvvvvvvvvvvvvvv
+Thread* os_make_thread(Thread_Proc proc, Allocator allocator) {
+	Thread *t = (Thread*)alloc(allocator, sizeof(Thread));
+	t->id = 0; // This is set when we start it
+	t->proc = proc;
+	t->initial_context = context;
+	t->allocator = allocator;
+	t->temporary_storage_size = KB(10);
+
+	return t;
+}
+void os_destroy_thread(Thread *t) {
+	os_join_thread(t);
+	dealloc(t->allocator, t);
+}
+void os_start_thread(Thread *t) {
+	os_thread_start(t);
+}
+void os_join_thread(Thread *t) {
+	os_thread_join(t);
+}
+////// DEPRECATED   ^^^^^^^^^^^^^^^^
+
+void os_thread_init(Thread *t, Thread_Proc proc) {
+	memset(t, 0, sizeof(Thread));
+	t->id = 0;
+	t->proc = proc;
+	t->initial_context = context;
+	t->temporary_storage_size = KB(10);
+}
+void os_thread_destroy(Thread *t) {
+	os_thread_join(t);
+}
+void os_thread_start(Thread *t) {
+	t->id = 0;
+	int err = pthread_create(&t->os_handle, 0, linux_thread_invoker, t);
+	assert(err == 0, "Failed creating thread (error %d)", err);
+
+	while (*(volatile u64*)&t->id == 0) {
+		os_yield_thread();
+	}
+}
+void os_thread_join(Thread *t) {
+	// pthread_join twice is undefined, but os_thread_destroy joins as well
+	if (!t->os_handle) return;
+	pthread_join(t->os_handle, 0);
+	t->os_handle = 0;
+}
+
+bool os_set_current_thread_name(string name) {
+	// Linux thread names are at most 15 bytes
+	char buffer[16];
+	u64 count = min(name.count, sizeof(buffer)-1);
+	memcpy(buffer, name.data, count);
+	buffer[count] = 0;
+	return prctl(PR_SET_NAME, buffer, 0, 0, 0) == 0;
+}
+bool os_set_current_thread_affinity(u64 affinity_mask) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (u64 i = 0; i < 64; i++) {
+		if (affinity_mask & (1ULL << i)) CPU_SET(i, &set);
+	}
+	if (affinity_mask == 0) {
+		for (u64 i = 0; i < min(os_get_number_of_logical_processors(), (u64)CPU_SETSIZE); i++) CPU_SET(i, &set);
+	}
+	// 0 is the calling thread (not the process) for sched_setaffinity
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+bool os_set_current_thread_priority(Thread_Priority priority) {
+	// Niceness is per thread on linux when given a thread id
+	int tid = (int)linux_get_thread_id();
+	struct sched_param param = {0};
+	if (priority == THREAD_PRIORITY_CLASS_REALTIME) {
+		param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) return true;
+		// Usually needs root or CAP_SYS_NICE, try the next best thing
+		return setpriority(PRIO_PROCESS, tid, -10) == 0;
+	}
+	
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+	int nice = 0;
+	switch (priority) {
+		case THREAD_PRIORITY_CLASS_DEFAULT:    nice = 0;  break;
+		case THREAD_PRIORITY_CLASS_BACKGROUND: nice = 10; break;
+		case THREAD_PRIORITY_CLASS_HIGH:       nice = -5; break;
+		default: panic("Invalid thread priority %d", priority);
+	}
+	return setpriority(PRIO_PROCESS, tid, nice) == 0;
+}
+
+///
+// Mutex primitive
+// Classic 3-state futex lock (0: unlocked, 1: locked, 2: locked with waiters)
+
+typedef struct Linux_Mutex {
+	volatile u32 state;
+} Linux_Mutex;
+
+Mutex_Handle os_make_mutex() {
+	Linux_Mutex *m;
+	// We make a mutex for program memory before the heap is ready
+	if (heap_initted) m = (Linux_Mutex*)heap_alloc(sizeof(Linux_Mutex));
+	else              m = (Linux_Mutex*)alloc(get_initialization_allocator(), sizeof(Linux_Mutex));
+
+	m->state = 0;
+	return m;
+}
+void os_destroy_mutex(Mutex_Handle m) {
+	if (is_pointer_in_program_memory(m)) heap_dealloc(m);
+}
+void os_lock_mutex(Mutex_Handle m) {
+	u32 c = 0;
+	if (__atomic_compare_exchange_n(&m->state, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return;
+	}
+	if (c != 2) c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		linux_futex_wait(&m->state, 2);
+		c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+	}
+}
+void os_unlock_mutex(Mutex_Handle m) {
+	u32 previous = __atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE);
+	assert(previous != 0, "Unlock mutex 0x%x which was not locked", m);
+	if (previous != 1) {
+		__atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+		linux_futex_wake(&m->state, 1);
+	}
+}
+
+
+///
+// Wait on address
+
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	linux_futex_wait(address, expected);
+}
+void os_wake_one_on_address(volatile u32 *address) {
+	linux_futex_wake(address, 1);
+}
+void os_wake_all_on_address(volatile u32 *address) {
+	linux_futex_wake(address, INT_MAX);
+}
+
+
+void os_sleep(u32 ms) {
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+void os_yield_thread() {
+	sched_yield();
+}
+
+void os_high_precision_sleep(f64 ms) {
+
+	const f64 s = ms/1000.0;
+
+	f64 start = os_get_current_time_in_seconds();
+	f64 end = start + (f64)s;
+	s32 sleep_time = (s32)((end-start)-1.0);
+	bool do_sleep = sleep_time >= 1;
+
+	if (do_sleep)  os_sleep(sleep_time);
+
+	while (os_get_current_time_in_seconds() < end) {
+		os_yield_thread();
+	}
+}
+
+
+///
+///
+// Time
+///
+
+
+u64 os_get_current_cycle_count() {
+	return rdtsc();
+}
+
+float64 os_get_current_time_in_seconds() {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return -1.0;
+	return (float64)ts.tv_sec + (float64)ts.tv_nsec / 1000000000.0;
+}
+
+
+///
+///
+// Dynamic Libraries
+///
+
+Dynamic_Library_Handle os_load_dynamic_library(string path) {
+	return dlopen(temp_convert_to_null_terminated_string(path), RTLD_NOW | RTLD_LOCAL);
+}
+void *os_dynamic_library_load_symbol(Dynamic_Library_Handle l, string identifier) {
+	return dlsym(l, temp_convert_to_null_terminated_string(identifier));
+}
+void os_unload_dynamic_library(Dynamic_Library_Handle l) {
+	dlclose(l);
+}
+
+
+///
+///
+// IO
+///
+
+const File OS_INVALID_FILE = -1;
+void os_write_string_to_stdout(string s) {
+	u64 written = 0;
+	while (written < s.count) {
+		ssize_t result = write(STDOUT_FILENO, s.data+written, s.count-written);
+		if (result <= 0) return;
+		written += result;
+	}
+}
+
+char *linux_temp_path(string path) {
+	char *cpath = temp_convert_to_null_terminated_string(path);
+	for (char *p = cpath; *p; p += 1) {
+		if (*p == '\\') *p = '/';
+	}
+	return cpath;
+}
+
+
+File os_file_open_s(string path, Os_Io_Open_Flags flags) {
+	int oflags = O_RDONLY;
+
+	if (flags & O_WRITE) {
+		oflags = O_RDWR;
+	}
+	if (flags & O_CREATE) {
+		oflags |= O_CREAT | O_TRUNC;
+		if (!(flags & O_WRITE)) oflags = (oflags & ~O_RDONLY) | O_RDWR;
+	}
+
+	return open(linux_temp_path(path), oflags | O_CLOEXEC, 0644);
+}
+
+void os_file_close(File f) {
+	if (f == OS_INVALID_FILE) return;
+	close(f);
+}
+
+bool os_file_delete_s(string path) {
+	return unlink(linux_temp_path(path)) == 0;
+}
+
+bool os_file_copy_s(string from, string to, bool replace_if_exists) {
+	if (!replace_if_exists && os_is_file_s(to)) return false;
+
+	File src = os_file_open_s(from, O_READ);
+	if (src == OS_INVALID_FILE) return false;
+	File dst = os_file_open_s(to, O_WRITE | O_CREATE);
+	if (dst == OS_INVALID_FILE) {
+		os_file_close(src);
+		return false;
+	}
+
+	u8 buffer[KB(64)];
+	bool ok = true;
+	while (true) {
+		u64 read_bytes = 0;
+		if (!os_file_read(src, buffer, sizeof(buffer), &read_bytes)) { ok = false; break; }
+		if (read_bytes == 0) break;
+		if (!os_file_write_bytes(dst, buffer, read_bytes)) { ok = false; break; }
+	}
+
+	os_file_close(src);
+	os_file_close(dst);
+	return ok;
+}
+
+bool os_make_directory_s(string path, bool recursive) {
+	char *cpath = linux_temp_path(path);
+
+	if (recursive) {
+		char *sep = strchr(cpath + 1, '/');
+		while (sep) {
+			*sep = 0;
+			if (mkdir(cpath, 0755) != 0 && errno != EEXIST) {
+				return false;
+			}
+			*sep = '/';
+			sep = strchr(sep + 1, '/');
+		}
+	}
+
+	if (mkdir(cpath, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+
+	return true;
+}
+bool os_delete_directory_s(string path, bool recursive) {
+	char *cpath = linux_temp_path(path);
+
+	if (recursive) {
+		DIR *dir = opendir(cpath);
+		if (!dir) return false;
+
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != 0) {
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+			string child_path = tprint("%cs/%cs", cpath, entry->d_name);
+
+			struct stat st;
+			if (lstat(temp_convert_to_null_terminated_string(child_path), &st) != 0) {
+				closedir(dir);
+				return false;
+			}
+
+			if (S_ISDIR(st.st_mode)) {
+				if (!os_delete_directory_s(child_path, true)) {
+					closedir(dir);
+					return false;
+				}
+			} else {
+				if (!os_file_delete_s(child_path)) {
+					closedir(dir);
+					return false;
+				}
+			}
+		}
+		closedir(dir);
+	}
+
+	return rmdir(cpath) == 0;
+}
+
+bool os_file_write_string(File f, string s) {
+	return os_file_write_bytes(f, s.data, s.count);
+}
+
+bool os_file_write_bytes(File f, void *buffer, u64 size_in_bytes) {
+	u64 written = 0;
+	while (written < size_in_bytes) {
+		ssize_t result = write(f, (u8*)buffer+written, size_in_bytes-written);
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		written += result;
+	}
+	return true;
+}
+
+bool os_file_read(File f, void* buffer, u64 bytes_to_read, u64 *actual_read_bytes) {
+	u64 read_total = 0;
+	bool ok = true;
+	while (read_total < bytes_to_read) {
+		ssize_t result = read(f, (u8*)buffer+read_total, bytes_to_read-read_total);
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			ok = false;
+			break;
+		}
+		if (result == 0) break; // EOF
+		read_total += result;
+	}
+	if (actual_read_bytes) {
+		*actual_read_bytes = read_total;
+	}
+	return ok;
+}
+
+bool os_file_set_pos(File f, s64 pos_in_bytes) {
+	if (pos_in_bytes < 0) return false;
+	return lseek(f, (off_t)pos_in_bytes, SEEK_SET) != (off_t)-1;
+}
+
+s64
+os_file_get_size(File f) {
+	struct stat st;
+	if (fstat(f, &st) != 0) return -1;
+	return (s64)st.st_size;
+}
+
+s64
+os_file_get_size_from_path(string path) {
+	struct stat st;
+	if (stat(linux_temp_path(path), &st) != 0) return -1;
+	return (s64)st.st_size;
+}
+
+s64 os_file_get_pos(File f) {
+	off_t pos = lseek(f, 0, SEEK_CUR);
+	if (pos == (off_t)-1) return (s64)-1;
+	return (s64)pos;
+}
+
+bool os_write_entire_file_handle(File f, string data) {
+	return os_file_write_string(f, data);
+}
+
+bool os_write_entire_file_s(string path, string data) {
+	File file = os_file_open_s(path, O_WRITE | O_CREATE);
+	if (file == OS_INVALID_FILE) {
+		return false;
+	}
+	bool result = os_file_write_string(file, data);
+	os_file_close(file);
+	return result;
+}
+
+bool os_read_entire_file_handle(File f, string *result, Allocator allocator) {
+	s64 file_size = os_file_get_size(f);
+	if (file_size < 0) {
+		return false;
+	}
+
+	u64 actual_read = 0;
+	result->data = (u8*)alloc(allocator, file_size);
+	result->count = file_size;
+
+	bool ok = os_file_read(f, result->data, file_size, &actual_read);
+	if (!ok) {
+		dealloc(allocator, result->data);
+		result->data = 0;
+		return false;
+	}
+
+	return actual_read == (u64)file_size;
+}
+
+bool os_read_entire_file_s(string path, string *result, Allocator allocator) {
+	File file = os_file_open_s(path, O_READ);
+	if (file == OS_INVALID_FILE) {
+		return false;
+	}
+	bool res = os_read_entire_file_handle(file, result, allocator);
+	os_file_close(file);
+	return res;
+}
+
+bool os_is_file_s(string path) {
+	struct stat st;
+	if (stat(linux_temp_path(path), &st) != 0) return false;
+	return S_ISREG(st.st_mode);
+}
+
+bool os_is_directory_s(string path) {
+	struct stat st;
+	if (stat(linux_temp_path(path), &st) != 0) return false;
+	return S_ISDIR(st.st_mode);
+}
+
+bool os_is_path_absolute(string path) {
+	return path.count > 0 && path.data[0] == '/';
+}
+
+// Resolves ".", ".." and repeated separators lexically. Does not touch the file system,
+// so it works for paths that don't exist (like GetFullPathNameW).
+string linux_make_absolute_normalized_path(string path, Allocator allocator) {
+	char cwd[PATH_MAX];
+	string full;
+	if (os_is_path_absolute(path) || (path.count > 0 && path.data[0] == '\\')) {
+		full = path;
+	} else {
+		if (!getcwd(cwd, sizeof(cwd))) return null_string;
+		full = tprint("%cs/%s", cwd, path);
+	}
+
+	u8 *out = (u8*)alloc(allocator, full.count+1);
+	u64 count = 0;
+
+	u64 i = 0;
+	while (i < full.count) {
+		while (i < full.count && (full.data[i] == '/' || full.data[i] == '\\')) i += 1;
+		u64 start = i;
+		while (i < full.count && full.data[i] != '/' && full.data[i] != '\\') i += 1;
+		u64 length = i - start;
+
+		if (length == 0) break;
+		if (length == 1 && full.data[start] == '.') continue;
+		if (length == 2 && full.data[start] == '.' && full.data[start+1] == '.') {
+			while (count > 0 && out[count-1] != '/') count -= 1;
+			if (count > 0) count -= 1;
+			continue;
+		}
+
+		out[count] = '/';
+		count += 1;
+		memcpy(out+count, full.data+start, length);
+		count += length;
+	}
+
+	if (count == 0) {
+		out[0] = '/';
+		count = 1;
+	}
+
+	return (string){count, out};
+}
+
+bool os_get_absolute_path(string path, string *result, Allocator allocator) {
+	string abs = linux_make_absolute_normalized_path(path, allocator);
+	if (!abs.count) return false;
+	*result = abs;
+	return true;
+}
+
+bool os_get_relative_path(string from, string to, string *result, Allocator allocator) {
+
+	string from_abs = linux_make_absolute_normalized_path(from, get_temporary_allocator());
+	string to_abs   = linux_make_absolute_normalized_path(to, get_temporary_allocator());
+	if (!from_abs.count || !to_abs.count) return false;
+
+	// Like PathRelativePathTo, treat 'from' as a directory unless it's a file
+	if (os_is_file(from_abs)) {
+		while (from_abs.count > 1 && from_abs.data[from_abs.count-1] != '/') from_abs.count -= 1;
+		if (from_abs.count > 1) from_abs.count -= 1;
+	}
+
+	// Find the last separator of the common prefix
+	u64 common = 0;
+	u64 i = 0;
+	while (i < from_abs.count && i < to_abs.count && from_abs.data[i] == to_abs.data[i]) {
+		if (from_abs.data[i] == '/') common = i;
+		i += 1;
+	}
+	if ((i == from_abs.count || from_abs.data[i] == '/') && (i == to_abs.count || to_abs.data[i] == '/')) {
+		common = i;
+	}
+
+	String_Builder builder;
+	string_builder_init(&builder, allocator);
+
+	string_builder_append(&builder, STR("."));
+	for (u64 j = common; j < from_abs.count; j += 1) {
+		if (from_abs.data[j] == '/' && (j+1) < from_abs.count) {
+			string_builder_append(&builder, STR("/.."));
+		}
+	}
+	if (common < to_abs.count) {
+		string rest = string_view(to_abs, common, to_abs.count-common);
+		if (rest.data[0] != '/') string_builder_append(&builder, STR("/"));
+		string_builder_append(&builder, rest);
+	}
+
+	*result = string_builder_get_string(builder);
+
+	return true;
+}
+
+bool os_do_paths_match(string a, string b) {
+	string abs_a = linux_make_absolute_normalized_path(a, get_temporary_allocator());
+	string abs_b = linux_make_absolute_normalized_path(b, get_temporary_allocator());
+	return strings_match(abs_a, abs_b);
+}
+
+void fprints(File f, string fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	fprint_va_list_buffered(f, fmt, args);
+	va_end(args);
+}
+void fprintf(File f, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	string s;
+	s.data = cast(u8*)fmt;
+	s.count = strlen(fmt);
+	fprint_va_list_buffered(f, s, args);
+	va_end(args);
+}
+
+
+
+
+
+///
+///
+// Queries
+///
+
+thread_local void *linux_stack_base = 0;
+thread_local void *linux_stack_limit = 0;
+void linux_query_stack_bounds() {
+	if (linux_stack_base) return;
+
+	pthread_attr_t attr;
+	void *stack_address = 0;
+	size_t stack_size = 0;
+	if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+		pthread_attr_getstack(&attr, &stack_address, &stack_size);
+		pthread_attr_destroy(&attr);
+	}
+	linux_stack_limit = stack_address;
+	linux_stack_base  = (u8*)stack_address + stack_size;
+}
+
+void*
+os_get_stack_base() {
+	linux_query_stack_bounds();
+	return linux_stack_base;
+}
+void*
+os_get_stack_limit() {
+	linux_query_stack_bounds();
+	return linux_stack_limit;
+}
+
+u64
+os_get_number_of_logical_processors() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (u64)count : 1;
+}
+
+// sysfs files say they're 4096 bytes no matter what, so os_read_entire_file doesn't work on them
+u64 linux_read_small_file(const char *path, char *buffer, u64 buffer_size) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return 0;
+	ssize_t count = read(fd, buffer, buffer_size-1);
+	close(fd);
+	if (count < 0) count = 0;
+	buffer[count] = 0;
+	return (u64)count;
+}
+// "0-3,8,10-11"
+u64 linux_parse_cpu_list(const char *list) {
+	u64 mask = 0;
+	const char *c = list;
+	while (*c >= '0' && *c <= '9') {
+		u64 first = strtoull(c, (char**)&c, 10);
+		u64 last = first;
+		if (*c == '-') last = strtoull(c+1, (char**)&c, 10);
+		for (u64 i = first; i <= last && i < 64; i++) mask |= 1ULL << i;
+		if (*c == ',') c++;
+	}
+	return mask;
+}
+
+void
+os_get_cpu_topology(Cpu_Topology *topology) {
+	memset(topology, 0, sizeof(*topology));
+	topology->logical_processor_count = os_get_number_of_logical_processors();
+	
+	char path[128];
+	char text[256];
+	for (u64 cpu = 0; cpu < min(topology->logical_processor_count, (u64)64); cpu++) {
+		format_string_to_buffer_va(path, sizeof(path), "/sys/devices/system/cpu/cpu%llu/topology/thread_siblings_list", cpu);
+		u64 core_mask = 1ULL << cpu;
+		if (linux_read_small_file(path, text, sizeof(text))) core_mask = linux_parse_cpu_list(text);
+		cpu_topology_add_core(topology, core_mask);
+		
+		for (u64 index = 0; ; index++) {
+			format_string_to_buffer_va(path, sizeof(path), "/sys/devices/system/cpu/cpu%llu/cache/index%llu/type", cpu, index);
+			if (!linux_read_small_file(path, text, sizeof(text))) break;
+			if (strncmp(text, "Instruction", 11) == 0) continue;
+			
+			format_string_to_buffer_va(path, sizeof(path), "/sys/devices/system/cpu/cpu%llu/cache/index%llu/level", cpu, index);
+			if (!linux_read_small_file(path, text, sizeof(text))) continue;
+			u32 level = (u32)strtoul(text, 0, 10);
+			
+			// "48K", "2048K", "32M"
+			format_string_to_buffer_va(path, sizeof(path), "/sys/devices/system/cpu/cpu%llu/cache/index%llu/size", cpu, index);
+			u64 size = 0;
+			if (linux_read_small_file(path, text, sizeof(text))) {
+				char *unit;
+				size = strtoull(text, &unit, 10);
+				if      (*unit == 'K') size = KB(size);
+				else if (*unit == 'M') size = MB(size);
+				else if (*unit == 'G') size = GB(size);
+			}
+			
+			format_string_to_buffer_va(path, sizeof(path), "/sys/devices/system/cpu/cpu%llu/cache/index%llu/shared_cpu_list", cpu, index);
+			if (!linux_read_small_file(path, text, sizeof(text))) continue;
+			cpu_topology_add_cache_group(topology, level, size, linux_parse_cpu_list(text));
+		}
+	}
+}
+
+u64
+os_get_number_of_physical_cores() {
+	Cpu_Topology topology;
+	os_get_cpu_topology(&topology);
+	return topology.physical_core_count;
+}
+
+///
+///
+// Debug
+///
+#define LINUX_MAX_STACK_FRAMES 64
+string *
+os_get_stack_trace(u64 *trace_count, Allocator allocator) {
+	void *frames[LINUX_MAX_STACK_FRAMES];
+	int frame_count = backtrace(frames, LINUX_MAX_STACK_FRAMES);
+
+	// backtrace_symbols mallocs the result
+	char **symbols = backtrace_symbols(frames, frame_count);
+
+	string *stack_strings = (string *)alloc(allocator, LINUX_MAX_STACK_FRAMES * sizeof(string));
+	*trace_count = 0;
+
+	for (int i = 0; i < frame_count; i++) {
+		if (symbols) {
+			string s = STR(symbols[i]);
+			stack_strings[*trace_count] = string_copy(s, allocator);
+		} else {
+			stack_strings[*trace_count].data = (u8 *)alloc(allocator, 32);
+			stack_strings[*trace_count].count = format_string_to_buffer_va((char *)stack_strings[*trace_count].data, 32, "0x%llx", (u64)frames[i]);
+		}
+		(*trace_count)++;
+	}
+
+	if (symbols) free(symbols);
+
+	return stack_strings;
+}
+
+bool os_grow_program_memory(u64 new_size) {
+	os_lock_mutex(program_memory_mutex); // #Sync
+	if (program_memory_capacity >= new_size) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return true;
+	}
+
+	bool is_first_time = program_memory == 0;
+
+	if (is_first_time) {
+		// Reserve the whole range now so we can keep growing contiguously, then
+		// commit from the start of it below.
+		void *reserved = mmap(VIRTUAL_MEMORY_BASE, LINUX_PROGRAM_MEMORY_RESERVE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (reserved == MAP_FAILED) {
+			os_unlock_mutex(program_memory_mutex); // #Sync
+			return false;
+		}
+		program_memory = reserved;
+		program_memory_next = program_memory;
+		program_memory_capacity = 0;
+	}
+
+	void* tail = (u8*)program_memory + program_memory_capacity;
+
+	assert((u64)program_memory_capacity % os.granularity == 0, "program_memory_capacity is not aligned to granularity!");
+	assert((u64)tail % os.granularity == 0, "Tail is not aligned to granularity!");
+
+	u64 amount_to_allocate = align_next(new_size-program_memory_capacity, os.granularity);
+
+	if (program_memory_capacity + amount_to_allocate > LINUX_PROGRAM_MEMORY_RESERVE_SIZE) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return false;
+	}
+
+	if (mprotect(tail, amount_to_allocate, PROT_READ | PROT_WRITE) != 0) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return false;
+	}
+#if CONFIGURATION == DEBUG
+	// Guarded allocations come and go all the time, filling would commit every page they ever used
+	if (!GUARD_PAGE_ALLOCATIONS) memset(tail, 0xBA, amount_to_allocate);
+	mprotect(tail, amount_to_allocate, PROT_NONE);
+#endif
+
+	program_memory_capacity += amount_to_allocate;
+
+
+	char size_str[32];
+	format_string_to_buffer_va(size_str, sizeof(size_str), "%llu", program_memory_capacity/1024);
+
+	os_write_string_to_stdout(STR("Program memory grew to "));
+	os_write_string_to_stdout(STR(size_str));
+	os_write_string_to_stdout(STR(" kb\n"));
+	os_unlock_mutex(program_memory_mutex); // #Sync
+	return true;
+}
+
+void*
+os_reserve_next_memory_pages(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_next_memory_pages");
+
+	void *p = program_memory_next;
+
+	program_memory_next = (u8*)program_memory_next + size;
+
+	void *program_tail = (u8*)program_memory + program_memory_capacity;
+
+	if ((u64)program_memory_next > (u64)program_tail) {
+		u64 minimum_size = ((u64)program_memory_next) - (u64)program_memory + 1;
+		u64 new_program_size = get_next_power_of_two(minimum_size);
+
+		const u64 ATTEMPTS = 1000;
+		for (u64 i = 0; i <= ATTEMPTS; i++) {
+			if (program_memory_capacity >= new_program_size) break; // Another thread might have resized already, causing it to fail here.
+			assert(i < ATTEMPTS, "OS is not letting us allocate more memory. Maybe we are out of memory? You sure must be using a lot of memory then.");
+			if (os_grow_program_memory(new_program_size))
+				break;
+		}
+	}
+
+	return p;
+}
+
+void
+os_unlock_program_memory_pages(void *start, u64 size) {
+#if CONFIGURATION == DEBUG || GUARD_PAGE_ALLOCATIONS
+	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
+	// Program memory is one contiguous mapping on linux so we can do this in one go
+	int err = mprotect(start, size, PROT_READ | PROT_WRITE);
+	assert(err == 0, "mprotect failed with error %d", errno);
+#endif
+}
+
+void
+os_lock_program_memory_pages(void *start, u64 size) {
+#if CONFIGURATION == DEBUG || GUARD_PAGE_ALLOCATIONS
+	assert((u64)start % os.page_size == 0, "When locking memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When locking memory pages, the size must be aligned to page_size");
+	int err = mprotect(start, size, PROT_NONE);
+	assert(err == 0, "mprotect failed with error %d", errno);
+#endif
+}
+
+void
+os_decommit_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	if (size == 0) return;
+	// Mapping fresh pages over the range drops the old ones
+	void *p = mmap(start, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+	assert(p == start, "mmap failed with error %d", errno);
+}
+
+void
+os_commit_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	int err = mprotect(start, size, PROT_READ | PROT_WRITE);
+	assert(err == 0, "mprotect failed with error %d", errno);
+}
+
+void*
+os_reserve_memory(u64 size) {
+	assert(size % os.page_size == 0, "When reserving memory, the size must be aligned to page_size");
+	void *p = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	assert(p != MAP_FAILED, "mmap failed with error %d", errno);
+	return p;
+}
+
+void
+os_release_memory(void *start, u64 size) {
+	int err = munmap(start, size);
+	assert(err == 0, "munmap failed with error %d", errno);
+}
+
+///
+///
+// Mouse pointer
+// #Incomplete no windowing on linux yet, so these are no-ops.
+
+void ogb_instance
+os_set_mouse_pointer_standard(Mouse_Pointer_Kind kind) {
+}
+void ogb_instance
+os_set_mouse_pointer_custom(Custom_Mouse_Pointer p) {
+}
+
+Custom_Mouse_Pointer ogb_instance
+os_make_custom_mouse_pointer(void *image, int width, int height, int hotspot_x, int hotspot_y) {
+	return 0;
+}
+
+Custom_Mouse_Pointer ogb_instance
+os_make_custom_mouse_pointer_from_file(string path, int hotspot_x, int hotspot_y, Allocator allocator) {
+	return 0;
+}
+
+void os_update() {
+	// Nothing to do in headless mode
+}
@@ -406,6 +406,12 @@ void os_init(u64 program_memory_capacity) {
     os_thread_init(&audio_thread, win32_audio_thread);
     os_thread_init(&audio_poll_default_device_thread, win32_audio_poll_default_device_thread);
     
+    audio_thread.name = STR("Audio mixer");
+    audio_thread.priority = THREAD_PRIORITY_CLASS_REALTIME;
+    audio_thread.affinity_mask = AUDIO_THREAD_AFFINITY_MASK;
+    audio_poll_default_device_thread.name = STR("Audio device poll");
+    audio_poll_default_device_thread.priority = THREAD_PRIORITY_CLASS_BACKGROUND;
+    
     os_thread_start(&audio_thread);
     os_thread_start(&audio_poll_default_device_thread);
     
@@ -472,21 +478,22 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 
 	Thread *t = (Thread*)param;
 	
-#if CONFIGURATION == RELEASE
-	// #Configurable #Copypaste
-	SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS);
-	SetThreadPriority(t->os_handle, THREAD_PRIORITY_TIME_CRITICAL);
-	timeBeginPeriod(1);
-#endif
-	
 	temporary_storage_init(t->temporary_storage_size);
 	
 	context = t->initial_context;
 	context.thread_id = GetCurrentThreadId();
 	
+	if (t->name.count)                                os_set_current_thread_name(t->name);
+	if (t->affinity_mask)                             os_set_current_thread_affinity(t->affinity_mask);
+	// Always applied so DEFAULT really means THREAD_PRIORITY_NORMAL
+	os_set_current_thread_priority(t->priority);
+	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	temporary_storage_destroy();
+	scratch_arenas_destroy();
+	frame_storage_destroy();
+	heap_thread_cache_release();
 	
 	return 0;
 }
@@ -551,6 +558,48 @@ void os_thread_join(Thread *t) {
 	WaitForSingleObject(t->os_handle, INFINITE);
 }
 
+// SetThreadDescription is windows 10 1607 and up, so we look it up instead of linking it
+typedef HRESULT (WINAPI *Win32_Set_Thread_Description_Proc)(HANDLE, PCWSTR);
+bool os_set_current_thread_name(string name) {
+	local_persist Win32_Set_Thread_Description_Proc set_thread_description = 0;
+	local_persist bool looked_up = false;
+	if (!looked_up) {
+		set_thread_description = (Win32_Set_Thread_Description_Proc)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription");
+		looked_up = true;
+	}
+	if (!set_thread_description) return false;
+	
+	return SUCCEEDED(set_thread_description(GetCurrentThread(), (PCWSTR)temp_win32_fixed_utf8_to_null_terminated_wide(name)));
+}
+bool os_set_current_thread_affinity(u64 affinity_mask) {
+	if (affinity_mask == 0) {
+		DWORD_PTR process_mask, system_mask;
+		if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) return false;
+		affinity_mask = (u64)process_mask;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)affinity_mask) != 0;
+}
+bool os_set_current_thread_priority(Thread_Priority priority) {
+	int win32_priority = THREAD_PRIORITY_NORMAL;
+	switch (priority) {
+		case THREAD_PRIORITY_CLASS_DEFAULT:    win32_priority = THREAD_PRIORITY_NORMAL;        break;
+		case THREAD_PRIORITY_CLASS_BACKGROUND: win32_priority = THREAD_PRIORITY_BELOW_NORMAL;  break;
+		case THREAD_PRIORITY_CLASS_HIGH:       win32_priority = THREAD_PRIORITY_HIGHEST;       break;
+		case THREAD_PRIORITY_CLASS_REALTIME:
+			win32_priority = THREAD_PRIORITY_TIME_CRITICAL;
+#if CONFIGURATION == RELEASE
+			// #Configurable
+			// Only realtime threads (the audio mixer) raise the process class. Every other
+			// thread keeps the priority it asked for.
+			SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS);
+			timeBeginPeriod(1);
+#endif
+			break;
+		default: panic("Invalid thread priority %d", priority);
+	}
+	return SetThreadPriority(GetCurrentThread(), win32_priority) != 0;
+}
+
 ///
 // Mutex primitive
 
@@ -591,6 +640,19 @@ void os_unlock_mutex(Mutex_Handle m) {
 	assert(result, "Unlock mutex 0x%x failed with error %d", m, GetLastError());
 }
 
+///
+// Wait on address
+
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	WaitOnAddress(address, &expected, sizeof(u32), INFINITE);
+}
+void os_wake_one_on_address(volatile u32 *address) {
+	WakeByAddressSingle((PVOID)address);
+}
+void os_wake_all_on_address(volatile u32 *address) {
+	WakeByAddressAll((PVOID)address);
+}
+
 
 void os_sleep(u32 ms) {
     Sleep(ms);
@@ -1055,6 +1117,42 @@ os_get_number_of_logical_processors() {
 	return (u64)win32_system_info.dwNumberOfProcessors;
 }
 
+void
+os_get_cpu_topology(Cpu_Topology *topology) {
+	memset(topology, 0, sizeof(*topology));
+	topology->logical_processor_count = os_get_number_of_logical_processors();
+	
+	DWORD length = 0;
+	GetLogicalProcessorInformation(0, &length);
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *infos = 0;
+	if (length) infos = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)alloc(get_temporary_allocator(), length);
+	
+	if (infos && GetLogicalProcessorInformation(infos, &length)) {
+		u64 info_count = length/sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+		for (u64 i = 0; i < info_count; i++) {
+			SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = &infos[i];
+			if (info->Relationship == RelationProcessorCore) {
+				cpu_topology_add_core(topology, (u64)info->ProcessorMask);
+			} else if (info->Relationship == RelationCache && info->Cache.Type != CacheInstruction) {
+				cpu_topology_add_cache_group(topology, info->Cache.Level, info->Cache.Size, (u64)info->ProcessorMask);
+			}
+		}
+	}
+	
+	if (topology->physical_core_count == 0) {
+		for (u64 i = 0; i < min(topology->logical_processor_count, (u64)64); i++) {
+			cpu_topology_add_core(topology, 1ULL << i);
+		}
+	}
+}
+
+u64
+os_get_number_of_physical_cores() {
+	Cpu_Topology topology;
+	os_get_cpu_topology(&topology);
+	return topology.physical_core_count;
+}
+
 ///
 ///
 // Debug
@@ -1183,7 +1281,8 @@ bool os_grow_program_memory(u64 new_size) {
 		program_memory_next = program_memory;
 		program_memory_capacity = aligned_size;
 #if CONFIGURATION == DEBUG
-		memset(program_memory, 0xBA, program_memory_capacity);
+		// Guarded allocations come and go all the time, filling would commit every page they ever used
+		if (!GUARD_PAGE_ALLOCATIONS) memset(program_memory, 0xBA, program_memory_capacity);
         DWORD _ = PAGE_READWRITE;
 		VirtualProtect(aligned_base, aligned_size, PAGE_NOACCESS, &_);
 #endif
@@ -1198,7 +1297,7 @@ bool os_grow_program_memory(u64 new_size) {
 		// Just keep allocating at the tail of the current chunk
 		void* result = VirtualAlloc(tail, amount_to_allocate, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
 #if CONFIGURATION == DEBUG
-		memset(result, 0xBA, amount_to_allocate);
+		if (!GUARD_PAGE_ALLOCATIONS) memset(result, 0xBA, amount_to_allocate);
 		DWORD _ = PAGE_READWRITE;
 		VirtualProtect(tail, amount_to_allocate, PAGE_NOACCESS, &_);
 #endif
@@ -1251,7 +1350,7 @@ os_reserve_next_memory_pages(u64 size) {
 
 void
 os_unlock_program_memory_pages(void *start, u64 size) {
-#if CONFIGURATION == DEBUG
+#if CONFIGURATION == DEBUG || GUARD_PAGE_ALLOCATIONS
 	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
 	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
 	// This memory may be across multiple allocated regions so we need to do this one page at a time.
@@ -1267,7 +1366,7 @@ os_unlock_program_memory_pages(void *start, u64 size) {
 
 void
 os_lock_program_memory_pages(void *start, u64 size) {
-#if CONFIGURATION == DEBUG
+#if CONFIGURATION == DEBUG || GUARD_PAGE_ALLOCATIONS
 	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
 	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
 	// This memory may be across multiple allocated regions so we need to do this one page at a time.
@@ -1281,6 +1380,59 @@ os_lock_program_memory_pages(void *start, u64 size) {
 #endif
 }
 
+void
+os_decommit_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	// VirtualFree can't span over multiple VirtualAlloc'd regions so we do one region at a time
+	u8 *p = (u8*)start;
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T info_size = VirtualQuery(p, &info, sizeof(info));
+		assert(info_size == sizeof(info), "VirtualQuery Failed with error %d", GetLastError());
+		u8 *region_end = min((u8*)info.BaseAddress + info.RegionSize, end);
+		
+		if (info.State == MEM_COMMIT) {
+			BOOL ok = VirtualFree(p, (SIZE_T)(region_end-p), MEM_DECOMMIT);
+			assert(ok, "VirtualFree Failed with error %d", GetLastError());
+		}
+		p = region_end;
+	}
+}
+
+void
+os_commit_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	u8 *p = (u8*)start;
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T info_size = VirtualQuery(p, &info, sizeof(info));
+		assert(info_size == sizeof(info), "VirtualQuery Failed with error %d", GetLastError());
+		u8 *region_end = min((u8*)info.BaseAddress + info.RegionSize, end);
+		
+		void *result = VirtualAlloc(p, (SIZE_T)(region_end-p), MEM_COMMIT, PAGE_READWRITE);
+		assert(result == p, "VirtualAlloc Failed with error %d", GetLastError());
+		p = region_end;
+	}
+}
+
+void*
+os_reserve_memory(u64 size) {
+	assert(size % os.page_size == 0, "When reserving memory, the size must be aligned to page_size");
+	void *p = VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+	assert(p, "VirtualAlloc Failed with error %d", GetLastError());
+	return p;
+}
+
+void
+os_release_memory(void *start, u64 size) {
+	BOOL ok = VirtualFree(start, 0, MEM_RELEASE);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+
 ///
 ///
 // Mouse pointer
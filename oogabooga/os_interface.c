@@ -8,15 +8,11 @@
 	typedef HANDLE File;
 	
 #elif defined(__linux__)
-    #ifndef OOGABOOGA_HEADLESS
-    #define "Linux is only supported for headless builds"
-    #endif
-	typedef SOMETHING Mutex_Handle;
-	typedef SOMETHING Thread_Handle;
-	typedef SOMETHING Dynamic_Library_Handle;
-	typedef SOMETHING Window_Handle;
-	typedef SOMETHING File;
-	#error "Linux is not supported yet";
+	typedef struct Linux_Mutex* Mutex_Handle;
+	typedef pthread_t Thread_Handle;
+	typedef void* Dynamic_Library_Handle;
+	typedef void* Window_Handle;
+	typedef int File;
 #elif defined(__APPLE__) && defined(__MACH__)
 	typedef SOMETHING Mutex_Handle;
 	typedef SOMETHING Thread_Handle;
@@ -98,6 +94,14 @@ typedef struct Thread Thread;
 
 typedef void(*Thread_Proc)(Thread*);
 
+// Not THREAD_PRIORITY_* because windows.h has those
+typedef enum Thread_Priority {
+	THREAD_PRIORITY_CLASS_DEFAULT = 0, // Leave it to the OS
+	THREAD_PRIORITY_CLASS_BACKGROUND,  // Streaming, loading, anything which can wait
+	THREAD_PRIORITY_CLASS_HIGH,        // Job workers, a server tick thread
+	THREAD_PRIORITY_CLASS_REALTIME,    // Audio mixing. Only for threads which sleep most of the time.
+} Thread_Priority;
+
 typedef struct Thread {
 	u64 id; // This is valid after os_thread_start
 	Context initial_context;
@@ -106,6 +110,12 @@ typedef struct Thread {
 	Thread_Proc proc;
 	Thread_Handle os_handle;
 	
+	// Set these between os_thread_init and os_thread_start. The thread applies them itself when
+	// it starts, so name has to stay valid until then (string literals are fine).
+	string name; // Shows up in debuggers and profilers
+	u64 affinity_mask; // Bit N lets it run on logical processor N. 0 means anywhere.
+	Thread_Priority priority;
+	
 	
 	Allocator allocator;  // Deprecated !! #Cleanup
 } Thread;
@@ -129,6 +139,18 @@ os_thread_start(Thread *t);
 void ogb_instance
 os_thread_join(Thread *t);
 
+// These change the calling thread, so a thread can also change its own settings while running.
+// They return false if the OS didn't allow it. For example on linux, raising priority needs
+// permissions which a normal user usually doesn't have.
+bool ogb_instance
+os_set_current_thread_name(string name);
+
+bool ogb_instance
+os_set_current_thread_affinity(u64 affinity_mask);
+
+bool ogb_instance
+os_set_current_thread_priority(Thread_Priority priority);
+
 
 
 ///
@@ -145,6 +167,20 @@ os_lock_mutex(Mutex_Handle m);
 void ogb_instance
 os_unlock_mutex(Mutex_Handle m);
 
+///
+// Wait on address (Win32 WaitOnAddress, linux futex)
+// This is what Mutex & semaphores in concurrency.c sleep on.
+
+// Sleeps while *address == expected. Can return spuriously, so check again in a loop.
+void ogb_instance
+os_wait_on_address(volatile u32 *address, u32 expected);
+
+void ogb_instance
+os_wake_one_on_address(volatile u32 *address);
+
+void ogb_instance
+os_wake_all_on_address(volatile u32 *address);
+
 ///
 // Threading utilities
 
@@ -389,6 +425,57 @@ os_get_stack_limit();
 ogb_instance u64
 os_get_number_of_logical_processors();
 
+///
+// Processor topology
+// Masks have bit N set for logical processor N, same as Thread.affinity_mask, so only the first
+// 64 logical processors are described.
+#define CPU_TOPOLOGY_MAX_CORES 64
+#define CPU_TOPOLOGY_MAX_CACHE_GROUPS 64
+typedef struct Cpu_Cache_Group {
+	u32 level; // 1, 2, 3 ...
+	u64 size;
+	u64 logical_processor_mask; // The logical processors which share this cache
+} Cpu_Cache_Group;
+
+typedef struct Cpu_Topology {
+	u64 logical_processor_count;
+	u64 physical_core_count;
+	// One per physical core, with the logical processors on it (SMT siblings)
+	u64 core_masks[CPU_TOPOLOGY_MAX_CORES];
+	// Data and unified caches, one per distinct cache (not one per processor)
+	u64 cache_group_count;
+	Cpu_Cache_Group cache_groups[CPU_TOPOLOGY_MAX_CACHE_GROUPS];
+} Cpu_Topology;
+
+// If the OS doesn't tell us, every logical processor is reported as its own core with no caches
+ogb_instance void
+os_get_cpu_topology(Cpu_Topology *topology);
+
+// For the os implementations. Processors and caches are listed per logical processor, so
+// these skip what's already there.
+inline void cpu_topology_add_core(Cpu_Topology *topology, u64 mask) {
+	if (!mask) return;
+	for (u64 i = 0; i < topology->physical_core_count; i++) {
+		if (topology->core_masks[i] == mask) return;
+	}
+	if (topology->physical_core_count < CPU_TOPOLOGY_MAX_CORES) {
+		topology->core_masks[topology->physical_core_count++] = mask;
+	}
+}
+inline void cpu_topology_add_cache_group(Cpu_Topology *topology, u32 level, u64 size, u64 mask) {
+	if (!mask) return;
+	for (u64 i = 0; i < topology->cache_group_count; i++) {
+		Cpu_Cache_Group *g = &topology->cache_groups[i];
+		if (g->level == level && g->logical_processor_mask == mask) return;
+	}
+	if (topology->cache_group_count < CPU_TOPOLOGY_MAX_CACHE_GROUPS) {
+		topology->cache_groups[topology->cache_group_count++] = (Cpu_Cache_Group){level, size, mask};
+	}
+}
+
+ogb_instance u64
+os_get_number_of_physical_cores();
+
 
 ///
 ///
@@ -437,11 +524,32 @@ os_grow_program_memory(size_t new_size);
 ogb_instance void*
 os_reserve_next_memory_pages(u64 size);
 
+// Locked pages can't be accessed at all. This only does something in DEBUG or with
+// GUARD_PAGE_ALLOCATIONS.
 void ogb_instance
 os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
 os_lock_program_memory_pages(void *start, u64 size);
 
+// Gives the physical memory of the pages back to the OS. The address range stays reserved, but
+// you need to os_commit_memory_pages() before touching it again.
+// Works on program memory and on memory from os_reserve_memory().
+// - start & size must be aligned to os.page_size
+void ogb_instance
+os_decommit_memory_pages(void *start, u64 size);
+// Committed pages are readable, writable and zeroed.
+// - start & size must be aligned to os.page_size
+void ogb_instance
+os_commit_memory_pages(void *start, u64 size);
+
+// Reserves a range of address space outside of program memory without committing any of it.
+// Use os_commit_memory_pages() on the parts you need.
+// - size must be aligned to os.page_size
+void* ogb_instance
+os_reserve_memory(u64 size);
+void ogb_instance
+os_release_memory(void *start, u64 size);
+
 ///
 ///
 // Mouse pointer
@@ -51,8 +51,14 @@ void _profiler_report_time_cycles(string name, u64 count, u64 start) {
     for (u64 start_time = rdtsc(), end_time = start_time, elapsed_time = 0; \
          elapsed_time == 0; \
          elapsed_time = (end_time = rdtsc()) - start_time, var+=elapsed_time)
+// Same as tm_scope_accum but var (a u64) can be shared between threads
+#define tm_scope_accum_atomic(name, var) \
+    for (u64 start_time = rdtsc(), end_time = start_time, elapsed_time = 0; \
+         elapsed_time == 0; \
+         elapsed_time = (end_time = rdtsc()) - start_time, atomic_fetch_add_64(&(var), elapsed_time, MEMORY_ORDER_RELAXED))
 #else
 	#define tm_scope(...)
 	#define tm_scope_var(...)
 	#define tm_scope_accum(...)
+	#define tm_scope_accum_atomic(...)
 #endif
\ No newline at end of file
@@ -50,7 +50,9 @@ inline void basic_rsqrt_float32_512(float *a, float *result);
 #endif
 
 #include <immintrin.h>
-#include <intrin.h>
+#ifdef _WIN32
+	#include <intrin.h>
+#endif
 
 
 // SSE
@@ -50,7 +50,12 @@ u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list ar
                 }
                 format_specifier[specifier_len] = '\0';
 
-                int temp_len = vsnprintf(temp_buffer, sizeof(temp_buffer), format_specifier, args);
+                // vsnprintf may consume args (it does on SysV where va_list is an array type),
+                // so give it a copy and skip the argument ourselves below.
+                va_list args_copy;
+                va_copy(args_copy, args);
+                int temp_len = vsnprintf(temp_buffer, sizeof(temp_buffer), format_specifier, args_copy);
+                va_end(args_copy);
                 switch (format_specifier[specifier_len - 1]) {
                     case 'd': case 'i': va_arg(args, int); break;
                     case 'u': case 'x': case 'X': case 'o': va_arg(args, unsigned int); break;
@@ -113,7 +118,11 @@ string sprint_va_list_to_buffer(const string fmt, va_list args, void* buffer, u6
 string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
     char* fmt_cstring = temp_convert_to_null_terminated_string(fmt);
-    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args) + 1; 
+    
+    va_list args_copy;
+    va_copy(args_copy, args);
+    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args_copy) + 1; 
+    va_end(args_copy);
 
     char* buffer = NULL;
 
@@ -124,7 +133,7 @@ string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
 
 string sprints(Allocator allocator, const string fmt, ...) {
-	va_list args = 0;
+	va_list args;
 	va_start(args, fmt);
 	string s = sprint_va_list(allocator, fmt, args);
 	va_end(args);
@@ -133,7 +142,7 @@ string sprints(Allocator allocator, const string fmt, ...) {
 
 // temp allocator
 string tprints(const string fmt, ...) {
-	va_list args = 0;
+	va_list args;
 	va_start(args, fmt);
 	string s = sprint_va_list(get_temporary_allocator(), fmt, args);
 	va_end(args);
@@ -236,9 +245,9 @@ typedef void(*Logger_Proc)(Log_Level level, string s);
 void string_builder_prints(String_Builder *b, string fmt, ...) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
+	va_list args1;
 	va_start(args1, fmt);
-	va_list args2 = 0;
+	va_list args2;
 	va_copy(args2, args1);
 	
 	u64 formatted_count = format_string_to_buffer(0, 0, temp_convert_to_null_terminated_string(fmt), args1);
@@ -255,9 +264,9 @@ void string_builder_prints(String_Builder *b, string fmt, ...) {
 void string_builder_printf(String_Builder *b, const char *fmt, ...) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
+	va_list args1;
 	va_start(args1, fmt);
-	va_list args2 = 0;
+	va_list args2;
 	va_copy(args2, args1);
 	
 	u64 formatted_count = format_string_to_buffer(0, 0, fmt, args1);
@@ -139,6 +139,34 @@ void test_allocator(bool do_log_heap) {
     
     assert(old_foo == foo, "Temp allocator goof");
     
+    // Overflowing temporary storage chains more blocks instead of wrapping around
+    reset_temporary_storage();
+    u64 *first_temp = (u64*)talloc(sizeof(u64));
+    *first_temp = 69;
+    u64 overflow_total = 0;
+    u8 *last_temp = 0;
+    while (overflow_total < TEMPORARY_STORAGE_SIZE*2) {
+        last_temp = (u8*)talloc(KB(100));
+        memset(last_temp, 0x42, KB(100));
+        overflow_total += KB(100);
+    }
+    u8 *huge_temp = (u8*)talloc(TEMPORARY_STORAGE_SIZE*3);
+    memset(huge_temp, 0x42, TEMPORARY_STORAGE_SIZE*3);
+    assert(*first_temp == 69, "Failed: temporary storage overflow overwrote earlier allocations");
+    assert(temporary_storage->next, "Failed: temporary storage did not chain on overflow");
+    assert(get_temporary_storage_high_water_mark() >= overflow_total + TEMPORARY_STORAGE_SIZE*3, "Failed: temporary storage high water mark");
+    
+    reset_temporary_storage();
+    void *after_reset = talloc(16);
+    assert(after_reset == first_temp, "Failed: reset_temporary_storage");
+    // Chained blocks are kept around when they get used again, and trimmed when they don't
+    talloc(TEMPORARY_STORAGE_SIZE);
+    assert(temporary_storage->next, "Failed: temporary storage should reuse chained block");
+    reset_temporary_storage();
+    reset_temporary_storage();
+    assert(!temporary_storage->next, "Failed: temporary storage did not release unused blocks at reset");
+    assert(get_temporary_storage_high_water_mark() >= overflow_total, "Failed: temporary storage high water mark should persist over resets");
+    
     // Repeated Allocation and Free
     for (int i = 0; i < 10000; ++i) {
         void* temp = alloc(heap, 128);
@@ -194,9 +222,470 @@ void test_allocator(bool do_log_heap) {
     
     assert(bytes_match(check_bytes, check_bytes_copy, 1024), "Memory corrupt");
     
+    // Size classes
+    for (u64 size = HEAP_ALIGNMENT; size <= HEAP_MAX_SMALL_SIZE; size += HEAP_ALIGNMENT) {
+    	u64 size_class = heap_size_to_class(size);
+    	assert(size_class < HEAP_SIZE_CLASS_COUNT, "Failed: heap_size_to_class");
+    	assert(heap_class_to_size(size_class) >= size, "Failed: heap_size_to_class");
+    	if (size_class > 0) assert(heap_class_to_size(size_class-1) < size, "Failed: heap_size_to_class");
+    }
+    
+#if !GUARD_PAGE_ALLOCATIONS
+    // Freed small slots are reused
+    void *small = alloc(heap, 100);
+    dealloc(heap, small);
+    void *small_again = alloc(heap, 100);
+    assert(small == small_again, "Failed: size class slot was not reused");
+    dealloc(heap, small_again);
+#endif
+    
+    // Lots of small allocations of varying sizes don't overlap
+    u8 *small_blocks[1000];
+    u64 small_sizes[1000];
+    for (int i = 0; i < 1000; ++i) {
+    	small_sizes[i] = get_random_int_in_range(1, HEAP_MAX_SMALL_SIZE);
+    	small_blocks[i] = (u8*)alloc(heap, small_sizes[i]);
+    	assert((u64)small_blocks[i] % HEAP_ALIGNMENT == 0, "Failed: small allocation not aligned");
+    	memset(small_blocks[i], i % 256, small_sizes[i]);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+    	dealloc(heap, small_blocks[i]);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+    	small_sizes[i] = get_random_int_in_range(1, HEAP_MAX_SMALL_SIZE);
+    	small_blocks[i] = (u8*)alloc(heap, small_sizes[i]);
+    	memset(small_blocks[i], i % 256, small_sizes[i]);
+    }
+    for (int i = 0; i < 1000; ++i) {
+    	for (u64 j = 0; j < small_sizes[i]; j++) {
+    		assert(small_blocks[i][j] == i % 256, "Failed: small allocations overlap");
+    	}
+    	dealloc(heap, small_blocks[i]);
+    }
+    
+    // Realloc from small to large and back keeps contents
+    u8 *r = (u8*)alloc(heap, 16);
+    for (int i = 0; i < 16; i++) r[i] = (u8)i;
+    r = (u8*)heap_allocator_proc(HEAP_MAX_SMALL_SIZE*4, r, ALLOCATOR_REALLOCATE, 0);
+    for (int i = 0; i < 16; i++) assert(r[i] == (u8)i, "Failed: realloc small -> large");
+    r = (u8*)heap_allocator_proc(8, r, ALLOCATOR_REALLOCATE, 0);
+    for (int i = 0; i < 8; i++) assert(r[i] == (u8)i, "Failed: realloc large -> small");
+    dealloc(heap, r);
+    
+#if !GUARD_PAGE_ALLOCATIONS
+    // Large allocations get their own pages which are reused after free
+    u8 *large = (u8*)alloc(heap, MB(8));
+    large[0] = 1;
+    large[MB(8)-1] = 2;
+    dealloc(heap, large);
+    u8 *large_again = (u8*)alloc(heap, MB(8));
+    assert(large == large_again, "Failed: large allocation address space was not reused");
+    assert(large_again[0] == 0 && large_again[MB(8)-1] == 0, "Failed: large allocation pages were not given back");
+    
+    u8 *large_a = (u8*)alloc(heap, MB(16));
+    u8 *large_b = (u8*)alloc(heap, MB(16));
+    memset(large_a, 0xAB, MB(16));
+    memset(large_b, 0xCD, MB(16));
+    bool adjacent = large_b == large_a + align_next(MB(16)+sizeof(Heap_Allocation_Metadata), os.page_size);
+    dealloc(heap, large_a);
+    dealloc(heap, large_b);
+    u8 *large_c = (u8*)alloc(heap, MB(32));
+    if (adjacent) assert(large_c == large_a, "Failed: freed large allocations were not merged");
+    dealloc(heap, large_c);
+    dealloc(heap, large_again);
+#endif
+    
+#if !GUARD_PAGE_ALLOCATIONS
+    // Realloc resizes in place when it can
+    u8 *small_r = (u8*)alloc(heap, 100);
+    assert(heap_realloc(small_r, 90) == small_r, "Failed: small realloc should shrink in place");
+    dealloc(heap, small_r);
+    
+    u8 *fl = (u8*)alloc(heap, KB(32));
+    u8 *fl_next = (u8*)alloc(heap, KB(32));
+    for (int i = 0; i < 256; i++) fl[i] = (u8)i;
+    bool fl_adjacent = fl_next == fl + KB(32) + sizeof(Heap_Allocation_Metadata);
+    dealloc(heap, fl_next);
+    u8 *fl_grown = (u8*)heap_realloc(fl, KB(48));
+    if (fl_adjacent) assert(fl_grown == fl, "Failed: realloc did not grow into the following free node");
+    for (int i = 0; i < 256; i++) assert(fl_grown[i] == (u8)i, "Failed: free list realloc grow");
+    u8 *fl_shrunk = (u8*)heap_realloc(fl_grown, KB(16));
+    assert(fl_shrunk == fl_grown, "Failed: free list realloc should shrink in place");
+    for (int i = 0; i < 256; i++) assert(fl_shrunk[i] == (u8)i, "Failed: free list realloc shrink");
+    dealloc(heap, fl_shrunk);
+    
+    u8 *lg = (u8*)alloc(heap, MB(4));
+    lg[0] = 69;
+    lg[MB(2)-1] = 42;
+    assert(heap_realloc(lg, MB(2)) == lg, "Failed: large realloc should shrink in place");
+    assert(heap_realloc(lg, MB(4)) == lg, "Failed: large realloc should grow into what it just gave back");
+    assert(lg[0] == 69 && lg[MB(2)-1] == 42, "Failed: large realloc in place");
+    lg[MB(4)-1] = 1;
+    dealloc(heap, lg);
+#endif
+    
+    reset_temporary_storage();
+    Allocator temp = get_temporary_allocator();
+    u8 *t = (u8*)alloc(temp, 64);
+    t[0] = 69;
+    assert(reallocate(temp, t, 64, 128) == t, "Failed: temporary storage should grow the last allocation in place");
+    alloc(temp, 16);
+    u8 *t_moved = (u8*)reallocate(temp, t, 128, 256);
+    assert(t_moved != t && t_moved[0] == 69, "Failed: temporary storage reallocate");
+    
     if (do_log_heap) log_heap();
 }
 
+// The heap before size classes: everything goes through the free lists
+void *test_heap_alloc_free_list_only(u64 size) {
+	size += sizeof(Heap_Allocation_Metadata);
+	size = align_next(size, HEAP_ALIGNMENT);
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Allocation_Metadata *meta = heap_alloc_free_list(size);
+	spinlock_release(&heap_lock);
+	return meta+1;
+}
+void test_heap_dealloc_free_list_only(void *p) {
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)p - 1;
+	Heap_Block *block = heap_meta_block(meta);
+	u64 size = meta->size;
+	heap_dealloc_free_list(meta, block, size);
+	spinlock_release(&heap_lock);
+}
+
+void test_allocator_speed() {
+	
+	const u64 slot_count = 4096;
+	const u64 op_count = 200000;
+	
+	void **slots = (void**)alloc(get_heap_allocator(), slot_count*sizeof(void*));
+	
+	for (int pass = 0; pass < 2; pass++) {
+		bool size_classes = pass == 1;
+		
+		memset(slots, 0, slot_count*sizeof(void*));
+		u64 seed_before = seed_for_random;
+		seed_for_random = 69420;
+		
+		float64 start_seconds = os_get_current_time_in_seconds();
+		u64 start_cycles = rdtsc();
+		
+		for (u64 i = 0; i < op_count; i++) {
+			u64 index = get_random() % slot_count;
+			if (slots[index]) {
+				if (size_classes) heap_dealloc(slots[index]);
+				else              test_heap_dealloc_free_list_only(slots[index]);
+				slots[index] = 0;
+			} else {
+				u64 size = get_random_int_in_range(16, 1024);
+				if (size_classes) slots[index] = heap_alloc(size);
+				else              slots[index] = test_heap_alloc_free_list_only(size);
+				*(u64*)slots[index] = i;
+			}
+		}
+		for (u64 i = 0; i < slot_count; i++) {
+			if (!slots[i]) continue;
+			if (size_classes) heap_dealloc(slots[i]);
+			else              test_heap_dealloc_free_list_only(slots[i]);
+		}
+		
+		u64 end_cycles = rdtsc();
+		float64 end_seconds = os_get_current_time_in_seconds();
+		
+		seed_for_random = seed_before;
+		
+		print("%cs: %llu ops took %.2f ms, on average %llu cycles per op\n", size_classes ? "Size class heap" : "Free list heap", op_count, (end_seconds-start_seconds)*1000.0, (end_cycles-start_cycles)/op_count);
+	}
+	
+	dealloc(get_heap_allocator(), slots);
+}
+
+typedef struct Test_Realloc_Counter {
+	u64 bytes_copied;
+	bool always_copy; // How realloc worked before it could resize in place
+} Test_Realloc_Counter;
+void *test_realloc_counting_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
+	Test_Realloc_Counter *counter = (Test_Realloc_Counter*)data;
+	if (message != ALLOCATOR_REALLOCATE || !p) return heap_allocator_proc(size, p, message, 0);
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)p - 1;
+	u64 old_size = meta->size - sizeof(Heap_Allocation_Metadata);
+	
+	void *new;
+	if (counter->always_copy) {
+		new = heap_alloc(size);
+		memcpy(new, p, min(size, old_size));
+		heap_dealloc(p);
+	} else {
+		new = heap_realloc(p, size);
+	}
+	if (new != p) counter->bytes_copied += min(size, old_size);
+	return new;
+}
+void test_realloc_speed() {
+	const u64 target_size = MB(32);
+	
+	for (int pass = 0; pass < 2; pass++) {
+		Test_Realloc_Counter counter = ZERO(Test_Realloc_Counter);
+		counter.always_copy = pass == 0;
+		Allocator allocator;
+		allocator.proc = test_realloc_counting_allocator_proc;
+		allocator.data = &counter;
+		
+		float64 start_seconds = os_get_current_time_in_seconds();
+		u64 *numbers;
+		growing_array_init((void**)&numbers, sizeof(u64), allocator);
+		for (u64 i = 0; i < target_size/sizeof(u64); i++) {
+			growing_array_add((void**)&numbers, &i);
+		}
+		for (u64 i = 0; i < target_size/sizeof(u64); i += 4099) {
+			assert(numbers[i] == i, "Failed: growing array contents after realloc");
+		}
+		growing_array_deinit((void**)&numbers);
+		float64 array_seconds = os_get_current_time_in_seconds() - start_seconds;
+		u64 array_copied = counter.bytes_copied;
+		
+		counter.bytes_copied = 0;
+		start_seconds = os_get_current_time_in_seconds();
+		String_Builder builder;
+		string_builder_init(&builder, allocator);
+		string line = STR("The quick brown fox jumps over the lazy dog\n");
+		while (builder.count < target_size) {
+			string_builder_append(&builder, line);
+		}
+		assert(strings_match(string_view(builder.result, builder.count-line.count, line.count), line), "Failed: string builder contents after realloc");
+		dealloc(allocator, builder.buffer);
+		float64 builder_seconds = os_get_current_time_in_seconds() - start_seconds;
+		u64 builder_copied = counter.bytes_copied;
+		
+		print("\n%cs: growing array to %llu MB copied %llu KB (%.2f ms), String_Builder to %llu MB copied %llu KB (%.2f ms)",
+			counter.always_copy ? "Copying realloc" : "In-place realloc",
+			target_size/MB(1), array_copied/KB(1), array_seconds*1000.0,
+			target_size/MB(1), builder_copied/KB(1), builder_seconds*1000.0);
+	}
+	print("\n");
+}
+
+typedef struct Test_Thing_For_Arena {
+	u64 x;
+} Test_Thing_For_Arena;
+void test_arena() {
+	Arena *arena = arena_make(MB(64));
+	
+	u64 start = arena_pos(arena);
+	int *a = (int*)arena_push(arena, sizeof(int));
+	int *b = (int*)arena_push(arena, sizeof(int));
+	*a = 69;
+	*b = 420;
+	assert((u64)a % ARENA_ALIGNMENT == 0 && (u64)b % ARENA_ALIGNMENT == 0, "Failed: arena_push alignment");
+	assert(b > a, "Failed: arena_push");
+	
+	// Nested scopes
+	u64 pos = arena_pos(arena);
+	u8 *big = (u8*)arena_push(arena, MB(10));
+	big[0] = 1;
+	big[MB(10)-1] = 2;
+	assert(arena->committed >= arena_pos(arena), "Failed: arena commit");
+	arena_pop_to(arena, pos);
+	assert(arena_pos(arena) == pos, "Failed: arena_pop_to");
+	u8 *big_again = (u8*)arena_push(arena, 64);
+	assert(big == big_again, "Failed: arena_pop_to did not free");
+	assert(*a == 69 && *b == 420, "Failed: arena_pop_to freed too much");
+	
+	// Allocator interface
+	Allocator allocator = get_arena_allocator(arena);
+	u8 *c = (u8*)alloc(allocator, 16);
+	for (int i = 0; i < 16; i++) c[i] = (u8)i;
+	u8 *c_grown = (u8*)allocator.proc(1024, c, ALLOCATOR_REALLOCATE, allocator.data);
+	assert(c == c_grown, "Failed: arena realloc of last allocation should grow in place");
+	u8 *d = (u8*)alloc(allocator, 16);
+	u8 *c_moved = (u8*)allocator.proc(2048, c, ALLOCATOR_REALLOCATE, allocator.data);
+	assert(c_moved > d, "Failed: arena realloc");
+	for (int i = 0; i < 16; i++) assert(c_moved[i] == (u8)i, "Failed: arena realloc did not copy");
+	dealloc(allocator, d);
+	
+	Test_Thing_For_Arena *things = 0;
+	growing_array_init((void**)&things, sizeof(Test_Thing_For_Arena), allocator);
+	for (u64 i = 0; i < 1000; i++) {
+		Test_Thing_For_Arena t = { i };
+		growing_array_add((void**)&things, &t);
+	}
+	for (u64 i = 0; i < 1000; i++) assert(things[i].x == i, "Failed: growing array in arena");
+	
+	arena_pop_to(arena, start);
+	assert(arena_pos(arena) == start, "Failed: arena_pop_to");
+	
+	// Scratch arenas
+	Arena *scratch = get_scratch_arena(0);
+	Arena *other_scratch = get_scratch_arena(scratch);
+	assert(scratch != other_scratch, "Failed: get_scratch_arena returned the arena we didn't want");
+	assert(get_scratch_arena(other_scratch) == scratch, "Failed: get_scratch_arena");
+	
+	u64 scratch_pos = arena_pos(scratch);
+	arena_push(scratch, 128);
+	arena_pop_to(scratch, scratch_pos);
+	
+	arena_destroy(arena);
+}
+
+typedef struct Test_Thing_For_Pool {
+	u64 id;
+	Vector3 position;
+	float32 health;
+	u8 padding[32];
+} Test_Thing_For_Pool;
+void test_pool() {
+	Pool pool;
+	pool_init(&pool, Test_Thing_For_Pool);
+	
+	Pool_Iterator empty_it = pool_iterate(&pool);
+	assert(!pool_iterator_next(&empty_it), "Failed: empty pool should have nothing to iterate");
+	
+	const u64 thing_count = 4000;
+	Test_Thing_For_Pool **things = (Test_Thing_For_Pool**)alloc(get_heap_allocator(), thing_count*sizeof(void*));
+	for (u64 i = 0; i < thing_count; i++) {
+		things[i] = (Test_Thing_For_Pool*)pool_alloc(&pool);
+		assert(things[i]->id == 0, "Failed: pool_alloc should zero initialize");
+		things[i]->id = i;
+	}
+	assert(pool.count == thing_count, "Failed: pool count");
+	assert(pool.chunk_count > 1, "Failed: test should span more than one pool chunk");
+	
+	// Free every third, iteration should skip them
+	for (u64 i = 0; i < thing_count; i += 3) {
+		pool_free(&pool, things[i]);
+		assert(!pool_is_live(&pool, things[i]), "Failed: pool_free");
+	}
+	u64 iterated = 0;
+	u64 last_id = 0;
+	Pool_Iterator it = pool_iterate(&pool);
+	while (pool_iterator_next(&it)) {
+		Test_Thing_For_Pool *t = (Test_Thing_For_Pool*)it.item;
+		assert(t->id % 3 != 0, "Failed: pool iteration hit a freed item");
+		assert(iterated == 0 || t->id > last_id, "Failed: pool iteration should be in address order");
+		last_id = t->id;
+		iterated += 1;
+	}
+	assert(iterated == pool.count, "Failed: pool iteration count (%llu, expected %llu)", iterated, pool.count);
+	
+	// Freed slots are reused before growing, live items never move
+	u64 chunk_count = pool.chunk_count;
+	for (u64 i = 0; i < thing_count; i += 3) {
+		things[i] = (Test_Thing_For_Pool*)pool_alloc(&pool);
+		things[i]->id = i;
+	}
+	assert(pool.chunk_count == chunk_count, "Failed: pool grew when it had free slots");
+	for (u64 i = 0; i < thing_count; i++) {
+		assert(things[i]->id == i, "Failed: pool item moved or was corrupted");
+	}
+	
+	// Allocator interface
+	Allocator allocator = get_pool_allocator(&pool);
+	Test_Thing_For_Pool *a = (Test_Thing_For_Pool*)alloc(allocator, sizeof(Test_Thing_For_Pool));
+	assert(pool_is_live(&pool, a) && pool.count == thing_count+1, "Failed: pool allocator");
+	dealloc(allocator, a);
+	assert(pool.count == thing_count, "Failed: pool allocator dealloc");
+	
+	pool_reset(&pool);
+	it = pool_iterate(&pool);
+	assert(pool.count == 0 && !pool_iterator_next(&it), "Failed: pool_reset");
+	
+	// Tiny items still fit the free list pointer, big items get bigger chunks
+	Pool small_pool;
+	pool_init(&small_pool, u8);
+	u8 *x = (u8*)pool_alloc(&small_pool);
+	u8 *y = (u8*)pool_alloc(&small_pool);
+	assert(y - x >= (s64)sizeof(void*), "Failed: small pool items overlap the free list");
+	pool_free(&small_pool, x);
+	assert(pool_alloc(&small_pool) == x, "Failed: small pool free list");
+	pool_deinit(&small_pool);
+	
+	Pool big_pool;
+	pool_init_raw(&big_pool, KB(4)+8, 0, MB(64));
+	assert(big_pool.items_per_chunk >= 64, "Failed: big pool items per chunk");
+	void *big = pool_alloc(&big_pool);
+	memset(big, 1, KB(4)+8);
+	it = pool_iterate(&big_pool);
+	assert(pool_iterator_next(&it) && it.item == big && !pool_iterator_next(&it), "Failed: big pool iteration");
+	pool_deinit(&big_pool);
+	
+	dealloc(get_heap_allocator(), things);
+	pool_deinit(&pool);
+}
+
+void test_pool_speed() {
+	const u64 counts[] = { 1000, 100000, 1000000 };
+	
+	for (u64 c = 0; c < sizeof(counts)/sizeof(counts[0]); c++) {
+		u64 count = counts[c];
+		Test_Thing_For_Pool **things = (Test_Thing_For_Pool**)alloc(get_heap_allocator(), count*sizeof(void*));
+		
+		for (int pass = 0; pass < 2; pass++) {
+			bool use_pool = pass == 1;
+			
+			Pool pool;
+			if (use_pool) pool_init(&pool, Test_Thing_For_Pool);
+			
+			u64 start_cycles = rdtsc();
+			float64 start_seconds = os_get_current_time_in_seconds();
+			for (u64 i = 0; i < count; i++) {
+				if (use_pool) things[i] = (Test_Thing_For_Pool*)pool_alloc(&pool);
+				else          things[i] = (Test_Thing_For_Pool*)alloc(get_heap_allocator(), sizeof(Test_Thing_For_Pool));
+				things[i]->id = i;
+			}
+			u64 alloc_cycles = rdtsc() - start_cycles;
+			float64 alloc_seconds = os_get_current_time_in_seconds() - start_seconds;
+			
+			// Free half so iteration has holes to skip
+			for (u64 i = 0; i < count; i += 2) {
+				if (use_pool) pool_free(&pool, things[i]);
+				else          dealloc(get_heap_allocator(), things[i]);
+				things[i] = 0;
+			}
+			
+			// The heap has no way of iterating so it has to go through the pointers
+			u64 sum = 0;
+			start_cycles = rdtsc();
+			start_seconds = os_get_current_time_in_seconds();
+			if (use_pool) {
+				Pool_Iterator it = pool_iterate(&pool);
+				while (pool_iterator_next(&it)) {
+					sum += ((Test_Thing_For_Pool*)it.item)->id;
+				}
+			} else {
+				for (u64 i = 0; i < count; i++) {
+					if (things[i]) sum += things[i]->id;
+				}
+			}
+			u64 iterate_cycles = rdtsc() - start_cycles;
+			float64 iterate_seconds = os_get_current_time_in_seconds() - start_seconds;
+			// Not an assert so the loops aren't optimized away in release
+			if (sum != (count/2)*(count/2)) panic("Failed: pool speed iteration sum");
+			
+			start_cycles = rdtsc();
+			start_seconds = os_get_current_time_in_seconds();
+			for (u64 i = 1; i < count; i += 2) {
+				if (use_pool) pool_free(&pool, things[i]);
+				else          dealloc(get_heap_allocator(), things[i]);
+			}
+			u64 free_cycles = rdtsc() - start_cycles;
+			float64 free_seconds = os_get_current_time_in_seconds() - start_seconds;
+			
+			if (use_pool) pool_deinit(&pool);
+			
+			print("\n%cs, %llu items: alloc %llu cycles/item (%.2f ms), iterate %llu cycles/live item (%.2f ms), free %llu cycles/item (%.2f ms)",
+				use_pool ? "Pool" : "Heap", count,
+				alloc_cycles/count, alloc_seconds*1000.0,
+				iterate_cycles/(count/2), iterate_seconds*1000.0,
+				free_cycles/(count/2), free_seconds*1000.0);
+		}
+		
+		dealloc(get_heap_allocator(), things);
+	}
+	print("\n");
+}
+
 void test_thread_proc1(Thread* t) {
 	os_sleep(5);
 	print("Hello from thread %llu\n", t->id);
@@ -210,6 +699,244 @@ void test_thread_proc1(Thread* t) {
 	print("Hello from thread %llu\n", t->id);
 }
 
+void test_job_increment(void *data) {
+	*(u64*)data += 1;
+}
+typedef struct Test_Nested_Job_Data {
+	u64 hits[8];
+} Test_Nested_Job_Data;
+void test_job_nested(void *data) {
+	Test_Nested_Job_Data *d = (Test_Nested_Job_Data*)data;
+	Job_Counter counter = {0};
+	for (u64 i = 0; i < 8; i++) job_submit(test_job_increment, &d->hits[i], &counter);
+	job_wait_counter(&counter);
+	for (u64 i = 0; i < 8; i++) assert(d->hits[i] == 1, "Failed: nested job did not run exactly once");
+}
+void test_job_from_other_thread(Thread *t) {
+	u64 *hits = (u64*)t->data;
+	Job_Counter counter = {0};
+	for (u64 i = 0; i < 1000; i++) job_submit(test_job_increment, &hits[i], &counter);
+	job_wait_counter(&counter);
+}
+// Something that takes a while and can't be optimized out
+void test_parallel_for_work(u64 first, u64 last, void *userdata) {
+	f32 *results = (f32*)userdata;
+	for (u64 i = first; i < last; i++) {
+		f32 x = (f32)i;
+		for (u64 j = 0; j < 64; j++) x = sqrtf(x*x + 1.0f);
+		results[i] = x;
+	}
+}
+void test_parallel_for_mark(u64 first, u64 last, void *userdata) {
+	u64 *hits = (u64*)userdata;
+	for (u64 i = first; i < last; i++) hits[i] += 1;
+}
+
+void test_jobs() {
+	Allocator heap = get_heap_allocator();
+	
+	job_system_init(0);
+	assert(job_get_worker_count() == os_get_number_of_logical_processors(), "Failed: job system worker count");
+	job_system_shutdown();
+	
+	// At least a few workers so there's stealing going on even on small machines
+	job_system_init(max(os_get_number_of_logical_processors(), 4));
+	u64 worker_count = job_get_worker_count();
+	
+	// Every job runs exactly once, even more jobs than fit in a deque
+	const u64 job_count = JOB_DEQUE_CAPACITY*3;
+	u64 *hits = (u64*)alloc(heap, job_count*sizeof(u64));
+	memset(hits, 0, job_count*sizeof(u64));
+	Job_Counter counter = {0};
+	for (u64 i = 0; i < job_count; i++) job_submit(test_job_increment, &hits[i], &counter);
+	job_wait_counter(&counter);
+	assert(counter.count == 0, "Failed: job counter");
+	for (u64 i = 0; i < job_count; i++) assert(hits[i] == 1, "Failed: job %llu ran %llu times", i, hits[i]);
+	
+	// Jobs which submit and wait for more jobs
+	Test_Nested_Job_Data nested[64];
+	memset(nested, 0, sizeof(nested));
+	for (u64 i = 0; i < 64; i++) job_submit(test_job_nested, &nested[i], &counter);
+	job_wait_counter(&counter);
+	
+	// Submitting from a thread which isn't a worker
+	memset(hits, 0, job_count*sizeof(u64));
+	Thread t;
+	os_thread_init(&t, test_job_from_other_thread);
+	t.data = hits;
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+	for (u64 i = 0; i < 1000; i++) assert(hits[i] == 1, "Failed: job submitted from another thread ran %llu times", hits[i]);
+	
+	// parallel_for covers every index once, with any batch size
+	u64 batches[] = { 0, 1, 7, 1000, job_count*2 };
+	for (u64 b = 0; b < sizeof(batches)/sizeof(batches[0]); b++) {
+		memset(hits, 0, job_count*sizeof(u64));
+		parallel_for(job_count, batches[b], test_parallel_for_mark, hits);
+		for (u64 i = 0; i < job_count; i++) assert(hits[i] == 1, "Failed: parallel_for with batch %llu hit %llu %llu times", batches[b], i, hits[i]);
+	}
+	dealloc(heap, hits);
+	
+	// Speed
+	const u64 n = 200000;
+	f32 *serial = (f32*)alloc(heap, n*sizeof(f32));
+	f32 *parallel = (f32*)alloc(heap, n*sizeof(f32));
+	
+	f64 start_seconds = os_get_current_time_in_seconds();
+	u64 start = rdtsc();
+	test_parallel_for_work(0, n, serial);
+	u64 serial_cycles = rdtsc()-start;
+	f64 serial_ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+	
+	start_seconds = os_get_current_time_in_seconds();
+	start = rdtsc();
+	parallel_for(n, 0, test_parallel_for_work, parallel);
+	u64 parallel_cycles = rdtsc()-start;
+	f64 parallel_ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+	
+	for (u64 i = 0; i < n; i++) assert(serial[i] == parallel[i], "Failed: parallel_for result mismatch");
+	print("\nparallel_for with %llu workers: serial %llu cycles (%.2f ms), parallel %llu cycles (%.2f ms), %.2fx\n", worker_count, serial_cycles, serial_ms, parallel_cycles, parallel_ms, (f64)serial_cycles/(f64)parallel_cycles);
+	
+	// Job overhead
+	const u64 small_job_count = 100000;
+	u64 *small_hits = (u64*)alloc(heap, small_job_count*sizeof(u64));
+	memset(small_hits, 0, small_job_count*sizeof(u64));
+	start = rdtsc();
+	for (u64 i = 0; i < small_job_count; i++) job_submit(test_job_increment, &small_hits[i], &counter);
+	job_wait_counter(&counter);
+	u64 job_cycles = rdtsc()-start;
+	print("%llu empty jobs: %llu cycles/job\n", small_job_count, job_cycles/small_job_count);
+	
+	dealloc(heap, serial);
+	dealloc(heap, parallel);
+	dealloc(heap, small_hits);
+	
+	job_system_shutdown();
+}
+
+typedef struct Test_Fiber_Data {
+	Fiber main;
+	Fiber fiber;
+	u64 switches;
+	f64 value;
+} Test_Fiber_Data;
+void test_fiber_proc(void *data) {
+	Test_Fiber_Data *d = (Test_Fiber_Data*)data;
+	f64 x = 1.0;
+	while (true) {
+		// Keep something in a register across the switch
+		x = x*0.5 + 1.0;
+		d->value = x;
+		d->switches += 1;
+		fiber_switch(&d->fiber, &d->main);
+	}
+}
+
+#define TEST_FIBER_JOB_COUNT 32
+typedef struct Test_Fiber_Job_Data {
+	Job_Counter gate;
+	volatile u64 started;
+	volatile u64 migrations;
+	volatile u64 atlas_count;
+} Test_Fiber_Job_Data;
+void test_fiber_job_wait_on_gate(void *data) {
+	Test_Fiber_Job_Data *d = (Test_Fiber_Job_Data*)data;
+	
+	u64 *temp = (u64*)talloc(256*sizeof(u64));
+	for (u64 i = 0; i < 256; i++) temp[i] = i*3;
+	u64 thread_before = get_context().thread_id;
+	
+	atomic_fetch_add_64(&d->started, 1, MEMORY_ORDER_RELAXED);
+	job_wait_counter(&d->gate);
+	
+	for (u64 i = 0; i < 256; i++) assert(temp[i] == i*3, "Failed: temporary storage changed while job was parked");
+	// Temporary storage still works after moving
+	u64 *more = (u64*)talloc(sizeof(u64));
+	*more = 5;
+	if (get_context().thread_id != thread_before) atomic_fetch_add_64(&d->migrations, 1, MEMORY_ORDER_RELAXED);
+}
+
+// Like decoding an asset, then uploading it, then building an atlas
+void test_fiber_job_decode(void *data) {
+	u64 *pixels = (u64*)data;
+	for (u64 i = 0; i < 64; i++) pixels[i] = i;
+}
+void test_fiber_job_upload(void *data) {
+	u64 *pixels = (u64*)data;
+	Job_Counter decoded = {0};
+	job_submit(test_fiber_job_decode, pixels, &decoded);
+	job_wait_counter(&decoded);
+	for (u64 i = 0; i < 64; i++) pixels[i] += 1;
+}
+void test_fiber_job_atlas(void *data) {
+	Test_Fiber_Job_Data *d = (Test_Fiber_Job_Data*)data;
+	u64 *pixels = (u64*)talloc(8*64*sizeof(u64));
+	Job_Counter uploaded = {0};
+	for (u64 i = 0; i < 8; i++) job_submit(test_fiber_job_upload, pixels + i*64, &uploaded);
+	job_wait_counter(&uploaded);
+	for (u64 i = 0; i < 8*64; i++) assert(pixels[i] == (i%64)+1, "Failed: fiber job chain result");
+	atomic_fetch_add_64(&d->atlas_count, 1, MEMORY_ORDER_RELAXED);
+}
+
+void test_job_fibers() {
+	Allocator heap = get_heap_allocator();
+	
+	// Raw fibers
+	Test_Fiber_Data fd = ZERO(Test_Fiber_Data);
+	u64 stack_size = KB(64);
+	void *stack = alloc(heap, stack_size);
+	fiber_init(&fd.fiber, stack, stack_size, test_fiber_proc, &fd);
+	f64 expected = 1.0;
+	f64 kept = 3.25;
+	for (u64 i = 0; i < 10; i++) {
+		fiber_switch(&fd.main, &fd.fiber);
+		expected = expected*0.5 + 1.0;
+		assert(fd.switches == i+1 && fd.value == expected, "Failed: fiber did not continue where it left off");
+		kept *= 2.0;
+	}
+	assert(kept == 3.25*1024.0, "Failed: register not preserved across fiber switch");
+	
+	const u64 switch_count = 100000;
+	u64 start = rdtsc();
+	for (u64 i = 0; i < switch_count; i++) fiber_switch(&fd.main, &fd.fiber);
+	u64 cycles = rdtsc()-start;
+	print("\nFiber switch there and back: %llu cycles", cycles/switch_count);
+	dealloc(heap, stack);
+	
+	job_system_init(max(os_get_number_of_logical_processors(), 4));
+	
+	// Waiting jobs park their fiber instead of blocking the worker, so all of these can be
+	// waiting at once even though there are fewer workers
+	Test_Fiber_Job_Data *d = (Test_Fiber_Job_Data*)alloc(heap, sizeof(Test_Fiber_Job_Data));
+	memset(d, 0, sizeof(*d));
+	d->gate.count = 1;
+	Job_Counter done = {0};
+	for (u64 i = 0; i < TEST_FIBER_JOB_COUNT; i++) job_submit(test_fiber_job_wait_on_gate, d, &done);
+	// (The rest wait in place if JOB_FIBER_COUNT is smaller)
+	u64 expected_parked = min(TEST_FIBER_JOB_COUNT, JOB_FIBER_COUNT);
+	f64 give_up = os_get_current_time_in_seconds() + 10.0;
+	while (d->started < TEST_FIBER_JOB_COUNT || job_waiting_fiber_count < expected_parked) {
+		assert(os_get_current_time_in_seconds() < give_up, "Failed: only %llu jobs parked", job_waiting_fiber_count);
+		os_yield_thread();
+	}
+	job_counter_add(&d->gate, -1);
+	job_wait_counter(&done);
+	assert(job_waiting_fiber_count == 0, "Failed: parked fibers left after their counter reached 0");
+	print("\n%d parked jobs, %llu continued on another thread", TEST_FIBER_JOB_COUNT, d->migrations);
+	
+	// Chains of jobs waiting on jobs
+	start = rdtsc();
+	for (u64 i = 0; i < 64; i++) job_submit(test_fiber_job_atlas, d, &done);
+	job_wait_counter(&done);
+	cycles = rdtsc()-start;
+	assert(d->atlas_count == 64, "Failed: fiber job chains");
+	print("\n64 atlas jobs waiting on 8 upload jobs waiting on 1 decode job: %llu cycles\n", cycles);
+	
+	dealloc(heap, d);
+	job_system_shutdown();
+}
+
 void test_threads() {
 	
 	Thread t;
@@ -225,6 +952,139 @@ void test_threads() {
 	os_unlock_mutex(m);
 }
 
+typedef struct Test_Thread_Settings_Data {
+	u64 pinned_mask;
+	bool started;
+	bool pinned;
+	bool unpinned;
+	bool renamed;
+	bool lowered_priority;
+	// What a DEFAULT thread started from the pinned, lowered thread ended up with
+	u64 processor_count;
+	u64 child_processor_count;
+	s64 child_priority;
+	bool can_raise_priority;
+} Test_Thread_Settings_Data;
+u64 test_current_thread_processor_count() {
+#if TARGET_OS == LINUX
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	sched_getaffinity(0, sizeof(set), &set);
+	return (u64)CPU_COUNT(&set);
+#else
+	return 0; // Windows threads don't inherit affinity from the thread that made them
+#endif
+}
+s64 test_current_thread_os_priority() {
+#if TARGET_OS == LINUX
+	return (s64)getpriority(PRIO_PROCESS, (id_t)linux_get_thread_id());
+#elif TARGET_OS == WINDOWS
+	return (s64)(GetThreadPriority(GetCurrentThread()) - THREAD_PRIORITY_NORMAL);
+#endif
+}
+void test_thread_settings_child_proc(Thread *t) {
+	Test_Thread_Settings_Data *d = (Test_Thread_Settings_Data*)t->data;
+	d->child_processor_count = test_current_thread_processor_count();
+	d->child_priority = test_current_thread_os_priority();
+}
+void test_thread_settings_proc(Thread *t) {
+	Test_Thread_Settings_Data *d = (Test_Thread_Settings_Data*)t->data;
+	d->started = true;
+	d->pinned = os_set_current_thread_affinity(d->pinned_mask);
+	d->lowered_priority = os_set_current_thread_priority(THREAD_PRIORITY_CLASS_BACKGROUND);
+	
+	// A DEFAULT thread must not inherit our pinning or priority
+	Thread child;
+	os_thread_init(&child, test_thread_settings_child_proc);
+	child.data = d;
+	os_thread_start(&child);
+	os_thread_join(&child);
+	os_thread_destroy(&child);
+	
+	d->unpinned = os_set_current_thread_affinity(0);
+	d->renamed = os_set_current_thread_name(STR("ogb renamed"));
+	d->lowered_priority = os_set_current_thread_priority(THREAD_PRIORITY_CLASS_BACKGROUND) && d->lowered_priority;
+}
+
+void test_thread_settings() {
+	Cpu_Topology topology;
+	os_get_cpu_topology(&topology);
+	
+	u64 logical_count = min(topology.logical_processor_count, (u64)64);
+	assert(logical_count >= 1, "Failed: no logical processors");
+	assert(topology.physical_core_count >= 1 && topology.physical_core_count <= logical_count, "Failed: %llu physical cores for %llu logical processors", topology.physical_core_count, logical_count);
+	assert(os_get_number_of_physical_cores() == topology.physical_core_count, "Failed: os_get_number_of_physical_cores");
+	
+	// Every logical processor is on exactly one core
+	u64 all_cores = 0;
+	for (u64 i = 0; i < topology.physical_core_count; i++) {
+		assert(topology.core_masks[i] != 0, "Failed: empty core mask");
+		assert((all_cores & topology.core_masks[i]) == 0, "Failed: logical processor is on two cores");
+		all_cores |= topology.core_masks[i];
+	}
+	for (u64 i = 0; i < topology.cache_group_count; i++) {
+		Cpu_Cache_Group *g = &topology.cache_groups[i];
+		assert(g->level >= 1 && g->logical_processor_mask != 0, "Failed: bad cache group");
+		for (u64 j = 0; j < i; j++) {
+			Cpu_Cache_Group *other = &topology.cache_groups[j];
+			assert(g->level != other->level || g->logical_processor_mask != other->logical_processor_mask, "Failed: duplicate cache group");
+		}
+	}
+	
+	print("\n%llu logical processors, %llu physical cores", topology.logical_processor_count, topology.physical_core_count);
+	for (u64 i = 0; i < topology.cache_group_count; i++) {
+		Cpu_Cache_Group *g = &topology.cache_groups[i];
+		print("\nL%u cache, %llu kb, shared by processors 0x%llx", g->level, g->size/1024, g->logical_processor_mask);
+	}
+	
+	Test_Thread_Settings_Data d = ZERO(Test_Thread_Settings_Data);
+	d.pinned_mask = topology.core_masks[0];
+	d.processor_count = test_current_thread_processor_count();
+#if TARGET_OS == LINUX
+	// Going from nice 10 back to 0 needs CAP_SYS_NICE or RLIMIT_NICE
+	struct rlimit nice_limit;
+	d.can_raise_priority = geteuid() == 0 || (getrlimit(RLIMIT_NICE, &nice_limit) == 0 && nice_limit.rlim_cur >= 20);
+#else
+	d.can_raise_priority = true;
+#endif
+	Thread t;
+	os_thread_init(&t, test_thread_settings_proc);
+	t.data = &d;
+	t.name = STR("ogb test thread");
+	t.affinity_mask = topology.core_masks[topology.physical_core_count-1];
+	t.priority = THREAD_PRIORITY_CLASS_BACKGROUND;
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+	
+	assert(d.started, "Failed: thread with settings didn't run");
+	assert(d.unpinned, "Failed: couldn't let a thread run on any processor");
+	assert(d.lowered_priority, "Failed: couldn't lower thread priority");
+	assert(d.child_processor_count == d.processor_count, "Failed: default thread inherited affinity, runs on %llu of %llu processors", d.child_processor_count, d.processor_count);
+	assert(!d.can_raise_priority || d.child_priority == 0, "Failed: default thread inherited priority %lld", d.child_priority);
+	// Pinning can be refused if we're limited to some processors (like in a container), and
+	// naming needs windows 10
+	print("\nPinning %cs, naming %cs\n", d.pinned ? "worked" : "was refused", d.renamed ? "worked" : "is not supported");
+}
+
+#define TEST_ALLOCATOR_THREADED_BATCH 64
+typedef struct Test_Allocator_Threaded_Data {
+	u64 op_count;
+	u64 thread_index;
+	u64 thread_count;
+	// Threads hand batches of allocations to the next thread which frees them
+	void **volatile *mailboxes;
+	u64 alloc_count;
+} Test_Allocator_Threaded_Data;
+
+void test_allocator_threaded_free_batch(void **batch) {
+	for (u64 i = 0; i < TEST_ALLOCATOR_THREADED_BATCH; i++) {
+		assert(*(u64*)batch[i] == i, "Failed: cross-thread allocation was corrupted");
+		heap_dealloc(batch[i]);
+	}
+	heap_dealloc(batch);
+}
+
 void test_allocator_threaded(Thread *t) {
 
 	Allocator heap = get_heap_allocator();
@@ -256,6 +1116,363 @@ void test_allocator_threaded(Thread *t) {
             dealloc(heap, mixed_blocks[i]);
         }
     }
+    
+    Test_Allocator_Threaded_Data *data = (Test_Allocator_Threaded_Data*)t->data;
+    if (!data) return;
+    
+    // Random small allocations, every now and then passing a batch to the next thread
+    void *live[256] = {0};
+    u64 seed = 69 + data->thread_index; // get_random() isn't thread safe
+    u64 alloc_count = 0;
+    void **volatile *my_mailbox = &data->mailboxes[data->thread_index];
+    void **volatile *next_mailbox = &data->mailboxes[(data->thread_index+1)%data->thread_count];
+    
+    for (u64 i = 0; i < data->op_count; i++) {
+    	seed = seed*MULTIPLIER + INCREMENT;
+    	u64 index = (seed >> 33) % 256;
+    	if (live[index]) {
+    		heap_dealloc(live[index]);
+    		live[index] = 0;
+    	} else {
+    		live[index] = heap_alloc(16 + (seed >> 40) % 1008);
+    		alloc_count += 1;
+    	}
+    	
+    	if (i % 1024 == 0) {
+    		void **batch = (void**)heap_alloc(TEST_ALLOCATOR_THREADED_BATCH*sizeof(void*));
+    		for (u64 j = 0; j < TEST_ALLOCATOR_THREADED_BATCH; j++) {
+    			batch[j] = heap_alloc(16 + j*8);
+    			*(u64*)batch[j] = j;
+    		}
+    		alloc_count += TEST_ALLOCATOR_THREADED_BATCH+1;
+    		if (!compare_and_swap_64((volatile u64*)next_mailbox, (u64)batch, 0)) {
+    			test_allocator_threaded_free_batch(batch);
+    		}
+    		
+    		void **received = *my_mailbox;
+    		if (received && compare_and_swap_64((volatile u64*)my_mailbox, 0, (u64)received)) {
+    			test_allocator_threaded_free_batch(received);
+    		}
+    	}
+    }
+    
+    for (u64 i = 0; i < 256; i++) {
+    	if (live[i]) heap_dealloc(live[i]);
+    }
+    
+    data->alloc_count = alloc_count;
+}
+
+void test_heap_stats_thread_proc(Thread *t) {
+	// Allocated with the tag inherited from the starting thread, freed on the starting thread
+	void **out = (void**)t->data;
+	*out = alloc(get_heap_allocator(), 1000);
+}
+void test_heap_stats() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 tag = heap_make_tag(STR("test"));
+	assert(strings_match(heap_get_tag_name(tag), STR("test")), "Failed: heap_get_tag_name");
+	assert(strings_match(heap_get_tag_name(0), STR("untagged")), "Failed: untagged heap tag name");
+	
+	Heap_Stats before = get_heap_stats();
+	assert(before.tagged_live_bytes[tag] == 0, "Failed: new heap tag should have no bytes");
+	
+	Context c = get_context();
+	c.allocation_tag = tag;
+	push_context(c);
+	void *small = alloc(heap, 100);
+	void *medium = alloc(heap, KB(100));
+	void *large = alloc(heap, MB(4));
+	
+	void *from_thread = 0;
+	Thread t;
+	os_thread_init(&t, test_heap_stats_thread_proc);
+	t.data = &from_thread;
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+	pop_context();
+	
+	void *untagged = alloc(heap, 100);
+	
+	Heap_Stats during = get_heap_stats();
+	u64 expected = 0;
+	void *tagged[] = { small, medium, large, from_thread };
+	for (u64 i = 0; i < sizeof(tagged)/sizeof(tagged[0]); i++) {
+		expected += ((Heap_Allocation_Metadata*)tagged[i] - 1)->size;
+	}
+	assert(during.tagged_live_bytes[tag] == expected, "Failed: tagged live bytes is %llu, expected %llu", during.tagged_live_bytes[tag], expected);
+	assert(during.live_allocation_count >= before.live_allocation_count + 5, "Failed: heap live allocation count");
+	assert(during.live_bytes >= before.live_bytes + expected, "Failed: heap live bytes");
+	assert(during.committed_bytes >= during.live_bytes, "Failed: heap committed bytes should cover live bytes");
+	assert(during.largest_free_block <= during.free_bytes, "Failed: largest free block");
+	assert(during.fragmentation >= 0.0f && during.fragmentation <= 1.0f, "Failed: heap fragmentation ratio");
+	
+	// Reallocating keeps the tag even when it has to move
+	u64 medium_size = ((Heap_Allocation_Metadata*)medium - 1)->size;
+	medium = heap_realloc(medium, MB(2));
+	Heap_Stats after_realloc = get_heap_stats();
+	expected += ((Heap_Allocation_Metadata*)medium - 1)->size - medium_size;
+	assert(after_realloc.tagged_live_bytes[tag] == expected, "Failed: realloc should keep the allocation tag");
+	
+	dealloc(heap, small);
+	dealloc(heap, medium);
+	dealloc(heap, large);
+	dealloc(heap, from_thread);
+	dealloc(heap, untagged);
+	
+	Heap_Stats after = get_heap_stats();
+	assert(after.tagged_live_bytes[tag] == 0, "Failed: tagged live bytes after free");
+	assert(after.live_bytes == before.live_bytes, "Failed: heap live bytes after free (%llu, was %llu)", after.live_bytes, before.live_bytes);
+	assert(after.live_allocation_count == before.live_allocation_count, "Failed: heap live allocation count after free");
+	
+	const u64 stats_count = 1000;
+	u64 start_cycles = rdtsc();
+	for (u64 i = 0; i < stats_count; i++) {
+		after = get_heap_stats();
+	}
+	u64 cycles = rdtsc() - start_cycles;
+	print("get_heap_stats takes %llu cycles with %llu free nodes... ", cycles/stats_count, after.free_node_count);
+}
+
+void test_heap_trim() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 count = 32;
+	void *blocks[32];
+	for (u64 i = 0; i < count; i++) {
+		blocks[i] = alloc(heap, KB(256));
+		memset(blocks[i], 0x42, KB(256));
+	}
+	for (u64 i = 0; i < count; i++) dealloc(heap, blocks[i]);
+	
+	Heap_Stats before = get_heap_stats();
+	u64 trimmed = heap_trim();
+	Heap_Stats after = get_heap_stats();
+	// With HEAP_DECOMMIT_THRESHOLD some of it may have been decommitted already
+	assert(after.decommitted_bytes >= KB(256)*(count-1), "Failed: heap_trim only decommitted %llu bytes", trimmed);
+	assert(after.committed_bytes + trimmed == before.committed_bytes, "Failed: heap_trim committed bytes");
+	assert(after.decommitted_bytes == before.decommitted_bytes + trimmed, "Failed: heap_trim decommitted bytes");
+	assert(heap_trim() == 0, "Failed: heap_trim should not decommit anything twice");
+	
+	// Decommitted pages are committed again when handed out
+	for (u64 i = 0; i < count; i++) {
+		u8 *p = (u8*)alloc(heap, KB(256));
+		for (u64 j = 0; j < KB(256); j += 1024) assert(p[j] == 0, "Failed: recommitted heap memory is not zero");
+		memset(p, 0x42, KB(256));
+		blocks[i] = p;
+	}
+	Heap_Stats reused = get_heap_stats();
+	assert(reused.decommitted_bytes < after.decommitted_bytes, "Failed: heap did not recommit pages");
+	for (u64 i = 0; i < count; i++) dealloc(heap, blocks[i]);
+}
+
+void test_alloc_aligned() {
+	Allocator heap = get_heap_allocator();
+	
+	// Small, free list and large allocations
+	u64 sizes[] = { 24, 1000, KB(16), KB(300), MB(2) };
+	u64 alignments[] = { 8, 16, 64, 256, 4096 };
+	for (u64 i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+		for (u64 j = 0; j < sizeof(alignments)/sizeof(alignments[0]); j++) {
+			u8 *p = (u8*)alloc_aligned(heap, sizes[i], alignments[j]);
+			assert((u64)p % alignments[j] == 0, "Failed: heap allocation not aligned to %llu", alignments[j]);
+			memset(p, 0x42, sizes[i]);
+			
+			u8 *q = (u8*)reallocate(heap, p, sizes[i], sizes[i]*2);
+			assert((u64)q % alignments[j] == 0, "Failed: heap reallocation lost the alignment %llu", alignments[j]);
+			for (u64 k = 0; k < sizes[i]; k += 7) assert(q[k] == 0x42, "Failed: heap reallocation lost the data");
+			memset(q, 0x42, sizes[i]*2);
+			dealloc(heap, q);
+		}
+	}
+	
+	// Aligned allocations are accounted like any other
+	Heap_Stats before = get_heap_stats();
+	void *p = alloc_aligned(heap, 1000, 256);
+	Heap_Stats during = get_heap_stats();
+	dealloc(heap, p);
+	Heap_Stats after = get_heap_stats();
+	assert(during.live_allocation_count == before.live_allocation_count+1, "Failed: aligned heap allocation count");
+	assert(during.live_bytes >= before.live_bytes+1000, "Failed: aligned heap allocation bytes");
+	assert(after.live_bytes == before.live_bytes && after.live_allocation_count == before.live_allocation_count, "Failed: aligned heap deallocation");
+	
+	Allocator temp = get_temporary_allocator();
+	reset_temporary_storage();
+	for (u64 i = 0; i < 100; i++) {
+		talloc(3);
+		u8 *t = (u8*)alloc_aligned(temp, 100, 64);
+		assert((u64)t % 64 == 0, "Failed: temporary allocation not aligned");
+		memset(t, 0x42, 100);
+	}
+	// Last allocation still resizes in place
+	u8 *t = (u8*)alloc_aligned(temp, 64, 128);
+	assert((u64)t % 128 == 0, "Failed: temporary allocation not aligned");
+	assert(reallocate(temp, t, 64, 128) == t, "Failed: aligned temporary allocation was not resized in place");
+	reset_temporary_storage();
+	
+	Arena *arena = arena_make(MB(1));
+	Allocator arena_allocator = get_arena_allocator(arena);
+	for (u64 i = 0; i < 100; i++) {
+		arena_push(arena, 3);
+		u8 *a = (u8*)alloc_aligned(arena_allocator, 100, 256);
+		assert((u64)a % 256 == 0, "Failed: arena allocation not aligned");
+		memset(a, 0x42, 100);
+	}
+	arena_destroy(arena);
+	
+	reset_frame_storage();
+	falloc(3);
+	u8 *f = (u8*)alloc_aligned(get_frame_allocator(), 100, 64);
+	assert((u64)f % 64 == 0, "Failed: frame allocation not aligned");
+	reset_frame_storage();
+	reset_frame_storage();
+	
+	typedef struct Test_Cache_Line_Thing {
+		u64 counter;
+	} Test_Cache_Line_Thing;
+	Pool pool;
+	pool_init_aligned(&pool, Test_Cache_Line_Thing, 64);
+	Allocator pool_allocator = get_pool_allocator(&pool);
+	Test_Cache_Line_Thing *last = 0;
+	for (u64 i = 0; i < 10000; i++) {
+		Test_Cache_Line_Thing *thing = (Test_Cache_Line_Thing*)alloc_aligned(pool_allocator, sizeof(Test_Cache_Line_Thing), 64);
+		assert((u64)thing % 64 == 0, "Failed: pool item not aligned");
+		assert(!last || thing != last, "Failed: pool handed out the same item twice");
+		thing->counter = i;
+		last = thing;
+	}
+	pool_deinit(&pool);
+}
+
+void test_guard_page_allocations() {
+	Allocator heap = get_heap_allocator();
+	
+	for (u64 size = 16; size <= KB(256); size *= 4) {
+		u8 *p = (u8*)alloc(heap, size);
+		assert((u64)(p+size) % os.page_size == 0, "Failed: guarded allocation does not end at its guard page");
+		memset(p, 0x42, size);
+		
+		u8 *q = (u8*)reallocate(heap, p, size, size*2);
+		assert(q != p, "Failed: guarded reallocation was not moved");
+		assert((u64)(q+size*2) % os.page_size == 0, "Failed: guarded reallocation does not end at its guard page");
+		for (u64 i = 0; i < size; i++) assert(q[i] == 0x42, "Failed: guarded reallocation lost the data");
+		dealloc(heap, q);
+	}
+	
+	u8 *aligned = (u8*)alloc_aligned(heap, 100, 64);
+	assert((u64)aligned % 64 == 0, "Failed: guarded aligned allocation");
+	memset(aligned, 0x42, 100);
+	dealloc(heap, aligned);
+	
+	// Freed ranges are decommitted and recycled through the quarantine, so lots of short lived
+	// allocations don't grow anything. Warm up until the quarantine is full first.
+	const u64 sizes[] = {16, 100, KB(5)};
+	for (u64 i = 0; i < HEAP_GUARD_QUARANTINE_COUNT*2; i++) {
+		dealloc(heap, alloc(heap, sizes[i%3]));
+	}
+	u64 program_memory_before = program_memory_capacity;
+	u64 committed_before = get_heap_stats().committed_bytes;
+	for (u64 i = 0; i < 100000; i++) {
+		u8 *p = (u8*)alloc(heap, sizes[i%3]);
+		p[0] = 1;
+		dealloc(heap, p);
+	}
+	assert(program_memory_capacity == program_memory_before, "Failed: guarded alloc/free keeps growing program memory (%llu -> %llu)", program_memory_before, program_memory_capacity);
+	assert(get_heap_stats().committed_bytes == committed_before, "Failed: guarded alloc/free keeps committing memory");
+}
+
+void test_frame_storage() {
+	reset_frame_storage();
+	reset_frame_storage();
+	
+	// Frame N
+	u64 *a = (u64*)falloc(sizeof(u64));
+	*a = 69;
+	Allocator allocator = get_frame_allocator();
+	u64 *b = (u64*)alloc(allocator, sizeof(u64));
+	*b = 420;
+	
+	// Frame N+1: N's allocations are still there
+	reset_frame_storage();
+	u64 *c = (u64*)falloc(sizeof(u64));
+	*c = 1337;
+	for (u64 i = 0; i < 1000; i++) falloc(KB(1));
+	assert(*a == 69 && *b == 420, "Failed: frame storage from the previous frame was overwritten");
+	assert(c != a && c != b, "Failed: frame storage handed out memory of the previous frame");
+	
+	// Frame N+2: N's memory is reused, N+1 is still there
+	reset_frame_storage();
+	u64 *d = (u64*)falloc(sizeof(u64));
+	assert(d == a, "Failed: frame storage did not reuse memory from two frames ago");
+	assert(*c == 1337, "Failed: frame storage from the previous frame was overwritten");
+	
+	// Way over FRAME_STORAGE_SIZE still doesn't overwrite anything
+	u8 *big = (u8*)falloc(FRAME_STORAGE_SIZE*2);
+	memset(big, 0x42, FRAME_STORAGE_SIZE*2);
+	assert(*c == 1337, "Failed: frame storage overflow overwrote the previous frame");
+	assert(get_frame_storage_high_water_mark() >= FRAME_STORAGE_SIZE*2, "Failed: frame storage high water mark");
+	
+	// Growing an allocation from the previous frame copies it into the current frame
+	u64 *e = (u64*)alloc(allocator, sizeof(u64)*4);
+	for (u64 i = 0; i < 4; i++) e[i] = i+1;
+	reset_frame_storage();
+	u64 *f = (u64*)falloc(sizeof(u64));
+	*f = 7;
+	u64 *g = (u64*)reallocate(allocator, e, sizeof(u64)*4, sizeof(u64)*64);
+	assert(g != e, "Failed: frame allocator reallocated in place across frames");
+	for (u64 i = 0; i < 4; i++) assert(g[i] == i+1, "Failed: frame allocator lost data in cross-frame reallocate");
+	for (u64 i = 4; i < 64; i++) g[i] = 0xFF;
+	assert(*f == 7, "Failed: cross-frame reallocate overwrote the current frame");
+	assert(e[0] == 1 && e[3] == 4, "Failed: cross-frame reallocate overwrote the previous frame");
+	
+	// Growing an allocation from the current frame still works
+	u64 *h = (u64*)reallocate(allocator, g, sizeof(u64)*64, sizeof(u64)*128);
+	assert(h[0] == 1 && h[3] == 4 && h[63] == 0xFF, "Failed: frame allocator reallocate in the same frame");
+	
+	reset_frame_storage();
+	reset_frame_storage();
+}
+
+void test_allocator_threaded_speed() {
+	
+	const u64 op_count = 200000;
+	
+	for (u64 thread_count = 1; thread_count <= 8; thread_count *= 2) {
+		Thread *threads = (Thread*)alloc(get_heap_allocator(), thread_count*sizeof(Thread));
+		Test_Allocator_Threaded_Data *datas = (Test_Allocator_Threaded_Data*)alloc(get_heap_allocator(), thread_count*sizeof(Test_Allocator_Threaded_Data));
+		void ***mailboxes = (void***)alloc(get_heap_allocator(), thread_count*sizeof(void**));
+		memset(mailboxes, 0, thread_count*sizeof(void**));
+		
+		for (u64 i = 0; i < thread_count; i++) {
+			datas[i] = (Test_Allocator_Threaded_Data){0};
+			datas[i].op_count = op_count;
+			datas[i].thread_index = i;
+			datas[i].thread_count = thread_count;
+			datas[i].mailboxes = mailboxes;
+			os_thread_init(&threads[i], test_allocator_threaded);
+			threads[i].data = &datas[i];
+		}
+		
+		float64 start_seconds = os_get_current_time_in_seconds();
+		for (u64 i = 0; i < thread_count; i++) os_thread_start(&threads[i]);
+		for (u64 i = 0; i < thread_count; i++) os_thread_join(&threads[i]);
+		float64 end_seconds = os_get_current_time_in_seconds();
+		
+		u64 alloc_count = 0;
+		for (u64 i = 0; i < thread_count; i++) {
+			alloc_count += datas[i].alloc_count;
+			if (mailboxes[i]) test_allocator_threaded_free_batch(mailboxes[i]);
+			os_thread_destroy(&threads[i]);
+		}
+		
+		print("%llu threads: %.2f million allocs/sec\n", thread_count, (float64)alloc_count/(end_seconds-start_seconds)/1000000.0);
+		
+		dealloc(get_heap_allocator(), threads);
+		dealloc(get_heap_allocator(), datas);
+		dealloc(get_heap_allocator(), mailboxes);
+	}
 }
 
 void test_strings() {
@@ -489,7 +1706,7 @@ void test_file_io() {
     assert(file != OS_INVALID_FILE, "Failed: os_file_open (read)");
     string hello_world_read = talloc_string(hello_world_write.count);
     bool read_result = os_file_read(file, hello_world_read.data, hello_world_read.count, &hello_world_read.count);
-    assert(read_result, "Failed: os_file_read %d", GetLastError());
+    assert(read_result, "Failed: os_file_read");
     assert(strings_match(hello_world_read, hello_world_write), "Failed: os_file_read write/read mismatch");
     os_file_close(file);
 
@@ -597,26 +1814,19 @@ void test_simd() {
 
 	
 
-    f32 *a_f32 = alloc(get_heap_allocator(), 128*sizeof(f32));
-    f32 *b_f32 = alloc(get_heap_allocator(), 128*sizeof(f32));
-    f32 *result_f32 = alloc(get_heap_allocator(), 128*sizeof(f32));
-    s32 *a_i32 = alloc(get_heap_allocator(), 128*sizeof(f32));
-    s32 *b_i32 = alloc(get_heap_allocator(), 128*sizeof(f32));
-    s32 *result_i32 = alloc(get_heap_allocator(), 128*sizeof(f32));
-    
-    (*(u64*)&a_f32) = ((*(u64*)&a_f32)+64) & ~(63);
-    (*(u64*)&b_f32) = ((*(u64*)&b_f32)+64) & ~(63);
-    (*(u64*)&result_f32) = ((*(u64*)&result_f32)+64) & ~(63);
-    (*(u64*)&a_i32) = ((*(u64*)&a_i32)+64) & ~(63);
-    (*(u64*)&b_i32) = ((*(u64*)&b_i32)+64) & ~(63);
-    (*(u64*)&result_i32) = ((*(u64*)&result_i32)+64) & ~(63);
+    f32 *a_f32 = alloc_aligned(get_heap_allocator(), 128*sizeof(f32), 64);
+    f32 *b_f32 = alloc_aligned(get_heap_allocator(), 128*sizeof(f32), 64);
+    f32 *result_f32 = alloc_aligned(get_heap_allocator(), 128*sizeof(f32), 64);
+    s32 *a_i32 = alloc_aligned(get_heap_allocator(), 128*sizeof(f32), 64);
+    s32 *b_i32 = alloc_aligned(get_heap_allocator(), 128*sizeof(f32), 64);
+    s32 *result_i32 = alloc_aligned(get_heap_allocator(), 128*sizeof(f32), 64);
     
-    assert((u64)a_f32%16 == 0);
-    assert((u64)b_f32%16 == 0);
-    assert((u64)result_f32%16 == 0);
-    assert((u64)a_i32%16 == 0);
-    assert((u64)b_i32%16 == 0);
-    assert((u64)result_i32%16 == 0);
+    assert((u64)a_f32%64 == 0);
+    assert((u64)b_f32%64 == 0);
+    assert((u64)result_f32%64 == 0);
+    assert((u64)a_i32%64 == 0);
+    assert((u64)b_i32%64 == 0);
+    assert((u64)result_i32%64 == 0);
     
     assert((u64)a_f32%32 == 0);
     assert((u64)b_f32%32 == 0);
@@ -770,10 +1980,8 @@ void test_simd() {
     #define _TEST_NUM_SAMPLES ((100000 + 64) & ~(63))
     assert(_TEST_NUM_SAMPLES % 16 == 0);
     
-    float *samples_a = alloc(get_heap_allocator(), _TEST_NUM_SAMPLES*sizeof(float)+512);
-    float *samples_b = alloc(get_heap_allocator(), _TEST_NUM_SAMPLES*sizeof(float)+512);
-    samples_a = (float*)(((u64)samples_a+64)&~(63));
-    samples_b = (float*)(((u64)samples_b+64)&~(63));
+    float *samples_a = alloc_aligned(get_heap_allocator(), _TEST_NUM_SAMPLES*sizeof(float), 64);
+    float *samples_b = alloc_aligned(get_heap_allocator(), _TEST_NUM_SAMPLES*sizeof(float), 64);
     memset(samples_a, 2, _TEST_NUM_SAMPLES*sizeof(float));
     memset(samples_b, 2, _TEST_NUM_SAMPLES*sizeof(float));
     
@@ -838,6 +2046,15 @@ void test_simd() {
     end = rdtsc();
     cycles = end-start;
     print("NO SIMD float32 mul took %llu cycles\n", cycles);
+    
+    dealloc(get_heap_allocator(), a_f32);
+    dealloc(get_heap_allocator(), b_f32);
+    dealloc(get_heap_allocator(), result_f32);
+    dealloc(get_heap_allocator(), a_i32);
+    dealloc(get_heap_allocator(), b_i32);
+    dealloc(get_heap_allocator(), result_i32);
+    dealloc(get_heap_allocator(), samples_a);
+    dealloc(get_heap_allocator(), samples_b);
 } 
 
 // Indirect testing of some simd stuff
@@ -1188,15 +2405,15 @@ void test_mutex() {
     
     // Test initialization
     mutex_init(&m);
-    assert(m.spin_time_microseconds == MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS, "Failed: Default spin time incorrect");
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after initialization");
+    assert(m.spin_count == MUTEX_DEFAULT_SPIN_COUNT, "Failed: Default spin count incorrect");
+    assert(m.state == MUTEX_UNLOCKED, "Failed: Mutex should not be acquired after initialization");
 
     // Test acquire and release without contention
     mutex_acquire_or_wait(&m);
-    assert(m.spinlock_acquired, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
+    assert(m.state == MUTEX_LOCKED, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
     
     mutex_release(&m);
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after mutex_release");
+    assert(m.state == MUTEX_UNLOCKED, "Failed: Mutex should not be acquired after mutex_release");
 
     // Clean up
     mutex_destroy(&m);
@@ -1227,7 +2444,807 @@ void test_mutex() {
     mutex_destroy(&data.mutex);
 }
 
-#ifndef OOGABOOGA_HEADLESS
+#define TEST_ATOMICS_OPS 200000
+typedef struct Test_Atomics_Data {
+	volatile u64 counter;
+	volatile u32 started;
+	volatile u32 bits;
+	bool use_cas;
+} Test_Atomics_Data;
+void test_atomics_thread(Thread *t) {
+	Test_Atomics_Data *d = (Test_Atomics_Data*)t->data;
+	for (u64 i = 0; i < TEST_ATOMICS_OPS; i++) {
+		if (d->use_cas) {
+			u64 old;
+			do { old = d->counter; } while (!compare_and_swap_64(&d->counter, old+1, old));
+		} else {
+			atomic_fetch_add_64(&d->counter, 1, MEMORY_ORDER_RELAXED);
+		}
+	}
+	u32 index = atomic_fetch_add_32(&d->started, 1, MEMORY_ORDER_RELAXED);
+	atomic_fetch_or_32(&d->bits, 1u << index, MEMORY_ORDER_RELAXED);
+}
+void test_atomics() {
+	volatile u8 a8 = 250;
+	assert(atomic_fetch_add_8(&a8, 10, MEMORY_ORDER_RELAXED) == 250 && a8 == 4, "Failed: atomic_fetch_add_8 should wrap");
+	assert(atomic_fetch_sub_8(&a8, 5, MEMORY_ORDER_SEQ_CST) == 4 && a8 == 255, "Failed: atomic_fetch_sub_8 should wrap");
+	
+	volatile u16 a16 = 0xF0F0;
+	assert(atomic_fetch_and_16(&a16, 0xFF00, MEMORY_ORDER_ACQUIRE) == 0xF0F0 && a16 == 0xF000, "Failed: atomic_fetch_and_16");
+	assert(atomic_fetch_or_16(&a16, 0x000F, MEMORY_ORDER_RELEASE) == 0xF000 && a16 == 0xF00F, "Failed: atomic_fetch_or_16");
+	
+	volatile u32 a32 = 0;
+	atomic_store_32(&a32, 7, MEMORY_ORDER_RELEASE);
+	assert(atomic_load_32(&a32, MEMORY_ORDER_ACQUIRE) == 7, "Failed: atomic_load_32/atomic_store_32");
+	assert(atomic_exchange_32(&a32, 9, MEMORY_ORDER_SEQ_CST) == 7 && a32 == 9, "Failed: atomic_exchange_32");
+	atomic_store_32(&a32, 11, MEMORY_ORDER_SEQ_CST);
+	assert(atomic_load_32(&a32, MEMORY_ORDER_SEQ_CST) == 11, "Failed: seq_cst atomic_store_32");
+	
+	volatile u64 a64 = 0xFFFFFFFFull;
+	assert(atomic_fetch_add_64(&a64, 1, MEMORY_ORDER_RELAXED) == 0xFFFFFFFFull && a64 == 0x100000000ull, "Failed: atomic_fetch_add_64 should carry past 32 bits");
+	assert(atomic_exchange_64(&a64, 3, MEMORY_ORDER_RELAXED) == 0x100000000ull, "Failed: atomic_exchange_64");
+	assert(atomic_fetch_sub_64(&a64, 4, MEMORY_ORDER_RELAXED) == 3 && a64 == UINT64_MAX, "Failed: atomic_fetch_sub_64 should wrap");
+	
+	int x, y;
+	void *volatile p = 0;
+	atomic_store_ptr(&p, &x, MEMORY_ORDER_RELEASE);
+	assert(atomic_exchange_ptr(&p, &y, MEMORY_ORDER_SEQ_CST) == &x, "Failed: atomic_exchange_ptr");
+	assert(atomic_load_ptr(&p, MEMORY_ORDER_ACQUIRE) == &y, "Failed: atomic_load_ptr");
+	
+	// Relaxed counter from many threads, compared to a compare_and_swap loop
+	const u64 thread_count = 8;
+	Thread threads[8];
+	for (u64 use_cas = 0; use_cas <= 1; use_cas++) {
+		Test_Atomics_Data d = ZERO(Test_Atomics_Data);
+		d.use_cas = use_cas;
+		f64 start_seconds = os_get_current_time_in_seconds();
+		u64 start = rdtsc();
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_init(&threads[i], test_atomics_thread);
+			threads[i].data = &d;
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_join(&threads[i]);
+			os_thread_destroy(&threads[i]);
+		}
+		u64 cycles = rdtsc()-start;
+		f64 ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+		assert(d.counter == thread_count*TEST_ATOMICS_OPS, "Failed: threaded atomic counter is %llu", d.counter);
+		assert(d.bits == (1u << thread_count)-1, "Failed: threaded atomic_fetch_or_32");
+		print("\n%cs, %llu threads: %llu cycles per increment (%.2f ms total)", use_cas ? "compare_and_swap loop" : "atomic_fetch_add relaxed", thread_count, cycles/(thread_count*TEST_ATOMICS_OPS), ms);
+	}
+	print("\n");
+}
+
+// The Mutex and Binary_Semaphore we had before they were built on os_wait_on_address,
+// to compare against.
+typedef struct Test_Old_Mutex {
+	Spinlock spinlock;
+	f64 spin_time_microseconds;
+	Mutex_Handle os_handle;
+	volatile bool spinlock_acquired;
+} Test_Old_Mutex;
+void test_old_mutex_init(Test_Old_Mutex *m) {
+	spinlock_init(&m->spinlock);
+	m->spin_time_microseconds = 100;
+	m->os_handle = os_make_mutex();
+	m->spinlock_acquired = false;
+}
+void test_old_mutex_acquire_or_wait(Test_Old_Mutex *m) {
+	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
+		m->spinlock_acquired = true;
+	}
+	os_lock_mutex(m->os_handle);
+}
+void test_old_mutex_release(Test_Old_Mutex *m) {
+	bool was_spinlock_acquired = m->spinlock_acquired;
+	m->spinlock_acquired = false;
+	os_unlock_mutex(m->os_handle);
+	if (was_spinlock_acquired) spinlock_release(&m->spinlock);
+}
+typedef struct Test_Old_Binary_Semaphore {
+	volatile bool signaled;
+	Test_Old_Mutex mutex;
+} Test_Old_Binary_Semaphore;
+void test_old_binary_semaphore_wait(Test_Old_Binary_Semaphore *sem) {
+	test_old_mutex_acquire_or_wait(&sem->mutex);
+	while (!sem->signaled) {
+		test_old_mutex_release(&sem->mutex);
+		os_yield_thread();
+		test_old_mutex_acquire_or_wait(&sem->mutex);
+	}
+	sem->signaled = false;
+	test_old_mutex_release(&sem->mutex);
+}
+void test_old_binary_semaphore_signal(Test_Old_Binary_Semaphore *sem) {
+	test_old_mutex_acquire_or_wait(&sem->mutex);
+	sem->signaled = true;
+	test_old_mutex_release(&sem->mutex);
+}
+
+#define TEST_MUTEX_SPEED_OPS 100000
+typedef struct Test_Mutex_Speed_Data {
+	bool old;
+	Mutex mutex;
+	Test_Old_Mutex old_mutex;
+	u64 ops;
+	u64 counter;
+} Test_Mutex_Speed_Data;
+void test_mutex_speed_thread(Thread *t) {
+	Test_Mutex_Speed_Data *d = (Test_Mutex_Speed_Data*)t->data;
+	for (u64 i = 0; i < d->ops; i++) {
+		if (d->old) {
+			test_old_mutex_acquire_or_wait(&d->old_mutex);
+			d->counter += 1;
+			test_old_mutex_release(&d->old_mutex);
+		} else {
+			mutex_acquire_or_wait(&d->mutex);
+			d->counter += 1;
+			mutex_release(&d->mutex);
+		}
+	}
+}
+
+typedef struct Test_Ping_Pong_Data {
+	bool old;
+	Binary_Semaphore ping, pong;
+	Test_Old_Binary_Semaphore old_ping, old_pong;
+	u64 rounds;
+} Test_Ping_Pong_Data;
+void test_ping_pong_thread(Thread *t) {
+	Test_Ping_Pong_Data *d = (Test_Ping_Pong_Data*)t->data;
+	for (u64 i = 0; i < d->rounds; i++) {
+		if (d->old) {
+			test_old_binary_semaphore_wait(&d->old_ping);
+			test_old_binary_semaphore_signal(&d->old_pong);
+		} else {
+			binary_semaphore_wait(&d->ping);
+			binary_semaphore_signal(&d->pong);
+		}
+	}
+}
+
+void test_mutex_speed() {
+	Allocator heap = get_heap_allocator();
+	
+	for (u64 old = 0; old <= 1; old++) {
+		// Uncontended
+		Test_Mutex_Speed_Data *d = (Test_Mutex_Speed_Data*)alloc(heap, sizeof(Test_Mutex_Speed_Data));
+		memset(d, 0, sizeof(*d));
+		d->old = old;
+		mutex_init(&d->mutex);
+		test_old_mutex_init(&d->old_mutex);
+		d->ops = TEST_MUTEX_SPEED_OPS;
+		
+		Thread self = ZERO(Thread);
+		self.data = d;
+		u64 start = rdtsc();
+		test_mutex_speed_thread(&self);
+		u64 cycles = rdtsc()-start;
+		print("\n%cs mutex, uncontended: %llu cycles per acquire/release", old ? "Old" : "New", cycles/TEST_MUTEX_SPEED_OPS);
+		
+		// Contended
+		for (u64 thread_count = 2; thread_count <= 8; thread_count *= 2) {
+			d->counter = 0;
+			d->ops = TEST_MUTEX_SPEED_OPS/thread_count;
+			Thread *threads = (Thread*)alloc(heap, thread_count*sizeof(Thread));
+			
+			f64 start_seconds = os_get_current_time_in_seconds();
+			start = rdtsc();
+			for (u64 i = 0; i < thread_count; i++) {
+				os_thread_init(&threads[i], test_mutex_speed_thread);
+				threads[i].data = d;
+				os_thread_start(&threads[i]);
+			}
+			for (u64 i = 0; i < thread_count; i++) {
+				os_thread_join(&threads[i]);
+				os_thread_destroy(&threads[i]);
+			}
+			cycles = rdtsc()-start;
+			f64 ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+			assert(d->counter == d->ops*thread_count, "Failed: mutex speed counter");
+			print("\n%cs mutex, %llu threads: %llu cycles per acquire/release (%.2f ms total)", old ? "Old" : "New", thread_count, cycles/(d->ops*thread_count), ms);
+			
+			dealloc(heap, threads);
+		}
+		
+		os_destroy_mutex(d->old_mutex.os_handle);
+		mutex_destroy(&d->mutex);
+		dealloc(heap, d);
+	}
+	
+	for (u64 old = 0; old <= 1; old++) {
+		// Two threads handing a signal back and forth
+		Test_Ping_Pong_Data *d = (Test_Ping_Pong_Data*)alloc(heap, sizeof(Test_Ping_Pong_Data));
+		memset(d, 0, sizeof(*d));
+		d->old = old;
+		d->rounds = 10000;
+		binary_semaphore_init(&d->ping, false);
+		binary_semaphore_init(&d->pong, false);
+		test_old_mutex_init(&d->old_ping.mutex);
+		test_old_mutex_init(&d->old_pong.mutex);
+		
+		Thread t;
+		os_thread_init(&t, test_ping_pong_thread);
+		t.data = d;
+		
+		f64 start_seconds = os_get_current_time_in_seconds();
+		u64 start = rdtsc();
+		os_thread_start(&t);
+		for (u64 i = 0; i < d->rounds; i++) {
+			if (old) {
+				test_old_binary_semaphore_signal(&d->old_ping);
+				test_old_binary_semaphore_wait(&d->old_pong);
+			} else {
+				binary_semaphore_signal(&d->ping);
+				binary_semaphore_wait(&d->pong);
+			}
+		}
+		os_thread_join(&t);
+		os_thread_destroy(&t);
+		u64 cycles = rdtsc()-start;
+		f64 ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+		print("\n%cs binary semaphore ping pong: %llu cycles per round trip (%.2f ms total)", old ? "Old" : "New", cycles/d->rounds, ms);
+		
+		os_destroy_mutex(d->old_ping.mutex.os_handle);
+		os_destroy_mutex(d->old_pong.mutex.os_handle);
+		binary_semaphore_destroy(&d->ping);
+		binary_semaphore_destroy(&d->pong);
+		dealloc(heap, d);
+	}
+	print("\n");
+}
+
+#define TEST_SEMAPHORE_ITEMS_PER_CONSUMER 10000
+typedef struct Test_Semaphore_Data {
+	Semaphore items;
+	volatile u32 consumed;
+} Test_Semaphore_Data;
+void test_semaphore_consumer(Thread *t) {
+	Test_Semaphore_Data *d = (Test_Semaphore_Data*)t->data;
+	for (u64 i = 0; i < TEST_SEMAPHORE_ITEMS_PER_CONSUMER; i++) {
+		semaphore_wait(&d->items);
+		u32 consumed;
+		do { consumed = d->consumed; } while (!compare_and_swap_32(&d->consumed, consumed+1, consumed));
+	}
+}
+void test_semaphores() {
+	Binary_Semaphore b;
+	binary_semaphore_init(&b, true);
+	binary_semaphore_wait(&b);
+	assert(b.signaled == 0, "Failed: binary semaphore wait should take the signal");
+	binary_semaphore_signal(&b);
+	binary_semaphore_signal(&b);
+	binary_semaphore_wait(&b);
+	assert(b.signaled == 0, "Failed: binary semaphore should only hold one signal");
+	binary_semaphore_destroy(&b);
+	
+	Semaphore s;
+	semaphore_init(&s, 2);
+	assert(semaphore_try_wait(&s) && semaphore_try_wait(&s), "Failed: semaphore initial count");
+	assert(!semaphore_try_wait(&s), "Failed: semaphore should be empty");
+	semaphore_signal(&s, 3);
+	assert(s.count == 3, "Failed: semaphore signal count");
+	semaphore_destroy(&s);
+	
+	// Producer signals in batches while consumers wait
+	const u64 consumer_count = 4;
+	Test_Semaphore_Data d = ZERO(Test_Semaphore_Data);
+	semaphore_init(&d.items, 0);
+	Thread threads[4];
+	for (u64 i = 0; i < consumer_count; i++) {
+		os_thread_init(&threads[i], test_semaphore_consumer);
+		threads[i].data = &d;
+		os_thread_start(&threads[i]);
+	}
+	u64 total = consumer_count*TEST_SEMAPHORE_ITEMS_PER_CONSUMER;
+	for (u64 produced = 0; produced < total; ) {
+		u32 n = (u32)min(total - produced, (u64)get_random_int_in_range(1, 16));
+		semaphore_signal(&d.items, n);
+		produced += n;
+		if (produced % 64 == 0) os_yield_thread();
+	}
+	for (u64 i = 0; i < consumer_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	assert(d.consumed == total, "Failed: semaphore consumers got %u of %llu", d.consumed, total);
+	assert(d.items.count == 0, "Failed: semaphore should be empty after consuming everything");
+	semaphore_destroy(&d.items);
+}
+
+typedef enum Test_Read_Lock_Kind {
+	TEST_READ_LOCK_SPINLOCK,
+	TEST_READ_LOCK_MUTEX,
+	TEST_READ_LOCK_RW_LOCK,
+	TEST_READ_LOCK_SEQLOCK,
+	TEST_READ_LOCK_KIND_COUNT,
+} Test_Read_Lock_Kind;
+const char *test_read_lock_names[TEST_READ_LOCK_KIND_COUNT] = {"Spinlock", "Mutex", "Rw_Lock", "Seqlock"};
+
+// The writer always writes the same value to every field so readers can tell if they got
+// a torn copy.
+typedef struct Test_Read_Mostly_Value {
+	u64 a, b, c, d;
+} Test_Read_Mostly_Value;
+typedef struct Test_Read_Lock_Data {
+	Test_Read_Lock_Kind kind;
+	Spinlock spinlock;
+	Mutex mutex;
+	Rw_Lock rw_lock;
+	Seqlock seqlock;
+	Test_Read_Mostly_Value value;
+	u64 reader_count;
+	u64 reads_per_reader;
+	u64 write_interval_cycles;
+	volatile u64 readers_done;
+	volatile u64 writes;
+	volatile u64 read_cycles;
+} Test_Read_Lock_Data;
+
+Test_Read_Mostly_Value test_read_locked(Test_Read_Lock_Data *d) {
+	Test_Read_Mostly_Value v;
+	switch (d->kind) {
+		case TEST_READ_LOCK_SPINLOCK:
+			spinlock_acquire_or_wait(&d->spinlock);
+			v = d->value;
+			spinlock_release(&d->spinlock);
+			break;
+		case TEST_READ_LOCK_MUTEX:
+			mutex_acquire_or_wait(&d->mutex);
+			v = d->value;
+			mutex_release(&d->mutex);
+			break;
+		case TEST_READ_LOCK_RW_LOCK:
+			rw_lock_acquire_read(&d->rw_lock);
+			v = d->value;
+			rw_lock_release_read(&d->rw_lock);
+			break;
+		case TEST_READ_LOCK_SEQLOCK:
+			seqlock_read(&d->seqlock, &v, &d->value, sizeof(v));
+			break;
+		default: panic("");
+	}
+	return v;
+}
+void test_write_locked(Test_Read_Lock_Data *d, u64 x) {
+	Test_Read_Mostly_Value v = {x, x, x, x};
+	switch (d->kind) {
+		case TEST_READ_LOCK_SPINLOCK:
+			spinlock_acquire_or_wait(&d->spinlock);
+			d->value = v;
+			spinlock_release(&d->spinlock);
+			break;
+		case TEST_READ_LOCK_MUTEX:
+			mutex_acquire_or_wait(&d->mutex);
+			d->value = v;
+			mutex_release(&d->mutex);
+			break;
+		case TEST_READ_LOCK_RW_LOCK:
+			rw_lock_acquire_write(&d->rw_lock);
+			d->value = v;
+			rw_lock_release_write(&d->rw_lock);
+			break;
+		case TEST_READ_LOCK_SEQLOCK:
+			seqlock_write(&d->seqlock, &d->value, &v, sizeof(v));
+			break;
+		default: panic("");
+	}
+}
+
+void test_read_lock_reader(Thread *t) {
+	Test_Read_Lock_Data *d = (Test_Read_Lock_Data*)t->data;
+	u64 start = rdtsc();
+	for (u64 i = 0; i < d->reads_per_reader; i++) {
+		Test_Read_Mostly_Value v = test_read_locked(d);
+		assert(v.a == v.b && v.b == v.c && v.c == v.d, "Failed: %cs reader saw a torn write", test_read_lock_names[d->kind]);
+	}
+	atomic_fetch_add_64(&d->read_cycles, rdtsc()-start, MEMORY_ORDER_RELAXED);
+	atomic_fetch_add_64(&d->readers_done, 1, MEMORY_ORDER_RELEASE);
+}
+void test_read_lock_writer(Thread *t) {
+	Test_Read_Lock_Data *d = (Test_Read_Lock_Data*)t->data;
+	u64 x = 0;
+	while (atomic_load_64(&d->readers_done, MEMORY_ORDER_ACQUIRE) < d->reader_count) {
+		test_write_locked(d, ++x);
+		atomic_fetch_add_64(&d->writes, 1, MEMORY_ORDER_RELAXED);
+		// Writes are rare
+		u64 start = rdtsc();
+		while (rdtsc()-start < d->write_interval_cycles) os_yield_thread();
+	}
+}
+
+void test_read_mostly_locks() {
+	// Rw_Lock on its own
+	Rw_Lock l;
+	rw_lock_init(&l);
+	rw_lock_acquire_read(&l);
+	rw_lock_acquire_read(&l);
+	assert((l.state & RW_LOCK_READER_MASK) == 2, "Failed: Rw_Lock should allow several readers");
+	rw_lock_release_read(&l);
+	rw_lock_release_read(&l);
+	rw_lock_acquire_write(&l);
+	assert(l.state == RW_LOCK_WRITER_HELD, "Failed: Rw_Lock write state");
+	rw_lock_release_write(&l);
+	assert(l.state == 0, "Failed: Rw_Lock should be free after release");
+	rw_lock_destroy(&l);
+	
+	Seqlock sl;
+	seqlock_init(&sl);
+	u32 seq = seqlock_read_begin(&sl);
+	assert(!seqlock_read_retry(&sl, seq), "Failed: seqlock read retry without a write");
+	seqlock_write_begin(&sl);
+	seqlock_write_end(&sl);
+	assert(seqlock_read_retry(&sl, seq), "Failed: seqlock read should retry after a write");
+	
+	Allocator heap = get_heap_allocator();
+	Test_Read_Lock_Data *d = (Test_Read_Lock_Data*)alloc(heap, sizeof(Test_Read_Lock_Data));
+	
+	// Several writers hammering it with no pause, to get writers waiting on writers
+	for (Test_Read_Lock_Kind kind = TEST_READ_LOCK_RW_LOCK; kind <= TEST_READ_LOCK_SEQLOCK; kind++) {
+		memset(d, 0, sizeof(*d));
+		d->kind = kind;
+		rw_lock_init(&d->rw_lock);
+		seqlock_init(&d->seqlock);
+		d->reader_count = 3;
+		d->reads_per_reader = 20000;
+		Thread threads[6];
+		for (u64 i = 0; i < 6; i++) {
+			os_thread_init(&threads[i], i < 3 ? test_read_lock_writer : test_read_lock_reader);
+			threads[i].data = d;
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < 6; i++) {
+			os_thread_join(&threads[i]);
+			os_thread_destroy(&threads[i]);
+		}
+		assert(d->rw_lock.state == 0 && d->rw_lock.writers_waiting == 0, "Failed: Rw_Lock should be free after stress test");
+		assert((d->seqlock.sequence & 1) == 0, "Failed: Seqlock should not be mid-write after stress test");
+		rw_lock_destroy(&d->rw_lock);
+	}
+	
+	// 1 writer, N readers
+	const u64 reads = 100000;
+	for (u64 reader_count = 1; reader_count <= 8; reader_count *= 2) {
+		for (Test_Read_Lock_Kind kind = 0; kind < TEST_READ_LOCK_KIND_COUNT; kind++) {
+			memset(d, 0, sizeof(*d));
+			d->kind = kind;
+			spinlock_init(&d->spinlock);
+			mutex_init(&d->mutex);
+			rw_lock_init(&d->rw_lock);
+			seqlock_init(&d->seqlock);
+			d->reader_count = reader_count;
+			d->reads_per_reader = reads/reader_count;
+			d->write_interval_cycles = 20000;
+			
+			Thread writer;
+			os_thread_init(&writer, test_read_lock_writer);
+			writer.data = d;
+			Thread readers[8];
+			
+			f64 start_seconds = os_get_current_time_in_seconds();
+			os_thread_start(&writer);
+			for (u64 i = 0; i < reader_count; i++) {
+				os_thread_init(&readers[i], test_read_lock_reader);
+				readers[i].data = d;
+				os_thread_start(&readers[i]);
+			}
+			for (u64 i = 0; i < reader_count; i++) {
+				os_thread_join(&readers[i]);
+				os_thread_destroy(&readers[i]);
+			}
+			os_thread_join(&writer);
+			os_thread_destroy(&writer);
+			f64 ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+			
+			u64 total_reads = d->reads_per_reader*reader_count;
+			print("\n%cs, 1 writer %llu readers: %llu cycles per read, %llu writes (%.2f ms total)", test_read_lock_names[kind], reader_count, d->read_cycles/total_reads, d->writes, ms);
+			
+			rw_lock_destroy(&d->rw_lock);
+			mutex_destroy(&d->mutex);
+		}
+	}
+	print("\n");
+	dealloc(heap, d);
+}
+
+typedef enum Test_Contended_Lock_Kind {
+	TEST_CONTENDED_NAIVE_SPINLOCK, // What Spinlock used to be: no pause, no backoff
+	TEST_CONTENDED_SPINLOCK,
+	TEST_CONTENDED_TICKET_LOCK,
+	TEST_CONTENDED_MUTEX,
+	TEST_CONTENDED_LOCK_KIND_COUNT,
+} Test_Contended_Lock_Kind;
+const char *test_contended_lock_names[] = {"Naive spinlock", "Spinlock", "Ticket_Lock", "Mutex"};
+
+typedef struct Test_Contended_Lock_Data {
+	Test_Contended_Lock_Kind kind;
+	alignat(64) Spinlock spinlock;
+	alignat(64) Ticket_Lock ticket_lock;
+	alignat(64) Mutex mutex;
+	alignat(64) u64 counter;
+	u64 acquires_per_thread;
+	u64 *latencies; // acquires_per_thread per thread
+	volatile u64 next_thread_index;
+} Test_Contended_Lock_Data;
+
+void test_contended_lock_thread(Thread *t) {
+	Test_Contended_Lock_Data *d = (Test_Contended_Lock_Data*)t->data;
+	u64 thread_index = atomic_fetch_add_64(&d->next_thread_index, 1, MEMORY_ORDER_RELAXED);
+	u64 *latencies = d->latencies + thread_index*d->acquires_per_thread;
+	for (u64 i = 0; i < d->acquires_per_thread; i++) {
+		u64 start = rdtsc();
+		switch (d->kind) {
+			case TEST_CONTENDED_NAIVE_SPINLOCK:
+				while (!compare_and_swap_bool(&d->spinlock.locked, true, false)) {
+					while (d->spinlock.locked) {}
+				}
+				break;
+			case TEST_CONTENDED_SPINLOCK:    spinlock_acquire_or_wait(&d->spinlock);       break;
+			case TEST_CONTENDED_TICKET_LOCK: ticket_lock_acquire_or_wait(&d->ticket_lock); break;
+			case TEST_CONTENDED_MUTEX:       mutex_acquire_or_wait(&d->mutex);             break;
+			default: panic("");
+		}
+		latencies[i] = rdtsc()-start;
+		
+		d->counter += 1;
+		
+		switch (d->kind) {
+			case TEST_CONTENDED_NAIVE_SPINLOCK:
+			case TEST_CONTENDED_SPINLOCK:    spinlock_release(&d->spinlock);       break;
+			case TEST_CONTENDED_TICKET_LOCK: ticket_lock_release(&d->ticket_lock); break;
+			case TEST_CONTENDED_MUTEX:       mutex_release(&d->mutex);             break;
+			default: panic("");
+		}
+	}
+}
+
+void test_contended_locks() {
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
+	for (u32 i = 0; i < SPIN_BACKOFF_YIELD_AFTER; i++) spin_backoff(&backoff);
+	assert(backoff.pauses == SPIN_BACKOFF_MAX_PAUSES, "Failed: spin backoff should be capped");
+	
+	Ticket_Lock tl;
+	ticket_lock_init(&tl);
+	ticket_lock_acquire_or_wait(&tl);
+	assert(tl.next_ticket == 1 && tl.now_serving == 0, "Failed: ticket lock state after acquire");
+	ticket_lock_release(&tl);
+	ticket_lock_acquire_or_wait(&tl);
+	ticket_lock_release(&tl);
+	assert(tl.next_ticket == 2 && tl.now_serving == 2, "Failed: ticket lock should be free after release");
+	
+	Allocator heap = get_heap_allocator();
+	Test_Contended_Lock_Data *d = (Test_Contended_Lock_Data*)alloc(heap, sizeof(Test_Contended_Lock_Data));
+	
+	// Every run does the same number of acquires in total, split between the threads
+	const u64 total_acquires = 32000;
+	const u64 max_threads = 32;
+	u64 *latencies = (u64*)alloc(heap, total_acquires*sizeof(u64));
+	u64 *sort_buffer = (u64*)alloc(heap, total_acquires*sizeof(u64));
+	Thread *threads = (Thread*)alloc(heap, max_threads*sizeof(Thread));
+	
+	for (u64 thread_count = 2; thread_count <= max_threads; thread_count *= 2) {
+		for (Test_Contended_Lock_Kind kind = 0; kind < TEST_CONTENDED_LOCK_KIND_COUNT; kind++) {
+			memset(d, 0, sizeof(*d));
+			d->kind = kind;
+			spinlock_init(&d->spinlock);
+			ticket_lock_init(&d->ticket_lock);
+			mutex_init(&d->mutex);
+			d->acquires_per_thread = total_acquires/thread_count;
+			d->latencies = latencies;
+			
+			f64 start_seconds = os_get_current_time_in_seconds();
+			u64 start = rdtsc();
+			for (u64 i = 0; i < thread_count; i++) {
+				os_thread_init(&threads[i], test_contended_lock_thread);
+				threads[i].data = d;
+				os_thread_start(&threads[i]);
+			}
+			for (u64 i = 0; i < thread_count; i++) {
+				os_thread_join(&threads[i]);
+				os_thread_destroy(&threads[i]);
+			}
+			u64 cycles = rdtsc()-start;
+			f64 ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+			
+			u64 count = d->acquires_per_thread*thread_count;
+			assert(d->counter == count, "Failed: %cs lost increments (%llu, expected %llu)", test_contended_lock_names[kind], d->counter, count);
+			
+			radix_sort(latencies, sort_buffer, count, sizeof(u64), 0, 48);
+			print("\n%cs, %llu threads: %llu cycles per acquire, wait p50 %llu p99 %llu max %llu cycles (%.2f ms total)", test_contended_lock_names[kind], thread_count, cycles/count, latencies[count/2], latencies[count*99/100], latencies[count-1], ms);
+			
+			mutex_destroy(&d->mutex);
+		}
+	}
+	print("\n");
+	
+	dealloc(heap, threads);
+	dealloc(heap, sort_buffer);
+	dealloc(heap, latencies);
+	dealloc(heap, d);
+}
+
+typedef struct Test_Queue_Data {
+	bool mpmc;
+	Spsc_Queue spsc;
+	Mpmc_Queue mpmc_queue;
+	u64 batch;
+	u64 total;
+	volatile u64 consumed_count;
+	volatile u64 consumed_sum;
+} Test_Queue_Data;
+typedef struct Test_Queue_Thread {
+	Test_Queue_Data *d;
+	u64 first; // Producers push first .. first+count-1
+	u64 count;
+} Test_Queue_Thread;
+
+#define TEST_QUEUE_MAX_BATCH 64
+void test_queue_producer(Thread *t) {
+	Test_Queue_Thread *p = (Test_Queue_Thread*)t->data;
+	Test_Queue_Data *d = p->d;
+	u64 items[TEST_QUEUE_MAX_BATCH];
+	u64 next = p->first;
+	u64 end = p->first + p->count;
+	while (next < end) {
+		u64 n = min(d->batch, end-next);
+		for (u64 i = 0; i < n; i++) items[i] = next+i;
+		u64 pushed;
+		if (d->mpmc) pushed = d->batch == 1 ? (u64)mpmc_queue_push(&d->mpmc_queue, items) : mpmc_queue_push_batch(&d->mpmc_queue, items, n);
+		else         pushed = d->batch == 1 ? (u64)spsc_queue_push(&d->spsc, items)       : spsc_queue_push_batch(&d->spsc, items, n);
+		next += pushed;
+		if (pushed == 0) os_yield_thread();
+	}
+}
+void test_queue_consumer(Thread *t) {
+	Test_Queue_Data *d = (Test_Queue_Data*)t->data;
+	u64 items[TEST_QUEUE_MAX_BATCH];
+	while (d->consumed_count < d->total) {
+		u64 popped;
+		if (d->mpmc) popped = d->batch == 1 ? (u64)mpmc_queue_pop(&d->mpmc_queue, items) : mpmc_queue_pop_batch(&d->mpmc_queue, items, d->batch);
+		else         popped = d->batch == 1 ? (u64)spsc_queue_pop(&d->spsc, items)       : spsc_queue_pop_batch(&d->spsc, items, d->batch);
+		if (popped == 0) {
+			os_yield_thread();
+			continue;
+		}
+		u64 sum = 0;
+		for (u64 i = 0; i < popped; i++) {
+			// A single producer's items must come out in order
+			if (!d->mpmc && i > 0) assert(items[i] == items[i-1]+1, "Failed: spsc queue order");
+			sum += items[i];
+		}
+		u64 old;
+		do { old = d->consumed_sum;   } while (!compare_and_swap_64(&d->consumed_sum, old+sum, old));
+		do { old = d->consumed_count; } while (!compare_and_swap_64(&d->consumed_count, old+popped, old));
+	}
+}
+
+// Runs producer_count producers and consumer_count consumers through the queue and returns the cycles it took
+u64 test_queue_run(Test_Queue_Data *d, u64 producer_count, u64 consumer_count, u64 items_per_producer, f64 *ms) {
+	assert(d->mpmc || (producer_count == 1 && consumer_count == 1), "Spsc queue only takes one of each");
+	Allocator heap = get_heap_allocator();
+	d->total = producer_count*items_per_producer;
+	d->consumed_count = 0;
+	d->consumed_sum = 0;
+	
+	Thread *threads = (Thread*)alloc(heap, (producer_count+consumer_count)*sizeof(Thread));
+	Test_Queue_Thread *producers = (Test_Queue_Thread*)alloc(heap, producer_count*sizeof(Test_Queue_Thread));
+	
+	f64 start_seconds = os_get_current_time_in_seconds();
+	u64 start = rdtsc();
+	for (u64 i = 0; i < producer_count+consumer_count; i++) {
+		if (i < producer_count) {
+			producers[i] = (Test_Queue_Thread){d, i*items_per_producer, items_per_producer};
+			os_thread_init(&threads[i], test_queue_producer);
+			threads[i].data = &producers[i];
+		} else {
+			os_thread_init(&threads[i], test_queue_consumer);
+			threads[i].data = d;
+		}
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < producer_count+consumer_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	u64 cycles = rdtsc()-start;
+	if (ms) *ms = (os_get_current_time_in_seconds()-start_seconds)*1000.0;
+	
+	assert(d->consumed_count == d->total, "Failed: queue consumed %llu of %llu items", d->consumed_count, d->total);
+	u64 expected_sum = d->total*(d->total-1)/2;
+	assert(d->consumed_sum == expected_sum, "Failed: queue items were lost or duplicated (sum %llu, expected %llu)", d->consumed_sum, expected_sum);
+	
+	dealloc(heap, producers);
+	dealloc(heap, threads);
+	return cycles;
+}
+
+void test_queues() {
+	Allocator heap = get_heap_allocator();
+	
+	// Single threaded behaviour
+	Spsc_Queue spsc;
+	spsc_queue_init(&spsc, u32, 5, heap);
+	assert(spsc.capacity == 8, "Failed: spsc capacity should round up to a power of two");
+	u32 x = 0;
+	assert(!spsc_queue_pop(&spsc, &x), "Failed: spsc queue should start empty");
+	for (u32 i = 0; i < 8; i++) assert(spsc_queue_push(&spsc, &i), "Failed: spsc push");
+	assert(!spsc_queue_push(&spsc, &x), "Failed: spsc queue should be full");
+	for (u32 i = 0; i < 3; i++) {
+		assert(spsc_queue_pop(&spsc, &x) && x == i, "Failed: spsc pop order");
+	}
+	// Wraps around the end of the buffer
+	u32 batch[8] = {8, 9, 10, 11, 12};
+	assert(spsc_queue_push_batch(&spsc, batch, 5) == 3, "Failed: spsc batch push should stop when full");
+	assert(spsc_queue_pop_batch(&spsc, batch, 8) == 8, "Failed: spsc batch pop");
+	for (u32 i = 0; i < 8; i++) assert(batch[i] == i+3, "Failed: spsc batch pop order");
+	assert(!spsc_queue_pop(&spsc, &x), "Failed: spsc queue should be empty");
+	spsc_queue_destroy(&spsc);
+	
+	Mpmc_Queue mpmc;
+	mpmc_queue_init(&mpmc, Vector3, 4, heap);
+	Vector3 v = v3(1, 2, 3);
+	for (u64 i = 0; i < 4; i++) assert(mpmc_queue_push(&mpmc, &v), "Failed: mpmc push");
+	assert(!mpmc_queue_push(&mpmc, &v), "Failed: mpmc queue should be full");
+	Vector3 vs[4];
+	assert(mpmc_queue_pop_batch(&mpmc, vs, 3) == 3, "Failed: mpmc batch pop");
+	assert(vs[2].x == 1 && vs[2].y == 2 && vs[2].z == 3, "Failed: mpmc item copy");
+	assert(mpmc_queue_push_batch(&mpmc, vs, 4) == 3, "Failed: mpmc batch push should stop when full");
+	assert(mpmc_queue_pop_batch(&mpmc, vs, 8) == 4, "Failed: mpmc should pop everything");
+	assert(!mpmc_queue_pop(&mpmc, &v), "Failed: mpmc queue should be empty");
+	mpmc_queue_destroy(&mpmc);
+	
+	// Threaded, every item must come out exactly once
+	Test_Queue_Data *d = (Test_Queue_Data*)alloc(heap, sizeof(Test_Queue_Data));
+	memset(d, 0, sizeof(*d));
+	spsc_queue_init(&d->spsc, u64, 256, heap);
+	mpmc_queue_init(&d->mpmc_queue, u64, 256, heap);
+	for (u64 batch = 1; batch <= 16; batch *= 16) {
+		d->batch = batch;
+		d->mpmc = false;
+		test_queue_run(d, 1, 1, 20000, 0);
+		d->mpmc = true;
+		test_queue_run(d, 1, 1, 20000, 0);
+		test_queue_run(d, 4, 4, 5000, 0);
+		test_queue_run(d, 3, 1, 5000, 0);
+		test_queue_run(d, 1, 3, 10000, 0);
+	}
+	spsc_queue_destroy(&d->spsc);
+	mpmc_queue_destroy(&d->mpmc_queue);
+	dealloc(heap, d);
+}
+
+#define TEST_QUEUE_SPEED_ITEMS 400000
+void test_queue_speed() {
+	Allocator heap = get_heap_allocator();
+	Test_Queue_Data *d = (Test_Queue_Data*)alloc(heap, sizeof(Test_Queue_Data));
+	memset(d, 0, sizeof(*d));
+	spsc_queue_init(&d->spsc, u64, 1024, heap);
+	mpmc_queue_init(&d->mpmc_queue, u64, 1024, heap);
+	
+	for (u64 batch = 1; batch <= TEST_QUEUE_MAX_BATCH; batch *= TEST_QUEUE_MAX_BATCH) {
+		f64 ms;
+		d->batch = batch;
+		
+		d->mpmc = false;
+		u64 cycles = test_queue_run(d, 1, 1, TEST_QUEUE_SPEED_ITEMS, &ms);
+		print("\nSpsc, 1 producer, batch %llu: %llu cycles per item (%.2f ms total)", batch, cycles/TEST_QUEUE_SPEED_ITEMS, ms);
+		
+		d->mpmc = true;
+		for (u64 producer_count = 1; producer_count <= 8; producer_count *= 2) {
+			cycles = test_queue_run(d, producer_count, 1, TEST_QUEUE_SPEED_ITEMS/producer_count, &ms);
+			print("\nMpmc, %llu producers, batch %llu: %llu cycles per item (%.2f ms total)", producer_count, batch, cycles/d->total, ms);
+		}
+	}
+	print("\n");
+	
+	spsc_queue_destroy(&d->spsc);
+	mpmc_queue_destroy(&d->mpmc_queue);
+	dealloc(heap, d);
+}
+
+#if OOGABOOGA_HAS_GFX
 int compare_draw_quads(const void *a, const void *b) {
     return ((Draw_Quad*)a)->z-((Draw_Quad*)b)->z;
 }
@@ -1297,7 +3314,332 @@ void test_sort() {
     
     print("Merge sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
 }
-#endif /* OOGABOOGA_HEADLESS */
+
+// draw_rect the way it was before draw_frame cached world_to_clip
+Draw_Quad *test_draw_rect_uncached(Vector2 position, Vector2 size, Vector4 color) {
+	Draw_Quad q = ZERO(Draw_Quad);
+	q.bottom_left  = v2(position.x,          position.y);
+	q.top_left     = v2(position.x,          position.y + size.y);
+	q.top_right    = v2(position.x + size.x, position.y + size.y);
+	q.bottom_right = v2(position.x + size.x, position.y);
+	q.color = color;
+	q.type = QUAD_TYPE_REGULAR;
+	return draw_quad_projected(q, m4_mul(draw_frame.projection, m4_inverse(draw_frame.view)));
+}
+void test_draw_rect_speed() {
+	reset_draw_frame(&draw_frame);
+	draw_frame.view = m4_make_translation(v3(3, -2, 0));
+	
+	Draw_Quad *a = draw_rect(v2(1, 2), v2(3, 4), v4(1, 1, 1, 1));
+	Draw_Quad *b = test_draw_rect_uncached(v2(1, 2), v2(3, 4), v4(1, 1, 1, 1));
+	assert(bytes_match(&a->bottom_left, &b->bottom_left, sizeof(Vector2)*4), "Cached world_to_clip gives a different result");
+	
+	// Writing view directly has to be picked up
+	draw_frame.view = m4_make_translation(v3(-5, 7, 0));
+	a = draw_rect(v2(1, 2), v2(3, 4), v4(1, 1, 1, 1));
+	b = test_draw_rect_uncached(v2(1, 2), v2(3, 4), v4(1, 1, 1, 1));
+	assert(bytes_match(&a->bottom_left, &b->bottom_left, sizeof(Vector2)*4), "Changing view did not invalidate world_to_clip");
+	
+	draw_frame.projection = m4_make_orthographic_projection(0, 100, 0, 50, -1, 10);
+	a = draw_rect(v2(1, 2), v2(3, 4), v4(1, 1, 1, 1));
+	b = test_draw_rect_uncached(v2(1, 2), v2(3, 4), v4(1, 1, 1, 1));
+	assert(bytes_match(&a->bottom_left, &b->bottom_left, sizeof(Vector2)*4), "Changing projection did not invalidate world_to_clip");
+	
+	const u64 rect_count = 100000;
+	const int num_samples = 10;
+	for (int cached = 0; cached < 2; cached++) {
+		u64 cycles = 0;
+		f64 seconds = 0;
+		for (int sample = 0; sample < num_samples; sample++) {
+			draw_frame.num_quads = 0;
+			
+			float64 start_seconds = os_get_current_time_in_seconds();
+			u64 start_cycles = rdtsc();
+			for (u64 i = 0; i < rect_count; i++) {
+				Vector2 p = v2((f32)(i % 100), (f32)(i % 50));
+				if (cached) draw_rect(p, v2(1, 1), v4(1, 1, 1, 1));
+				else        test_draw_rect_uncached(p, v2(1, 1), v4(1, 1, 1, 1));
+			}
+			cycles += rdtsc() - start_cycles;
+			seconds += os_get_current_time_in_seconds() - start_seconds;
+		}
+		print("\n\tdraw_rect %cs: %llu cycles per rect, %.2f ms per %llu rects",
+			cached ? "with cached world_to_clip" : "inverting view every call",
+			cycles/(rect_count*num_samples), (seconds*1000.0)/(f64)num_samples, rect_count);
+	}
+	print("\n");
+	
+	reset_draw_frame(&draw_frame);
+}
+
+void test_draw_quads() {
+	reset_draw_frame(&draw_frame);
+	
+	// Userdata has to survive quad_buffer growing
+	const u64 quad_count = 30000;
+	u64 old_allocated_quads = allocated_quads;
+	for (u64 i = 0; i < quad_count; i++) {
+		Draw_Quad *q = draw_rect(v2(0, 0), v2(0.1, 0.1), v4(1, 1, 1, 1));
+		assert(q->userdata[0].x == 0 && q->userdata[0].w == 0, "Userdata was not cleared");
+		q->userdata[0].x = (f32)i;
+		q->userdata[VERTEX_2D_USER_DATA_COUNT-1].w = (f32)(i*2);
+		q->z = (s32)(i % 7) - 3;
+	}
+	assert(old_allocated_quads >= quad_count || allocated_quads > old_allocated_quads, "Quad buffer was expected to grow");
+	for (u64 i = 0; i < quad_count; i++) {
+		Draw_Quad *q = &quad_buffer[i];
+		assert(q->userdata[0].x == (f32)i && q->userdata[VERTEX_2D_USER_DATA_COUNT-1].w == (f32)(i*2), "Userdata for quad %llu was lost", i);
+	}
+	
+	// Culled quads can be written to too
+	Draw_Quad *culled = draw_rect(v2(100, 100), v2(1, 1), v4(1, 1, 1, 1));
+	culled->userdata[0].x = 1;
+	
+	u32 *order = get_draw_frame_quad_order();
+	for (u64 i = 0; i < quad_count; i++) assert(order[i] == i, "Order without z sorting should be draw order");
+	
+	draw_frame.enable_z_sorting = true;
+	order = get_draw_frame_quad_order();
+	for (u64 i = 1; i < quad_count; i++) {
+		Draw_Quad *a = &quad_buffer[order[i-1]];
+		Draw_Quad *b = &quad_buffer[order[i]];
+		assert(a->z < b->z || (a->z == b->z && order[i-1] < order[i]), "Quads not sorted by z, or equal z lost draw order");
+	}
+	
+	// Sorting indices vs moving whole quads like the renderers used to
+	Draw_Quad *sorted = alloc(get_heap_allocator(), quad_count*2*sizeof(Draw_Quad));
+	const int num_samples = 20;
+	u64 quad_cycles = 0, index_cycles = 0;
+	for (int a = 0; a < num_samples; a++) {
+		memcpy(sorted, quad_buffer, quad_count*sizeof(Draw_Quad));
+		u64 start = rdtsc();
+		radix_sort(sorted, sorted + quad_count, quad_count, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+		quad_cycles += rdtsc() - start;
+		
+		start = rdtsc();
+		get_draw_frame_quad_order();
+		index_cycles += rdtsc() - start;
+	}
+	dealloc(get_heap_allocator(), sorted);
+	print("\n\tDraw_Quad is %llu bytes. Z sorting %llu quads: %llu cycles moving quads, %llu cycles sorting indices\n",
+		(u64)sizeof(Draw_Quad), quad_count, quad_cycles/num_samples, index_cycles/num_samples);
+	
+	// Scissors are shared through an index, 0 is none
+	reset_draw_frame(&draw_frame);
+	Draw_Quad *none = draw_rect(v2(0, 0), v2(0.1, 0.1), v4(1, 1, 1, 1));
+	push_window_scissor(v2(1, 2), v2(3, 4));
+	Draw_Quad *outer = draw_rect(v2(0, 0), v2(0.1, 0.1), v4(1, 1, 1, 1));
+	push_window_scissor(v2(5, 6), v2(7, 8));
+	Draw_Quad *inner = draw_rect(v2(0, 0), v2(0.1, 0.1), v4(1, 1, 1, 1));
+	pop_window_scissor();
+	Draw_Quad *outer_again = draw_rect(v2(0, 0), v2(0.1, 0.1), v4(1, 1, 1, 1));
+	pop_window_scissor();
+	assert(none->scissor_index == 0, "Quad without scissor has a scissor");
+	assert(outer->scissor_index == outer_again->scissor_index, "Same scissor should give the same index");
+	Vector4 outer_scissor = scissor_buffer[outer->scissor_index-1];
+	Vector4 inner_scissor = scissor_buffer[inner->scissor_index-1];
+	assert(outer_scissor.x1 == 1 && outer_scissor.y1 == 2 && outer_scissor.x2 == 3 && outer_scissor.y2 == 4, "Bad scissor");
+	assert(inner_scissor.x1 == 5 && inner_scissor.y1 == 6 && inner_scissor.x2 == 7 && inner_scissor.y2 == 8, "Bad scissor");
+	
+	reset_draw_frame(&draw_frame);
+}
+#endif /* OOGABOOGA_HAS_GFX */
+
+#if OOGABOOGA_HAS_GFX && GFX_RENDERER == GFX_RENDERER_SOFTWARE
+// x, y in window pixels with y up, like the draw procedures
+u32 software_test_pixel(s32 x, s32 y) {
+	return software_framebuffer.pixels[(u64)(software_framebuffer.height-1-y)*software_framebuffer.stride + x];
+}
+bool software_test_pixel_is(s32 x, s32 y, u32 expected) {
+	u32 got = software_test_pixel(x, y);
+	for (u32 shift = 0; shift < 32; shift += 8) {
+		s32 a = (got >> shift) & 0xff;
+		s32 b = (expected >> shift) & 0xff;
+		if (abs(a - b) > 1) return false;
+	}
+	return true;
+}
+void software_test_begin_frame() {
+	reset_draw_frame(&draw_frame);
+	draw_frame.projection = m4_make_orthographic_projection(0, window.width, 0, window.height, -1, 10);
+}
+void software_test_draw_golden_scene(Gfx_Image *checker, Gfx_Image *glyph) {
+	software_test_begin_frame();
+	draw_frame.enable_z_sorting = true;
+
+	draw_rect(v2(10, 10), v2(20, 20), v4(1, 0, 0, 1));
+	draw_rect(v2(40, 10), v2(20, 20), v4(1, 1, 1, 0.5));
+	draw_circle(v2(100, 100), v2(40, 40), v4(0, 0, 1, 1));
+
+	push_window_scissor(v2(50, 50), v2(60, 60));
+	draw_rect(v2(40, 40), v2(40, 40), v4(0, 1, 0, 1));
+	pop_window_scissor();
+
+	// Drawn red last but blue has the higher z
+	push_z_layer(10);
+	draw_rect(v2(150, 10), v2(20, 20), v4(0, 0, 1, 1));
+	pop_z_layer();
+	push_z_layer(5);
+	draw_rect(v2(150, 10), v2(20, 20), v4(1, 0, 0, 1));
+	pop_z_layer();
+
+	draw_image(checker, v2(200, 200), v2(20, 20), v4(1, 1, 1, 1));
+
+	Draw_Quad *q = draw_image(glyph, v2(200, 100), v2(20, 20), v4(0, 1, 0, 1));
+	q->type = QUAD_TYPE_TEXT;
+}
+void test_software_renderer() {
+	s32 old_width = window.width;
+	s32 old_height = window.height;
+	Vector4 old_clear_color = window.clear_color;
+	Allocator heap = get_heap_allocator();
+
+	window.width = 256;
+	window.height = 256;
+	window.clear_color = v4(0, 0, 0, 1);
+
+	// Bottom row first: white, black / black, white
+	u32 checker_pixels[4] = {0xffffffff, 0xff000000, 0xff000000, 0xffffffff};
+	Gfx_Image *checker = make_image(2, 2, 4, checker_pixels, heap);
+	u8 glyph_pixels[2] = {255, 0};
+	Gfx_Image *glyph = make_image(2, 1, 1, glyph_pixels, heap);
+
+	software_test_draw_golden_scene(checker, glyph);
+	gfx_update();
+
+	const u32 black = 0xff000000, red = 0xff0000ff, green = 0xff00ff00, blue = 0xffff0000, white = 0xffffffff;
+
+	assert(software_framebuffer.width == 256 && software_framebuffer.height == 256, "Framebuffer was not resized to the window");
+	assert(software_test_pixel_is(0, 0, black), "Expected clear color, got 0x%08x", software_test_pixel(0, 0));
+
+	// Rect coverage is exact: pixel centers inside, nothing more
+	assert(software_test_pixel_is(10, 10, red) && software_test_pixel_is(29, 29, red), "Rect is missing pixels");
+	assert(software_test_pixel_is(9, 10, black) && software_test_pixel_is(30, 10, black), "Rect covers too much horizontally");
+	assert(software_test_pixel_is(10, 9, black) && software_test_pixel_is(10, 30, black), "Rect covers too much vertically");
+	assert(software_test_pixel_is(20, 20, red), "Diagonal between the triangles was not drawn");
+
+	// White at half alpha over black; alpha is the source alpha
+	assert(software_test_pixel_is(50, 20, 0x80808080), "Bad blending, got 0x%08x", software_test_pixel(50, 20));
+
+	assert(software_test_pixel_is(120, 120, blue), "Circle center not drawn");
+	assert(software_test_pixel_is(101, 101, 0), "Circle corner should be transparent, got 0x%08x", software_test_pixel(101, 101));
+
+	assert(software_test_pixel_is(50, 50, green) && software_test_pixel_is(59, 59, green), "Scissor cut too much");
+	assert(software_test_pixel_is(49, 55, black) && software_test_pixel_is(60, 55, black), "Scissor cut too little");
+	assert(software_test_pixel_is(55, 49, black) && software_test_pixel_is(55, 60, black), "Scissor cut too little");
+
+	assert(software_test_pixel_is(160, 20, blue), "Z sorting failed, got 0x%08x", software_test_pixel(160, 20));
+
+	assert(software_test_pixel_is(205, 205, white), "Bad texel");
+	assert(software_test_pixel_is(215, 205, black), "Bad texel");
+	assert(software_test_pixel_is(205, 215, black), "Bad texel");
+	assert(software_test_pixel_is(215, 215, white), "Bad texel");
+
+	// Text takes coverage from the red channel
+	assert(software_test_pixel_is(205, 110, green), "Text quad not drawn, got 0x%08x", software_test_pixel(205, 110));
+	assert(software_test_pixel_is(215, 110, 0), "Text quad should be transparent here, got 0x%08x", software_test_pixel(215, 110));
+
+	// Png round trip
+	{
+		string png = software_framebuffer_encode_png(heap);
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(0);
+		third_party_allocator = heap;
+		u8 *rgb = stbi_load_from_memory(png.data, png.count, &width, &height, &channels, STBI_rgb);
+		stbi_set_flip_vertically_on_load(1);
+		assert(rgb, "Png could not be decoded");
+		assert(width == 256 && height == 256 && channels == 3, "Png has bad dimensions");
+		for (s32 y = 0; y < height; y++) {
+			for (s32 x = 0; x < width; x++) {
+				u32 c = software_framebuffer.pixels[(u64)y*software_framebuffer.stride + x];
+				u8 *p = rgb + ((u64)y*width + x)*3;
+				assert(p[0] == (u8)c && p[1] == (u8)(c >> 8) && p[2] == (u8)(c >> 16), "Png pixel (%d, %d) mismatch", x, y);
+			}
+		}
+		
+		// Allocators that can't reallocate have to work too, stb_image grows its buffers
+		Arena *arena = arena_make(MB(16));
+		Allocator others[] = { get_arena_allocator(arena), get_frame_allocator(), get_temporary_allocator() };
+		stbi_set_flip_vertically_on_load(0);
+		for (u64 i = 0; i < sizeof(others)/sizeof(others[0]); i++) {
+			third_party_allocator = others[i];
+			int other_width, other_height, other_channels;
+			u8 *other = stbi_load_from_memory(png.data, png.count, &other_width, &other_height, &other_channels, STBI_rgb);
+			assert(other, "Png could not be decoded with allocator %llu", i);
+			assert(bytes_match(other, rgb, (u64)width*height*3), "Png decoded differently with allocator %llu", i);
+		}
+		stbi_set_flip_vertically_on_load(1);
+		arena_destroy(arena);
+		
+		third_party_allocator = heap;
+		stbi_image_free(rgb);
+		third_party_allocator = ZERO(Allocator);
+		dealloc_string(heap, png);
+	}
+
+	// Going wide has to give the exact same picture
+	u64 pixels_size = (u64)software_framebuffer.stride*software_framebuffer.height*sizeof(u32);
+	u32 *serial_pixels = alloc(heap, pixels_size);
+	memcpy(serial_pixels, software_framebuffer.pixels, pixels_size);
+
+	job_system_init(max(os_get_number_of_logical_processors(), 4));
+	software_test_draw_golden_scene(checker, glyph);
+	gfx_update();
+	assert(memcmp(serial_pixels, software_framebuffer.pixels, pixels_size) == 0, "Multithreaded render differs from single threaded");
+	job_system_shutdown();
+
+	dealloc(heap, serial_pixels);
+
+	// Throughput
+	window.width = 1280;
+	window.height = 720;
+	const u64 rect_count = 10000;
+	const u64 frame_count = 10;
+	Vector4 *rects = alloc(heap, rect_count*sizeof(Vector4));
+	Vector4 *colors = alloc(heap, rect_count*sizeof(Vector4));
+	u64 pixel_count = 0;
+	for (u64 i = 0; i < rect_count; i++) {
+		f32 w = get_random_float32_in_range(4, 64);
+		f32 h = get_random_float32_in_range(4, 64);
+		rects[i] = v4(get_random_float32_in_range(-32, 1280), get_random_float32_in_range(-32, 720), w, h);
+		colors[i] = v4(get_random_float32_in_range(0, 1), get_random_float32_in_range(0, 1), get_random_float32_in_range(0, 1), get_random_float32_in_range(0.2, 1));
+		pixel_count += (u64)(w*h);
+	}
+	for (u64 wide = 0; wide < 2; wide++) {
+		if (wide) job_system_init(0);
+
+		u64 cycles = 0;
+		f64 seconds = 0;
+		for (u64 frame = 0; frame < frame_count; frame++) {
+			software_test_begin_frame();
+			for (u64 i = 0; i < rect_count; i++) draw_rect(rects[i].xy, rects[i].zw, colors[i]);
+
+			float64 start_seconds = os_get_current_time_in_seconds();
+			u64 start_cycles = rdtsc();
+			gfx_update();
+			cycles += rdtsc() - start_cycles;
+			seconds += os_get_current_time_in_seconds() - start_seconds;
+		}
+
+		f64 ms = (seconds*1000.0)/(f64)frame_count;
+		print("\n\t%llu rects at 1280x720 %cs: %llu cycles, %.2f ms per frame, %.1f Mpix/s",
+			rect_count, wide ? "with job system" : "single threaded", cycles/frame_count, ms, ((f64)pixel_count/1000000.0)/(ms/1000.0));
+
+		if (wide) job_system_shutdown();
+	}
+	print("\n");
+
+	dealloc(heap, rects);
+	dealloc(heap, colors);
+	delete_image(checker);
+	delete_image(glyph);
+
+	window.width = old_width;
+	window.height = old_height;
+	window.clear_color = old_clear_color;
+	reset_draw_frame(&draw_frame);
+}
+#endif
 
 typedef struct Test_Thing {
     int foo;
@@ -1375,10 +3717,78 @@ void oogabooga_run_tests() {
 	test_allocator(true);
 	print("OK!\n");
 	
+	print("Testing arena... ");
+	test_arena();
+	print("OK!\n");
+	
+	print("Testing frame storage... ");
+	test_frame_storage();
+	print("OK!\n");
+	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
+#if !GUARD_PAGE_ALLOCATIONS
+	print("Testing pool speed... ");
+	test_pool_speed();
+	print("OK!\n");
+#endif
+	
+#if !GUARD_PAGE_ALLOCATIONS
+	print("Testing allocator speed... ");
+	test_allocator_speed();
+	print("OK!\n");
+#endif
+	
+	print("Testing heap stats... ");
+	test_heap_stats();
+	print("OK!\n");
+	
+#if !GUARD_PAGE_ALLOCATIONS
+	print("Testing heap trim... ");
+	test_heap_trim();
+	print("OK!\n");
+#endif
+	
+	print("Testing aligned allocation... ");
+	test_alloc_aligned();
+	print("OK!\n");
+	
+#if GUARD_PAGE_ALLOCATIONS
+	print("Testing guard page allocations... ");
+	test_guard_page_allocations();
+	print("OK!\n");
+#endif
+	
+#if !GUARD_PAGE_ALLOCATIONS
+	print("Testing realloc speed... ");
+	test_realloc_speed();
+	print("OK!\n");
+#endif
+	
+#if !GUARD_PAGE_ALLOCATIONS
+	print("Testing threaded allocator speed... ");
+	test_allocator_threaded_speed();
+	print("OK!\n");
+#endif
+	
 	print("Testing threads... ");
 	test_threads();
 	print("OK!\n");
 	
+	print("Testing thread settings... ");
+	test_thread_settings();
+	print("OK!\n");
+	
+	print("Testing jobs... ");
+	test_jobs();
+	print("OK!\n");
+	
+	print("Testing job fibers... ");
+	test_job_fibers();
+	print("OK!\n");
+	
 	print("Testing strings... ");
 	test_strings();
 	print("OK!\n");
@@ -1410,11 +3820,53 @@ void oogabooga_run_tests() {
 	print("Testing mutex... ");
 	test_mutex();
 	print("OK!\n");
+	
+	print("Testing atomics... ");
+	test_atomics();
+	print("OK!\n");
+	
+	print("Testing semaphores... ");
+	test_semaphores();
+	print("OK!\n");
+	
+	print("Testing mutex speed... ");
+	test_mutex_speed();
+	print("OK!\n");
+	
+	print("Testing read-mostly locks... ");
+	test_read_mostly_locks();
+	print("OK!\n");
+	
+	print("Testing contended locks... ");
+	test_contended_locks();
+	print("OK!\n");
+	
+	print("Testing queues... ");
+	test_queues();
+	print("OK!\n");
+	
+	print("Testing queue speed... ");
+	test_queue_speed();
+	print("OK!\n");
 
-#ifndef OOGABOOGA_HEADLESS
+#if OOGABOOGA_HAS_GFX
 	print("Testing radix sort... ");
 	test_sort();
 	print("OK!\n");
+	
+	print("Testing draw_rect speed... ");
+	test_draw_rect_speed();
+	print("OK!\n");
+	
+	print("Testing draw quads... ");
+	test_draw_quads();
+	print("OK!\n");
+#endif
+
+#if OOGABOOGA_HAS_GFX && GFX_RENDERER == GFX_RENDERER_SOFTWARE
+	print("Testing software renderer... ");
+	test_software_renderer();
+	print("OK!\n");
 #endif
 
 	
@@ -120,11 +120,11 @@ void *third_party_malloc(size_t size) {
 	if (!size) return 0;
 	return alloc(third_party_allocator, size);
 }
-void *third_party_realloc(void *p, size_t size) {
+// Takes the old size so allocators that can't reallocate (arena, frame, temporary) can copy instead
+void *third_party_realloc(void *p, size_t old_size, size_t size) {
 	assert(third_party_allocator.proc, "No third party allocator was set, but it was used!");
 	if (!size) return 0;
-	if (!p) return third_party_malloc(size);
-	return third_party_allocator.proc(size, p, ALLOCATOR_REALLOCATE, 0);
+	return reallocate(third_party_allocator, p, old_size, size);
 }
 void third_party_free(void *p) {
 	assert(third_party_allocator.proc, "No third party allocator was set, but it was used!");
@@ -149,7 +149,7 @@ size_t stbtt_strlen(const char* str) {
 #define STBI_NO_STDIO
 #define STBI_ASSERT(x) {if (!(x)) *(volatile char*)0 = 0;}
 #define STBI_MALLOC(sz)           third_party_malloc(sz)
-#define STBI_REALLOC(p,newsz)     third_party_allocator.proc(newsz, p, ALLOCATOR_REALLOCATE, 0)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz) third_party_realloc(p,oldsz,newsz)
 #define STBI_FREE(p)              third_party_free(p)
 #include "third_party/stb_image.h"
 